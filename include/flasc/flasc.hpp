@@ -4,6 +4,7 @@
 #include <emergent/Uuid.hpp>
 #include <emergent/Io.hpp>
 #include <psinc/Instrument.h>
+#include <psinc/UsbTransport.h>
 #include <iomanip>
 #include <optional>
 
@@ -305,7 +306,7 @@ class Flasc
 		bool Kick(string serial)
 		{
 			Instrument instrument;
-			Transport transport;
+			UsbTransport transport;
 
 			if (this->LegacyConnect(transport))
 			{
@@ -652,7 +653,7 @@ class Flasc
 		bool FlashLegacy(Instrument &instrument, const std::vector<byte> &reference, const std::vector <byte> &firmware)
 		{
 			std::vector<byte> buffer;
-			Transport transport;
+			UsbTransport transport;
 			std::atomic<bool> waiting(false);
 
 			if (this->LegacyConnect(transport))
@@ -27,6 +27,75 @@ extern "C"
 
 		PSINC_UNKNOWN_DEVICE		= -9,
 
+		PSINC_TIMEOUT				= -10,
+		PSINC_NOT_STREAMING			= -11,
+		PSINC_CAMERA_BUSY			= -12,
+	};
+
+
+	// Details of a frame delivered by a stream
+	struct psinc_frame_info
+	{
+		uint64_t sequence;		// Incremented for every frame requested, so a gap indicates a dropped frame
+		int64_t timestamp;		// Monotonic time at which the transfer completed in microseconds
+		int exposure;			// The configured exposure and gain when the frame was requested
+		int gain;
+		unsigned char context;	// The context in use when the frame was requested
+	};
+
+
+	// A decoded frame on lease from a stream, which remains valid until it is released
+	struct psinc_frame
+	{
+		void *data;				// The first pixel (unsigned char, or uint16_t for an HDR stream)
+		int width;
+		int height;
+		int depth;				// Channels per pixel (1 for greyscale or 3 for RGB)
+		int stride;				// Bytes from the start of one row to the next
+		int bytes;				// Bytes per channel
+		psinc_frame_info info;
+		void *lease;			// Used internally to return the buffer to the stream
+	};
+
+
+	// Invoked for each frame of a stream on the thread that decoded it. The status is PSINC_OK
+	// or PSINC_CAMERA_IO_ERROR, in which case the image is null. The image and info are only
+	// valid for the duration of the call. Return false to end the stream, which must then still
+	// be stopped with psinc_camera_stop_stream.
+	typedef bool (*psinc_frame_callback)(void *context, int status, emg_image *image, const psinc_frame_info *info);
+	typedef bool (*psinc_hdrframe_callback)(void *context, int status, emg_hdrimage *image, const psinc_frame_info *info);
+
+
+	// Channel order of colour output
+	enum PSINC_CHANNEL_ORDER
+	{
+		PSINC_RGB	= 0,
+		PSINC_BGR	= 1,
+		PSINC_RGBA	= 2,
+		PSINC_BGRA	= 3,	// Matches 32-bit Windows bitmaps and QImage::Format_RGB32
+	};
+
+
+	// Duration of a stage of the capture path in microseconds
+	struct psinc_stage
+	{
+		double mean, p50, p90, p99, max;
+	};
+
+
+	// Timing of the capture path over recent frames
+	struct psinc_timing
+	{
+		uint64_t frames;		// Frames successfully captured
+		uint64_t failed;		// Frames that failed
+		double fps;				// Rate at which frames are returned
+
+		psinc_stage request;	// Command sent to first data received
+		psinc_stage transfer;	// First data received to transfer complete
+		psinc_stage queued;		// Transfer complete to decode start
+		psinc_stage decode;		// Decode start to decode end
+		psinc_stage callback;	// Decode end to callback return
+		psinc_stage total;		// Command sent to callback return
 	};
 
 
@@ -39,6 +108,11 @@ extern "C"
 	// Construct an instance of camera
 	psinc_camera *psinc_camera_create();
 
+	// Construct an instance of camera that communicates with a simulated device instead of
+	// physical hardware. The chip type is "v024" or "mt9", the bandwidth is in bytes per second
+	// (0 is unlimited) and the latency of each command is in microseconds.
+	psinc_camera *psinc_camera_create_simulated(const char *chip, double bandwidth, int latency);
+
 	// Initialise the camera and instruct it to connect to a specific camera.
 	// An empty serial number will instruct it to connect to the first camera it can find.
 	// The serial number supports regular expressions and can therefore be used to connect
@@ -57,12 +131,72 @@ extern "C"
 	// an image has been grabbed or an error occurs.
 	int psinc_camera_grab_hdr(psinc_camera *camera, emg_hdrimage *image);
 
+	// Start grabbing continuously. Frames are decoded into a pool of colour or greyscale images
+	// that is allocated here. If a callback is supplied then it receives each frame, otherwise
+	// the frames are held in a queue of the given length for psinc_camera_next_frame, and once
+	// the queue is full the oldest frame is dropped to make room for the newest.
+	// Returns PSINC_CAMERA_BUSY if the camera is already grabbing.
+	int psinc_camera_start_stream(psinc_camera *camera, int queue, bool colour, psinc_frame_callback callback, void *context);
+
+	// As above but for HDR frames.
+	int psinc_camera_start_stream_hdr(psinc_camera *camera, int queue, bool colour, psinc_hdrframe_callback callback, void *context);
+
+	// Stop the stream and wait until the camera has finished with it, after which the callback
+	// will not be invoked again. This must not be called from within the callback.
+	int psinc_camera_stop_stream(psinc_camera *camera);
+
+	// Wait for the oldest queued frame of a stream and copy it to the supplied image. A negative
+	// timeout (in milliseconds) waits indefinitely. The info may be null.
+	// Returns PSINC_TIMEOUT if no frame arrived in time, PSINC_CAMERA_IO_ERROR if the frame failed
+	// and PSINC_NOT_STREAMING if the stream is stopped or was started with a callback.
+	int psinc_camera_next_frame(psinc_camera *camera, emg_image *image, int timeout, psinc_frame_info *info);
+
+	// As above but for a stream started with psinc_camera_start_stream_hdr.
+	int psinc_camera_next_frame_hdr(psinc_camera *camera, emg_hdrimage *image, int timeout, psinc_frame_info *info);
+
+	// Wait for the oldest queued frame of a stream and lend its buffer to the caller instead of
+	// copying it. The buffer belongs to the pool of the stream and must be returned with
+	// psinc_frame_release, which remains safe after the stream has been stopped. Whilst more than
+	// one frame is held the oldest queued frames may be dropped to make room for new ones.
+	// The return codes are the same as for psinc_camera_next_frame and the frame data is null
+	// if the frame failed.
+	int psinc_frame_acquire(psinc_camera *camera, int timeout, psinc_frame *frame);
+
+	// Return a frame obtained from psinc_frame_acquire to its stream.
+	int psinc_frame_release(psinc_frame *frame);
+
+	// Set the number of frames requested ahead of the one being received and the number of raw
+	// frames that can be held waiting to be decoded, which applies from the next grab or stream.
+	int psinc_camera_set_pipeline(psinc_camera *camera, unsigned char depth, int decoding);
+
+	// Grab a frame and decode it directly into memory owned by the caller (such as a bitmap or a
+	// pinned array) in its final layout, which avoids copying and converting it afterwards. The depth
+	// is 1 for greyscale or otherwise the number of channels of the order (3 or 4, where alpha is
+	// opaque). The stride is the number of bytes from the start of one row to the next and the size
+	// is the number of bytes available. The dimensions of the frame are returned and the grab fails
+	// with PSINC_CAMERA_IO_ERROR if it does not fit. This function blocks like psinc_camera_grab.
+	int psinc_camera_grab_into(psinc_camera *camera, unsigned char *data, int size, int stride, int depth, int order, int &width, int &height);
+
+	// As above for HDR data.
+	int psinc_camera_grab_into_hdr(psinc_camera *camera, uint16_t *data, int size, int stride, int depth, int order, int &width, int &height);
+
 	// Set a specific camera feature to the given value.
 	int psinc_camera_set_feature(psinc_camera *camera, const char *feature, int value);
 
 	// Retrieve the value for a specific camera feature.
 	int psinc_camera_get_feature(psinc_camera *camera, const char *feature, int &value);
 
+	// Resolve a feature name to a handle (zero or positive) that can be used to access the
+	// feature without a name lookup, or a negative error code. The handle remains valid
+	// whilst the camera is connected to the same type of chip.
+	int psinc_camera_feature_handle(psinc_camera *camera, const char *feature);
+
+	// Set a camera feature by handle to the given value.
+	int psinc_camera_set_feature_by_handle(psinc_camera *camera, int handle, int value);
+
+	// Retrieve the value for a camera feature by handle.
+	int psinc_camera_get_feature_by_handle(psinc_camera *camera, int handle, int &value);
+
 	// Set the flash power for this camera.
 	int psinc_camera_set_flash(psinc_camera *camera, unsigned char power);
 
@@ -72,6 +206,10 @@ extern "C"
 	// Check camera connection status
 	bool psinc_camera_connected(psinc_camera *camera);
 
+	// Retrieve the frame rate and the time spent in each stage of the capture path over
+	// recent frames. If reset is true then the recorded frames are discarded afterwards.
+	int psinc_camera_timing(psinc_camera *camera, psinc_timing *timing, bool reset);
+
 
 
 	/* ------------------- Device ------------------- */
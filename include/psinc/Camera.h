@@ -3,7 +3,13 @@
 #include <psinc/Instrument.h>
 #include <psinc/Properties.hpp>
 #include <psinc/handlers/DataHandler.hpp>
+#include <psinc/Decoder.h>
+#include <psinc/Frame.h>
+#include <psinc/Recording.h>
+#include <psinc/Timing.hpp>
 #include <psinc/driver/Feature.h>
+#include <psinc/driver/Features.h>
+#include <psinc/driver/Batch.h>
 #include <psinc/driver/Aliases.h>
 #include <psinc/driver/Device.h>
 #include <psinc/Transport.h>
@@ -11,6 +17,8 @@
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <queue>
+#include <array>
 
 
 namespace psinc
@@ -33,8 +41,12 @@ namespace psinc
 			};
 
 
-			/// Default Constructor
-			Camera();
+			/// Constructor. A camera is connected over USB unless an alternative transport
+			/// (such as a SimulatedTransport) is supplied.
+			explicit Camera(std::unique_ptr<Transport> transport = nullptr);
+
+			/// Destructor
+			virtual ~Camera();
 
 
 			/// Initialises the transport to look for specific descriptors or on a particular
@@ -53,14 +65,61 @@ namespace psinc
 			/// @return False if grabbing could not be started (already grabbing)
 			bool GrabImage(Mode mode, DataHandler &handler, std::function<bool(bool)> callback);
 
-			/// Checks if the camera is currently performing an asynchronous image grab.
+			/// Start an asynchronous image grab where the callback also receives the metadata
+			/// for the frame (capture timestamp, sequence number, context, exposure, gain and
+			/// the sampled count where enabled).
+			bool GrabImage(Mode mode, DataHandler &handler, std::function<bool(bool, const Metadata &)> callback);
+
+			/// Checks if the camera is currently performing an asynchronous image grab (or
+			/// is part of a synchronised grab).
 			/// @return True if the camera is currently grabbing.
 			bool Grabbing();
 
+			/// Block until the current asynchronous grab has finished, which is once the callback
+			/// has stopped the stream and the handler is no longer in use. A negative timeout (ms)
+			/// waits indefinitely. This must not be called from within the callback.
+			/// @return False if the camera is still grabbing after the timeout.
+			bool AwaitGrab(int timeout = -1);
+
 			/// Sets the flash power. Depending on the camera type this can be
 			/// a xenon or LED flash.
 			void SetFlash(byte power);
 
+			/// Configure the asynchronous capture pipeline used when streaming. The depth is the
+			/// number of capture requests kept queued with the camera, so that the next frame is
+			/// requested whilst the current one is still being received, and transfers is the number
+			/// of bulk reads kept in flight. A depth of 0 (the default) uses synchronous transfers.
+			void SetPipeline(byte depth, byte transfers = 4);
+
+			/// Configure the decoupled decode stage used by subsequent calls to GrabImage. When the
+			/// capacity is non-zero the instrument thread only receives raw frames into a bounded
+			/// ring and a separate thread drains it, invoking the handler and callback, so that
+			/// decoding overlaps with the transfer of the next frame. Since frames are captured
+			/// ahead of the callback this is intended for streaming. A capacity of 0 (the default)
+			/// decodes on the instrument thread.
+			void SetDecoding(size_t capacity, Decoder::Overflow overflow = Decoder::Overflow::DropOldest);
+
+			/// Sample the Count device as part of each capture request so that its value is
+			/// delivered with the frame metadata without a separate round trip. The count is
+			/// read immediately after the frame has been captured. This must only be enabled
+			/// for cameras that provide the Count device.
+			void SetCountSampling(bool enabled);
+
+			/// Write the raw data for every frame received to a recording (see Replay) before it is
+			/// decoded, or stop recording if null. The frame is written on the instrument thread so
+			/// the recording must be on storage that can keep up with the stream.
+			void SetRecording(std::shared_ptr<Recorder> recorder);
+
+			/// Retrieve the captured/decoded/dropped/late counters for the decoupled decode stage.
+			Decoder::Statistics DecodeStatistics();
+
+			/// Retrieve the frame rate and the percentiles of the time spent in each stage of the
+			/// capture path (request, transfer, queued, decode and callback) over recent frames.
+			Timing::Statistics TimingStatistics();
+
+			/// Discard the frames recorded for the timing statistics.
+			void ResetTiming();
+
 			/// Change the context for camera chips that support multiple contexts.
 			/// Multiple contexts allow sets of features to be configured and rapidly
 			/// switched between.
@@ -77,6 +136,36 @@ namespace psinc
 			/// the default value instead.
 			bool SetWindow(byte context, int x = 0, int y = 0, int width = -1, int height = -1);
 
+			/// Begin a batch of register changes. Until the batch is committed, setting features
+			/// (directly or through SetWindow and SetProperties) only stages the new register
+			/// values, and the feature values continue to report what the camera is using.
+			/// Batches can be nested.
+			void BeginBatch();
+
+			/// Send all of the register changes staged since BeginBatch as packed transfers,
+			/// coalescing the changes to features that share a register into a single write.
+			bool CommitBatch();
+
+			/// Discard all of the register changes staged since BeginBatch.
+			void DiscardBatch();
+
+			/// Enable or disable the shadow register mode. Whilst enabled, setting features only
+			/// marks their registers as dirty and the feature values report the new settings.
+			/// The dirty registers are sent together, either with CommitRegisters or automatically
+			/// before the next frame is requested when grabbing, so that retuning many features
+			/// does not stall the stream. Disabling the mode sends anything outstanding.
+			bool SetShadowing(bool enabled);
+
+			/// Send the registers changed in shadow mode (or in an open batch) immediately.
+			bool CommitRegisters();
+
+			/// Feature values are served from the local cache unless their register is marked as
+			/// volatile, in which case it is read from the camera whenever a value is requested
+			/// (such as for status or automatic exposure readback). Each read is a round trip
+			/// that waits for any frames in flight, so should be avoided whilst streaming.
+			/// @return False if there is no register at the given address.
+			bool SetVolatile(int address, bool enabled);
+
 			// WARNING: Expert-only commands for direct access to registers. Using these
 			// will render the values stored in the feature maps above obsolete. Setting
 			// invalid values could leave the chip in an inoperative state.
@@ -88,9 +177,10 @@ namespace psinc
 			// Returns the chip type for the currently connected camera or "unknown" if no camera is present.
 			const std::string GetType();
 
-			/// A map of feature name to Feature instance for the connected device
+			/// The features of the connected device, which can be accessed by name or by a
+			/// handle resolved once with features.Find(name).
 			/// A "Feature" is a representation of a property of the imaging chip.
-			std::map<std::string, Feature> features;
+			Features features;
 
 			/// Maps common features to simple names grouped by context.
 			std::map<byte, Aliases> aliases;
@@ -117,8 +207,8 @@ namespace psinc
 			/// the grab function.
 			DataHandler *handler = nullptr;
 
-			/// Initialise the features and registers from a chip specific XML document.
-			bool Configure(pugi::xml_node xml);
+			/// Initialise the features and registers from a chip description table.
+			bool Configure(const chip::Description &description);
 
 			/// Request all register values from the camera to synchronise it with those
 			/// accessible in this driver.
@@ -126,24 +216,110 @@ namespace psinc
 
 			/// Attempt to capture data from the device. The supplied handler should
 			/// be of the appropriate type to cope with the data that will be captured.
+			/// When streaming, requests for subsequent frames are queued ahead if the
+			/// pipeline is enabled.
+			/// The frame is released once processed, leaving only its timing.
 			/// @return AcquisitionStatus
-			bool Capture(DataHandler *handler, Mode mode, int flash);
+			bool Capture(Frame &frame, DataHandler *handler, Mode mode, int flash, bool streaming);
+
+			/// Receive the raw data for a frame from the device without processing it.
+			bool Receive(Frame &frame, std::atomic<bool> &waiting, Mode mode, int flash, bool streaming);
+
+			/// Describe the frame that the current window will produce and prepare the capture
+			/// packet for it. Returns the number of bytes to request (0 if the window is empty),
+			/// otherwise the packet must be sent and then completed with Batch::Carried.
+			/// Must be called with the window lock held.
+			size_t Describe(Frame &frame, Mode mode, int flash);
+
+			/// Fill the pipeline with capture requests, returning false if nothing is queued.
+			/// Must be called with the window lock held.
+			bool Request(std::atomic<bool> &waiting, Mode mode, int flash, bool streaming);
+
+			/// Fill in the metadata that is only known once the frame has been received.
+			void Finish(Frame &frame);
+
+			/// Ensure that the next frame of the current grab has been requested and check whether
+			/// it can be received without waiting. Used by a CameraGroup so that the shared thread
+			/// only blocks when every camera is waiting for data.
+			bool Ready();
+
+			/// Discard any frames that were queued ahead in the pipeline.
+			void Flush();
+
+
+			/// The chip registers for the connected camera in address order. The features
+			/// refer to these so the storage must not change once configured.
+			std::vector<Register> registers;
+
+			/// Handles for the integer and fractional parts of a channel gain
+			struct ChannelGain
+			{
+				Features::Handle integer	= Features::INVALID;
+				Features::Handle fraction	= Features::INVALID;
+			};
 
+			/// The red, green1, green2 and blue channel gains for each context (where supported)
+			std::array<std::array<ChannelGain, 4>, 2> gains;
 
-			/// The chip registers for the connected camera. The map key is the register
-			/// address.
-			std::map<int, Register> registers;
+			/// Register writes staged for sending together
+			Batch batch;
 
 			/// Byte buffer containing the packet to be transmitted to the actual device
 			/// this class represents.
 			std::vector<byte> send;
 
-			/// Byte buffer used to receive data from the device during a capture.
-			std::vector<byte> receive;
+			/// The packet for the current capture request, which also carries any dirty shadow
+			/// registers ahead of the capture command
+			std::vector<byte> packet;
+
+
+
+			/// The description of each frame currently queued in the pipeline since the
+			/// window could be changed whilst there are requests outstanding.
+			std::queue<Frame> pending;
+
+			/// Number of capture requests to keep queued when streaming (0 disables the pipeline)
+			byte pipeline = 0;
+
+			/// Set once the callback has requested another frame so that the pipeline is only
+			/// filled when streaming (avoiding unwanted captures for a single grab).
+			bool streaming = false;
+
+
+			/// The decoupled decode stage
+			Decoder decoder;
+
+			/// Capacity of the decode ring (0 disables the decoupled decode stage)
+			size_t ring = 0;
+
+			/// Behaviour of the decode ring when full
+			Decoder::Overflow overflow = Decoder::Overflow::DropOldest;
+
+			/// Set if the current grab is using the decoupled decode stage
+			bool decoupled = false;
+
+			/// Records the time spent in each stage of the capture path for recent frames
+			Timing timing;
 
 
 			/// Image capture complete callback
-			std::function<bool(bool)> callback	= nullptr;
+			std::function<bool(bool, const Metadata &)> callback = nullptr;
+
+			/// Signalled (with the critical section held) when a grab finishes
+			std::condition_variable finished;
+
+			/// Incremented for each frame requested from the camera
+			uint64_t sequence = 0;
+
+			/// Set if the Count device is sampled with each frame
+			bool counting = false;
+
+			/// Receives a copy of every frame when recording
+			std::shared_ptr<Recorder> recorder;
+
+			/// Set whilst the camera is part of a synchronised grab driven by its group,
+			/// during which it cannot be grabbed individually
+			std::atomic<bool> synchronised = false;
 
 			/// Storage for the capture mode
 			Mode mode = Mode::Normal;
@@ -186,5 +362,8 @@ namespace psinc
 			// Maximum exposure range when converting a normalised exposure property to an integer feature value
 			// The full range of exposure is not usually necessary since active lighting is most commonly used.
 			static const int MAX_EXPOSURE = 1024;
+
+			/// The group drives the capture stages directly for a synchronised grab
+			friend class CameraGroup;
 	};
 }
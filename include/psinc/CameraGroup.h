@@ -0,0 +1,181 @@
+#pragma once
+
+#include <psinc/Camera.h>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <vector>
+
+
+namespace psinc
+{
+	class UsbContext;
+
+	/// Drives a number of cameras from a single thread.
+	///
+	/// A standalone Camera has its own thread and its own libusb context. The cameras in
+	/// a group instead share one libusb context and are all serviced by the group thread,
+	/// which only wakes when USB events arrive (transfers completing, hotplugging) or a
+	/// camera is asked to do something. Each camera streams through the asynchronous
+	/// pipeline and, where enabled, decodes on its own decode stage, so the group thread
+	/// only ever blocks when every camera is waiting for data and the processor time used
+	/// scales with the data rate rather than with the number of cameras.
+	class CameraGroup
+	{
+		public:
+
+			/// A camera taking part in a synchronised grab and the handler for its data
+			struct Member
+			{
+				Camera *camera			= nullptr;
+				DataHandler *handler	= nullptr;
+			};
+
+
+			/// Constructor. The pipeline depth and decode ring capacity are applied to each
+			/// camera as it is added (see Camera::SetPipeline and Camera::SetDecoding). A
+			/// pipeline depth of 0 is not recommended since each frame would then be a single
+			/// blocking transfer that holds up the rest of the group.
+			explicit CameraGroup(byte pipeline = 2, size_t decoding = 2);
+
+			/// Destructor. Stops the thread and then disposes of the cameras.
+			~CameraGroup();
+
+			CameraGroup(const CameraGroup &) = delete;
+			CameraGroup &operator=(const CameraGroup &) = delete;
+
+
+			/// Add a camera connected over USB. The parameters are the same as for
+			/// Camera::Initialise. The camera remains owned by the group.
+			Camera &Add(std::string serial = "", std::function<void(bool)> onConnection = nullptr, int timeout = 500, const std::set<uint16_t> &vendors = Instrument::Vendors::All);
+
+			/// Add a camera using an alternative transport (such as a SimulatedTransport).
+			Camera &Add(std::unique_ptr<Transport> transport, std::string serial = "", std::function<void(bool)> onConnection = nullptr, int timeout = 500, const std::set<uint16_t> &vendors = Instrument::Vendors::All);
+
+			/// The number of cameras in the group
+			size_t Size();
+
+			/// Access a camera by the order in which it was added
+			Camera &operator[](size_t index);
+
+
+			/// Start a synchronised grab across a master and slaves that are wired together and
+			/// belong to this group. For each cycle all of the slaves are armed and, as soon as
+			/// every one of them is waiting for the sync signal, the master is triggered. The
+			/// callback is invoked once per cycle after all of the frames have been received and
+			/// decoded (in parallel on the shared worker pool) with the overall status and the
+			/// metadata of each frame, including its capture timestamp, ordered master first and
+			/// then the slaves. Returning true continues streaming, in which case the slaves are
+			/// armed for the next cycle as soon as the master has been triggered so that no frame
+			/// period is lost waiting for them. The master is only triggered for the next cycle
+			/// once the slaves have delivered their frames for the current one.
+			/// @return False if a synchronised grab is already in progress or any of the cameras
+			/// is not part of this group or is already grabbing.
+			bool GrabSynchronised(const Member &master, const std::vector<Member> &slaves, std::function<bool(bool, const std::vector<Metadata> &)> callback, Camera::Mode edge = Camera::Mode::SlaveRising);
+
+			/// Returns true whilst a synchronised grab is in progress.
+			bool Synchronising();
+
+
+			/// Wake the group thread, such as when a grab has been started.
+			void Notify();
+
+
+		private:
+
+			/// The state of a synchronised grab, which is only accessed by the group thread
+			/// once it has started.
+			struct Synchronised
+			{
+				struct Participant
+				{
+					Camera *camera			= nullptr;
+					DataHandler *handler	= nullptr;
+					Camera::Mode mode		= Camera::Mode::Normal;
+					std::deque<Frame> frames;						// Requested but not yet received
+					std::atomic<bool> armed[2] = { false, false };	// Set once the request for a cycle has been sent (alternating)
+				};
+
+				/// The master followed by the slaves (a deque since the participants cannot be moved)
+				std::deque<Participant> members;
+
+				std::function<bool(bool, const std::vector<Metadata> &)> callback = nullptr;
+
+				/// Number of cycles for which the slaves have been armed, the master triggered and
+				/// the frames collected
+				uint64_t requested	= 0;
+				uint64_t triggered	= 0;
+				uint64_t collected	= 0;
+
+				/// Set once the callback has requested another cycle
+				bool streaming = false;
+
+				/// Set once the callback has stopped the grab, any cycles still in progress
+				/// are completed and discarded
+				bool stopping = false;
+
+				/// When the slaves for the next cycle to be triggered started arming (or finished
+				/// delivering the previous cycle if later)
+				std::chrono::steady_clock::time_point since;
+			};
+
+
+			/// Progress the synchronised grab without blocking. Returns true if the thread is
+			/// safe to go to sleep.
+			bool Synchronise(Synchronised &sync);
+
+			/// Request a frame from a participant in the given mode
+			bool Request(Synchronised::Participant &participant, std::atomic<bool> &armed, Camera::Mode mode);
+
+			/// Collect the oldest requested frame from a participant
+			bool Receive(Synchronised::Participant &participant, Frame &frame);
+
+			/// Discard everything that has been requested after a failure
+			void Abort(Synchronised &sync);
+
+
+			/// Take ownership of a camera using the given transport and initialise it. An external
+			/// transport does not use the shared context.
+			Camera &Insert(std::unique_ptr<Transport> transport, bool external, std::string serial, std::function<void(bool)> onConnection, int timeout, const std::set<uint16_t> &vendors);
+
+			/// Entry point for the thread
+			void Entry();
+
+			/// Sleep until there is something to do
+			void Wait(bool grabbing);
+
+
+			/// The libusb context shared by the cameras connected over USB. This must
+			/// outlive the cameras since their transports refer to it.
+			std::shared_ptr<UsbContext> context;
+
+			/// The cameras in the order they were added
+			std::vector<std::unique_ptr<Camera>> cameras;
+
+			/// Set when a camera has been added so that the thread updates its list
+			std::atomic<bool> added = false;
+
+			/// The number of cameras that do not use the shared context. Events for these
+			/// cannot wake the thread so it must poll them whilst grabbing.
+			std::atomic<size_t> external = 0;
+
+			/// Applied to each camera as it is added
+			byte pipeline	= 2;
+			size_t decoding	= 2;
+
+			/// Protects the list of cameras
+			std::mutex cs;
+
+			/// Set by Notify so that a wake is not missed if the thread is busy
+			std::atomic<bool> woken = false;
+
+			/// Control flag for the thread
+			std::atomic<bool> run = true;
+
+			/// The synchronised grab in progress (if any)
+			std::unique_ptr<Synchronised> sync;
+
+			/// The thread
+			std::thread _thread;
+	};
+}
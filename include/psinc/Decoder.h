@@ -0,0 +1,105 @@
+#pragma once
+
+#include <psinc/Frame.h>
+#include <psinc/Timing.hpp>
+#include <condition_variable>
+#include <functional>
+#include <thread>
+#include <deque>
+
+
+namespace psinc
+{
+	/// A decode stage that is decoupled from the transport. Raw frames are pushed into
+	/// a bounded ring by the instrument thread and drained by a separate thread which
+	/// invokes the data handler and callback, so that decoding of one frame overlaps
+	/// with the USB transfer of the next.
+	class Decoder
+	{
+		public:
+
+			/// The behaviour when a frame is pushed and the ring is full
+			enum class Overflow
+			{
+				DropOldest,	///< Discard the oldest frame in the ring to make room
+				Block		///< Wait for the decode thread to make room
+			};
+
+			struct Statistics
+			{
+				uint64_t captured	= 0;	///< Frames pushed into the ring
+				uint64_t decoded	= 0;	///< Frames successfully processed by the handler
+				uint64_t dropped	= 0;	///< Frames discarded because the ring was full
+				uint64_t late		= 0;	///< Frames that were not decoded before the next one arrived
+			};
+
+
+			Decoder() {}
+			~Decoder();
+
+			/// Begin decoding with the given handler and callback. The callback is invoked from the
+			/// decode thread with the status and metadata of each frame and, as with Camera::GrabImage, returning
+			/// false will stop the stream. If timing is supplied then each frame is recorded once the
+			/// callback returns.
+			void Start(size_t capacity, Overflow overflow, DataHandler *handler, std::function<bool(bool, const Metadata &)> callback, Timing *timing = nullptr);
+
+			/// Push a frame into the ring, a failed capture is passed on to the callback in order.
+			/// Returns false once the stream has been stopped by the callback.
+			bool Push(Frame &&frame, bool success);
+
+			/// Discard anything still in the ring and wait for the frame currently being decoded.
+			void Stop();
+
+			/// Returns true if a stream is active and has not been stopped by the callback.
+			bool Running();
+
+			/// Retrieve the counters for the current (or most recent) stream
+			Statistics Stats();
+
+
+		private:
+
+			struct Item
+			{
+				Frame frame;
+				bool success = false;
+			};
+
+			/// Entry point for the decode thread
+			void Entry();
+
+			/// Protects the ring and state
+			std::mutex cs;
+
+			/// Signalled when a frame is pushed or the state changes
+			std::condition_variable available;
+
+			/// Signalled when space is made in the ring or a frame has been decoded
+			std::condition_variable space;
+
+			/// The ring of frames waiting to be decoded
+			std::deque<Item> ring;
+
+			/// Maximum number of frames held in the ring
+			size_t capacity = 1;
+
+			Overflow overflow = Overflow::DropOldest;
+
+			DataHandler *handler = nullptr;
+			std::function<bool(bool, const Metadata &)> callback = nullptr;
+			Timing *timing = nullptr;
+
+			/// Set whilst a stream is active (cleared by the callback or Stop)
+			bool running = false;
+
+			/// Set whilst the decode thread is processing a frame outside of the lock
+			bool busy = false;
+
+			/// Control flag for the thread
+			bool run = false;
+
+			Statistics statistics;
+
+			std::thread _thread;
+	};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <psinc/TransportBuffer.hpp>
+#include <psinc/Timing.hpp>
+#include <psinc/handlers/DataHandler.hpp>
+
+
+namespace psinc
+{
+	using emg::byte;
+
+	/// Information about a frame that is delivered alongside the image
+	struct Metadata
+	{
+		/// Monotonic time at which the transfer of the frame completed
+		std::chrono::steady_clock::time_point timestamp;
+
+		/// Incremented for every frame requested from the camera, so a gap indicates
+		/// a frame that failed or was dropped
+		uint64_t sequence = 0;
+
+		/// The context, exposure and gain in effect when the frame was requested. These
+		/// are the configured values and will not reflect automatic adjustments.
+		byte context	= 0;
+		int exposure	= 0;
+		int gain		= 0;
+
+		/// The value of the Count device sampled with the frame (see Camera::SetCountSampling)
+		bool counted	= false;
+		uint64_t count	= 0;
+	};
+
+	/// A raw frame as received from the camera along with everything
+	/// required to decode it at a later point.
+	struct Frame
+	{
+		/// The raw data on loan from the transport buffer pool
+		TransportPool::Lease data;
+
+		size_t width	= 0;
+		size_t height	= 0;
+		bool monochrome	= true;
+		bool hdr		= false;
+		byte bayerMode	= 0;
+
+		/// The number of bytes following the image data (such as a sampled count)
+		size_t trailer	= 0;
+
+		Metadata metadata;
+
+		/// Stamped at each stage of the capture path
+		FrameTiming timing;
+
+
+		/// Decode this frame using the given handler
+		bool Process(DataHandler &handler)
+		{
+			this->timing.decoding = FrameTiming::Clock::now();
+
+			const bool result = this->data
+				&& this->data->Size() >= this->trailer
+				&& handler.Process(this->monochrome, this->hdr, this->data->Data(), this->data->Size() - this->trailer, this->width, this->height, this->bayerMode);
+
+			this->timing.decoded = FrameTiming::Clock::now();
+
+			return result;
+		}
+	};
+}
@@ -2,13 +2,15 @@
 
 #include <psinc/Transport.h>
 #include <psinc/driver/Device.h>
-#include <condition_variable>
+#include <mutex>
 #include <atomic>
 #include <thread>
 
 
 namespace psinc
 {
+	class CameraGroup;
+
 	enum class ResetLevel
 	{
 		Connection		= 0xff,	// Full hardware reset at the USB transport level
@@ -42,8 +44,9 @@ namespace psinc
 
 
 
-			/// Default Constructor
-			Instrument() {}
+			/// Constructor. The instrument communicates with physical hardware over USB
+			/// unless an alternative transport (such as a SimulatedTransport) is supplied.
+			explicit Instrument(std::unique_ptr<Transport> transport = nullptr);
 
 			/// Destructor
 			virtual ~Instrument();
@@ -74,6 +77,10 @@ namespace psinc
 			/// Returns the USB major version of the connection and 0 if no device is connected
 			uint8_t UsbVersion() const;
 
+			/// Returns the hit/miss/fallback counters for the pool of receive buffers. A
+			/// fallback indicates that device (DMA) memory could not be allocated.
+			TransportPool::Statistics BufferStatistics();
+
 
 			/// Retrieve list of all serial numbers for any connected instruments of the given type
 			static std::map<std::string, Transport::Info> List(uint16_t product = Type::Camera, const std::set<uint16_t> &vendors = Vendors::All);
@@ -98,12 +105,15 @@ namespace psinc
 			/// Returns true if the thread is safe to go to sleep.
 			virtual bool Main() { return true; }
 
+			/// Wake the thread driving this instrument (its own or that of the group it belongs to).
+			void Notify();
+
 
-			/// The communications layer, effectively a wrapper around libusb 1.0.
-			Transport transport;
+			/// Ownership of the communications layer, which is usually a wrapper around libusb 1.0.
+			std::unique_ptr<Transport> link;
 
-			/// Condition variable used to wake the thread
-			std::condition_variable condition;
+			/// The communications layer
+			Transport &transport;
 
 			/// Critical section mutex
 			std::mutex cs;
@@ -111,18 +121,25 @@ namespace psinc
 			/// Invoked when the connection status changes
 			std::function<void(bool)> onConnection = nullptr;
 
+			/// The group that drives this instrument in place of its own thread (if any)
+			CameraGroup *group = nullptr;
+
 
 		private:
 
 			/// Entry point for the thread
 			void Entry();
 
+			/// A single iteration of the main loop (which must be called with the critical
+			/// section held). Returns true if the thread is safe to go to sleep.
+			bool Step();
+
 
 			/// The thread
 			std::thread _thread;
 
-			/// Control flag for the thread
-			std::atomic<bool> run;
+			/// Control flag for the thread (which is never started for an instrument in a group)
+			std::atomic<bool> run = false;
 
 			/// Set to true once initialised so that the thread is only created once
 			/// even though the Initialise function can be called multiple times if the serial
@@ -131,5 +148,8 @@ namespace psinc
 
 			/// Set to true if the instrument is fully configured and refreshed after connection.
 			bool configured = false;
+
+			/// The group calls Step for each of its instruments from a single thread
+			friend class CameraGroup;
 	};
 }
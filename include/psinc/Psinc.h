@@ -1,6 +1,7 @@
 #pragma once
 
 #include <psinc/Camera.h>
+#include <psinc/CameraGroup.h>
 
 
 namespace psinc
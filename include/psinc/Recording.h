@@ -0,0 +1,142 @@
+#pragma once
+
+#include <psinc/Frame.h>
+#include <psinc/handlers/DataHandler.hpp>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace psinc
+{
+	using emg::byte;
+
+	/// The layout of a recording, which is a compact append-only file of raw frames exactly as
+	/// they were received from the camera along with everything required to decode them.
+	///
+	/// The file begins with a Header and is followed by a Record for each frame. The raw data
+	/// (without any trailer) immediately follows its record and is padded to a multiple of 8
+	/// bytes so that every record, and the data, remains aligned within a memory mapping. All
+	/// values are in the native byte order, which is little-endian on all supported platforms.
+	/// A record that is incomplete, such as when recording was interrupted, ends the file.
+	namespace recording
+	{
+		static constexpr char MAGIC[8]		= { 'P', 'S', 'I', 'N', 'C', 'R', 'E', 'C' };
+		static constexpr uint32_t VERSION	= 1;
+		static constexpr uint32_t FRAME		= 0x454d5246;	// "FRME"
+
+		struct Header
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t reserved;
+		};
+
+		struct Record
+		{
+			uint32_t magic;
+			uint32_t size;			// Bytes of raw data that follow
+			uint32_t width;
+			uint32_t height;
+			int32_t exposure;
+			int32_t gain;
+			uint64_t sequence;
+			int64_t sent;			// Time at which the capture command was sent (ns, steady clock)
+			int64_t received;		// Time at which the transfer completed (ns, steady clock)
+			uint64_t count;
+			byte monochrome;
+			byte hdr;
+			byte bayerMode;
+			byte context;
+			byte counted;
+			byte reserved[3];
+		};
+
+		static_assert(sizeof(Header) == 16 && sizeof(Record) == 64, "The recording layout must not contain any padding");
+	}
+
+
+	/// Writes raw frames to a recording (see Camera::SetRecording). It is safe to share a recorder
+	/// between cameras, in which case the frames are interleaved in the order they arrive.
+	class Recorder
+	{
+		public:
+
+			~Recorder();
+
+			/// Open a recording. If the file already holds a recording then new frames are appended
+			/// to it, otherwise it is created.
+			bool Open(const std::string &path);
+
+			void Close();
+
+			/// Append a received frame. The data is written directly from the transport buffer.
+			bool Write(const Frame &frame);
+
+			/// The number of frames written since the recording was opened
+			uint64_t Frames();
+
+
+		private:
+
+			std::mutex cs;
+			std::FILE *file = nullptr;
+			uint64_t frames = 0;
+	};
+
+
+	/// Replays a recording through a data handler without a camera or transport, so that problems
+	/// seen in the field can be reproduced and image pipelines benchmarked or regression tested on
+	/// real sensor data. The file is memory-mapped and the frames are decoded directly from the
+	/// mapping, so a recording of any length can be replayed without reading it into memory.
+	class Replay
+	{
+		public:
+
+			enum class Speed
+			{
+				Maximum,	///< Deliver each frame as soon as the previous callback returns
+				Recorded	///< Deliver frames at the intervals at which they were originally received
+			};
+
+
+			~Replay();
+
+			/// Map a recording and index the frames within it
+			bool Open(const std::string &path);
+
+			void Close();
+
+			/// The number of complete frames in the recording
+			size_t Size() const;
+
+			/// Decode a single frame with the given handler. The metadata (where supplied) is filled
+			/// with the values recorded, including the original timestamp.
+			bool Process(size_t index, DataHandler &handler, Metadata *metadata = nullptr) const;
+
+			/// Decode the frames in order from the first given, invoking the callback after each one
+			/// as with Camera::GrabImage. Returning false from the callback stops the replay, which
+			/// otherwise ends with the last frame. Runs on the calling thread.
+			/// @return The number of frames replayed
+			size_t Play(DataHandler &handler, std::function<bool(bool, const Metadata &)> callback, Speed speed = Speed::Maximum, size_t first = 0) const;
+
+
+		private:
+
+			/// Read the record for a frame, returning a pointer to its data
+			const byte *Read(size_t index, recording::Record &record) const;
+
+			const byte *data	= nullptr;
+			size_t length		= 0;
+
+			/// The offset of the record for each frame
+			std::vector<size_t> index;
+
+			#ifdef _WIN32
+				void *file		= nullptr;
+				void *mapping	= nullptr;
+			#endif
+	};
+}
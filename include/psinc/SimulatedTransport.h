@@ -0,0 +1,218 @@
+#pragma once
+
+#include <psinc/Transport.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+
+
+namespace psinc
+{
+	/// Simulated transport implementation.
+	///
+	/// A software camera that interprets the command protocol (driver/Commands.h)
+	/// against an in-memory register file initialised from the chip XML. Frames are
+	/// synthetic and are served at a configurable bandwidth and latency so that full
+	/// capture throughput can be measured, and timing problems reproduced, without
+	/// a camera attached. The first 4 bytes of each frame hold a little-endian frame
+	/// counter so that dropped or reordered frames can be detected, and the Count
+	/// device reports the number of frames captured.
+	class SimulatedTransport : public Transport
+	{
+		public:
+
+			struct Configuration
+			{
+				std::string chip	= "v024";		// Chip type used for the register file ("v024" or "mt9")
+				std::string serial	= "SIMULATED";	// The serial number reported by the camera
+				bool monochrome		= false;		// Report a monochrome sensor instead of bayer
+				double bandwidth	= 40e6;			// Rate at which data is delivered in bytes per second (0 is unlimited)
+				int latency			= 200;			// Turnaround time of each command in microseconds
+				int jitter			= 0;			// Maximum random addition to the latency in microseconds
+			};
+
+
+			SimulatedTransport() : SimulatedTransport(Configuration()) {}
+			explicit SimulatedTransport(const Configuration &configuration);
+
+			/// Initialises the transport with the serial of interest, which is treated
+			/// as a regex expression. The camera connects at the next poll.
+			bool Initialise(const std::set<uint16_t> &vendors, uint16_t product, std::string serial, std::function<void(bool)> onConnection, int timeout = 500) override;
+
+			void SetTimeout(int timeout) override;
+
+			/// Raise any pending connection events.
+			void Poll(int time) override;
+
+			/// Block until a connection event is pending, the oldest queued frame would
+			/// have been delivered, or the wait is interrupted.
+			void Wait(int time) override;
+
+			/// Wake a thread that is blocked in Wait.
+			void Interrupt() override;
+
+			/// Report whether or not the transport is connected.
+			bool Connected() const override;
+
+			/// Interpret the command packet and read the response (if required)
+			bool Transfer(std::vector<byte> *send, std::vector<byte> *receive, std::atomic<bool> &waiting, bool check = true, bool truncate = false) override;
+
+			/// Interpret the command packet and read the response into a leased buffer
+			bool Transfer(std::vector<byte> *send, TransportBuffer &receive, std::atomic<bool> &waiting, FrameTiming *timing = nullptr, size_t trailer = 0) override;
+
+			/// Lease a receive buffer from the pool.
+			TransportPool::Lease Lease(size_t size) override;
+
+			/// Retrieve the receive buffer pool counters
+			TransportPool::Statistics BufferStatistics() override;
+
+			/// Queue a frame request. It is delivered once the simulated link has had time
+			/// to transfer it following any requests that were queued before. The simulated
+			/// link has no packets so the trailer is simply part of the response.
+			bool Queue(const std::vector<byte> &command, size_t size, std::atomic<bool> &waiting, size_t trailer = 0) override;
+
+			/// Wait for the oldest queued frame to be delivered and hand over its buffer.
+			bool Collect(TransportPool::Lease &receive, FrameTiming *timing = nullptr) override;
+
+			/// Returns true once the oldest queued frame would have been delivered.
+			bool Ready() override;
+
+			/// The number of frames that have been queued but not yet collected.
+			size_t Queued() override;
+
+			/// Discard everything that has been queued.
+			void Flush() override;
+
+			/// Nothing is ever in flight so this is the same as Flush.
+			void Cancel() override;
+
+			/// There are no bulk transfers to configure so this has no effect.
+			void SetTransfers(size_t count, size_t size = 256 * 1024) override;
+
+			/// A control reset reboots the simulated camera, which disconnects and then
+			/// connects again at the following poll.
+			bool Reset(bool control = false) override;
+
+			/// Force a disconnection. It will not connect again until re-initialised or plugged in.
+			void Disconnect() override;
+
+			/// The simulated camera always reports a USB 2 connection
+			uint8_t UsbVersion() const override;
+
+
+			/// Simulate plugging in or unplugging the camera. The resulting connection
+			/// events are raised at the next poll.
+			void Plug(bool attached);
+
+			/// Retrieve the value of a register in the simulated register file or -1 if
+			/// the register does not exist.
+			int Peek(int address);
+
+
+		private:
+
+			/// A frame request that has been queued for streaming
+			struct Request
+			{
+				TransportPool::Lease data;
+				FrameTiming timing;
+				bool failed = false;
+			};
+
+
+			/// Load the register file from the chip table
+			bool Load();
+
+			/// Interpret each of the commands in a packet, appending any responses to the output.
+			bool Execute(const std::vector<byte> &packet);
+
+			/// Append the synthetic frame data for a capture command to the output.
+			void Capture(size_t size);
+
+			/// Append the response to a register page read to the output.
+			void Page(byte page);
+
+			/// The data returned when a device is read
+			std::vector<byte> Describe(byte index);
+
+			/// Discard any response data that has not been read.
+			void Discard();
+
+			/// Take up to the given amount of data from the output, returning the number of bytes read.
+			size_t Read(byte *data, size_t size);
+
+			/// Send a packet and receive the response, blocking for as long as the transfer would take.
+			bool Exchange(const std::vector<byte> *send, byte *data, size_t size, std::atomic<bool> &waiting, bool check, size_t &transferred, FrameTiming *timing = nullptr);
+
+			/// Reserve the simulated link for a command and the given amount of response data,
+			/// stamping the times at which the first and last of it will have been delivered.
+			/// Returns false if that would exceed the timeout.
+			bool Schedule(size_t size, FrameTiming &timing);
+
+
+			/// Simulation parameters
+			Configuration configuration;
+
+			/// Guards the simulated camera state since transfers can come from any thread
+			mutable std::mutex cs;
+
+			/// Used to wake a thread blocked in Wait (when interrupted or a camera arrives)
+			std::condition_variable wake;
+			bool woken = false;
+
+			/// The serial number of interest, supports a regex string.
+			std::string serial;
+
+			/// Invoked when the connection status changes
+			std::function<void(bool)> onConnection = nullptr;
+
+			/// Connection state. The camera connects at the next poll once it has arrived and is
+			/// attached, and a disconnection event is raised if it is unplugged whilst connected.
+			bool attached	= true;
+			bool arrived	= false;
+			bool connected	= false;
+			bool disconnect	= false;
+
+			/// Chip properties taken from the chip table
+			byte type			= 0x00;
+			int addressSize		= 1;
+			bool hdr			= false;
+
+			/// The register file (address and value) and the values that it is reset to
+			std::map<int, uint16_t> registers;
+			std::map<int, uint16_t> defaults;
+
+			/// Data held by the camera devices (storage blocks, name, serial and so on)
+			std::map<byte, std::vector<byte>> devices;
+
+			/// Channel selected for each device
+			std::map<byte, uint16_t> channels;
+
+			/// Response data waiting to be read
+			std::vector<byte> output;
+			size_t position = 0;
+
+			/// Synthetic frame content, regenerated whenever the frame size changes
+			std::vector<byte> pattern;
+
+			/// Incremented for each frame captured
+			uint32_t sequence = 0;
+
+			/// The time at which the simulated link becomes free
+			std::chrono::steady_clock::time_point busy;
+
+			/// Source of the latency jitter
+			std::minstd_rand random;
+
+			/// Frames queued for streaming in the order they were requested
+			std::deque<Request> frames;
+
+			/// Pool of receive buffers
+			TransportPool pool;
+
+			/// A transfer that would take longer than this (in ms) fails as it would over USB
+			int timeout = 500;
+	};
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <psinc/UsbTransport.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+
+namespace psinc
+{
+	/// Simulated libusb backend.
+	///
+	/// Stands in for a streaming device behind a UsbTransport (see UsbTransport::Attach) so that
+	/// the asynchronous pipeline, including the ring of read transfers and the handling of failed
+	/// and cancelled transfers, can be exercised without hardware. Every command submitted as an
+	/// asynchronous transfer requests a frame, which the device sends on the read endpoint at the
+	/// configured bandwidth followed by an optional trailer (such as the count appended to a capture).
+	/// As with a real endpoint, a read only completes early when the frame or trailer ends with a
+	/// short packet, otherwise the data runs on into the same read. Every byte of a frame and its
+	/// trailer holds the low byte of its sequence number so that misaligned data can be detected.
+	/// Transfers complete, and their callbacks are invoked, whilst events are being handled.
+	class SimulatedUsb : public UsbBackend
+	{
+		public:
+
+			struct Configuration
+			{
+				size_t frame		= 752 * 480;	// Size of each frame in bytes
+				double bandwidth	= 0;			// Rate at which data is sent in bytes per second (0 is unlimited)
+				size_t trailer		= 0;			// Size of the trailer sent as a separate packet after each frame
+				size_t packet		= 512;			// Maximum packet size of the read endpoint (1024 for USB 3)
+			};
+
+
+			/// Faults that can be injected into the stream
+			enum class Fault
+			{
+				None,
+				Short,		// The device abandons the current frame, ending the read with a short packet
+				Timeout,	// The device stops sending so reads time out
+				Hang,		// The device stops sending and transfers only complete if cancelled
+				Disconnect	// The device is unplugged so transfers fail and no more can be submitted
+			};
+
+
+			SimulatedUsb() : SimulatedUsb(Configuration()) {}
+			explicit SimulatedUsb(const Configuration &configuration);
+
+			/// The handle to attach to a transport
+			libusb_device_handle *Device();
+
+			/// Inject a fault once a further number of bytes have been sent. Injecting Fault::None
+			/// clears a fault that is pending or in effect, after which the device sends any frames
+			/// that are still outstanding.
+			void Inject(Fault fault, size_t after = 0);
+
+			/// The number of transfers that have been submitted but have not yet completed.
+			size_t Pending();
+
+			/// Returns true once the device has been closed by the transport.
+			bool Closed();
+
+			int Submit(libusb_transfer *transfer) override;
+			int Cancel(libusb_transfer *transfer) override;
+			int Handle(libusb_context *context, struct timeval *time) override;
+
+			/// Commands are accepted but register reads are not simulated and so time out.
+			int Transfer(libusb_device_handle *handle, byte endpoint, byte *data, int size, int *transferred, unsigned int timeout) override;
+
+			int Reset(libusb_device_handle *handle, bool control, unsigned int timeout) override;
+			void Close(libusb_device_handle *handle) override;
+
+			/// Receive buffers are always allocated from normal memory
+			bool Mapped() const override { return false; }
+
+
+		private:
+
+			using Clock = std::chrono::steady_clock;
+
+			/// A transfer owned by the device
+			struct Submission
+			{
+				libusb_transfer *transfer;
+				Clock::time_point submitted;
+				int received = 0;	// Bytes sent into the transfer so far
+			};
+
+
+			/// The data of a requested frame that is still to be sent
+			struct Frame
+			{
+				size_t data;		// Bytes of the frame itself
+				size_t trailer;		// Bytes of the trailer, which are sent once the frame is complete
+			};
+
+
+			/// Complete whatever the device has sent or failed by the given time, returning
+			/// the time at which something would next complete if nothing does now.
+			/// Must be called with the lock held.
+			Clock::time_point Progress(Clock::time_point now);
+
+			/// Finish the transfer with the given status and queue it for its callback to be invoked.
+			/// Must be called with the lock held.
+			void Complete(libusb_transfer *transfer, libusb_transfer_status status, int length = 0);
+
+			/// Returns true if the given fault is in effect. Must be called with the lock held.
+			bool Active(Fault fault) const;
+
+
+			/// Simulation parameters
+			Configuration configuration;
+
+			/// Guards the device state since transfers can be submitted from any thread
+			std::mutex cs;
+
+			/// Signalled when a transfer is submitted or cancelled
+			std::condition_variable changed;
+
+			/// Transfers waiting on the write and read endpoints
+			std::deque<Submission> writes;
+			std::deque<Submission> reads;
+
+			/// Transfers that have finished and are waiting for their callbacks to be invoked
+			std::deque<libusb_transfer *> completed;
+
+			/// The requested frames that are still to be sent
+			std::deque<Frame> frames;
+
+			/// Sequence number of the frame at the front of the queue
+			uint32_t sequence = 0;
+
+			/// Total number of bytes sent
+			size_t sent = 0;
+
+			/// The pending fault and the point in the stream at which it takes effect
+			Fault fault		= Fault::None;
+			size_t trigger	= 0;
+
+			/// The time at which the link finishes sending the data already read
+			Clock::time_point busy;
+
+			/// Set once the device has been closed
+			bool closed = false;
+	};
+}
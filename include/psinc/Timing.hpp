@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+
+namespace psinc
+{
+	/// Timestamps for each stage of the capture path of a single frame
+	struct FrameTiming
+	{
+		using Clock = std::chrono::steady_clock;
+
+		Clock::time_point sent;		// Capture command sent to the camera
+		Clock::time_point first;	// First data received (resolved to the granularity of the USB transfers)
+		Clock::time_point received;	// Transfer complete
+		Clock::time_point decoding;	// Decode started
+		Clock::time_point decoded;	// Decode finished
+		Clock::time_point returned;	// Callback returned
+	};
+
+
+	/// Rolling statistics for the capture path. The timestamps of the most recent frames
+	/// are kept in a fixed size window and only summarised when queried, so recording a
+	/// frame is cheap enough to be left enabled.
+	class Timing
+	{
+		public:
+
+			/// Summary of the duration of a stage in microseconds
+			struct Stage
+			{
+				double mean	= 0;
+				double p50	= 0;
+				double p90	= 0;
+				double p99	= 0;
+				double max	= 0;
+			};
+
+			struct Statistics
+			{
+				uint64_t frames	= 0;	// Frames successfully captured since the last reset
+				uint64_t failed	= 0;	// Frames that failed since the last reset
+				double fps		= 0;	// Rate at which frames are returned from the callback (over the window)
+
+				Stage request;			// Command sent to first data received (exposure, readout and USB latency)
+				Stage transfer;			// First data received to transfer complete
+				Stage queued;			// Transfer complete to decode start (waiting in the decode ring)
+				Stage decode;			// Decode start to decode end
+				Stage callback;			// Decode end to callback return
+				Stage total;			// Command sent to callback return
+			};
+
+
+			explicit Timing(const size_t window = 256) : window(std::max<size_t>(window, 2)) {}
+
+
+			/// Record a frame once the callback has returned
+			void Record(FrameTiming timing, const bool success)
+			{
+				timing.returned = FrameTiming::Clock::now();
+
+				std::lock_guard lock(this->cs);
+
+				if (!success)
+				{
+					this->failed++;
+					return;
+				}
+
+				if (this->frames.size() < this->window)	this->frames.push_back(timing);
+				else									this->frames[this->count % this->window] = timing;
+
+				this->count++;
+			}
+
+
+			/// Discard everything recorded so far
+			void Reset()
+			{
+				std::lock_guard lock(this->cs);
+
+				this->frames.clear();
+				this->count		= 0;
+				this->failed	= 0;
+			}
+
+
+			/// Summarise the frames in the window
+			Statistics Stats()
+			{
+				Statistics result;
+				std::vector<FrameTiming> frames;
+
+				{
+					std::lock_guard lock(this->cs);
+
+					frames			= this->frames;
+					result.frames	= this->count;
+					result.failed	= this->failed;
+				}
+
+				if (frames.empty())
+				{
+					return result;
+				}
+
+				auto span = [](auto from, auto to) {
+					return std::chrono::duration<double, std::micro>(to - from).count();
+				};
+
+				auto first	= std::min_element(frames.begin(), frames.end(), [](auto &a, auto &b) { return a.returned < b.returned; })->returned;
+				auto last	= std::max_element(frames.begin(), frames.end(), [](auto &a, auto &b) { return a.returned < b.returned; })->returned;
+
+				if (last > first)
+				{
+					result.fps = 1e6 * (frames.size() - 1) / span(first, last);
+				}
+
+				result.request	= Summarise(frames, [&](auto &f) { return span(f.sent, f.first); });
+				result.transfer	= Summarise(frames, [&](auto &f) { return span(f.first, f.received); });
+				result.queued	= Summarise(frames, [&](auto &f) { return span(f.received, f.decoding); });
+				result.decode	= Summarise(frames, [&](auto &f) { return span(f.decoding, f.decoded); });
+				result.callback	= Summarise(frames, [&](auto &f) { return span(f.decoded, f.returned); });
+				result.total	= Summarise(frames, [&](auto &f) { return span(f.sent, f.returned); });
+
+				return result;
+			}
+
+
+		private:
+
+			template <typename Duration> static Stage Summarise(const std::vector<FrameTiming> &frames, Duration duration)
+			{
+				Stage result;
+				std::vector<double> values;
+
+				values.reserve(frames.size());
+
+				for (auto &f : frames)
+				{
+					values.push_back(duration(f));
+					result.mean += values.back();
+				}
+
+				std::sort(values.begin(), values.end());
+
+				auto percentile = [&](const double p) { return values[std::lrint(p * (values.size() - 1))]; };
+
+				result.mean	/= values.size();
+				result.p50	= percentile(0.50);
+				result.p90	= percentile(0.90);
+				result.p99	= percentile(0.99);
+				result.max	= values.back();
+
+				return result;
+			}
+
+
+			std::mutex cs;
+
+			/// Maximum number of frames held in the window
+			const size_t window;
+
+			/// The most recent frames (used as a ring once full)
+			std::vector<FrameTiming> frames;
+
+			/// Total number of successful and failed frames recorded
+			uint64_t count	= 0;
+			uint64_t failed	= 0;
+	};
+}
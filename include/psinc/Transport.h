@@ -2,11 +2,9 @@
 
 #include <cstdint>
 #include <emergent/Emergent.hpp>
-// #include <psinc/TransportBuffer.hpp>
-#include <libusb-1.0/libusb.h>
+#include <psinc/TransportBuffer.hpp>
+#include <psinc/Timing.hpp>
 #include <atomic>
-#include <mutex>
-#include <queue>
 #include <map>
 #include <set>
 
@@ -15,11 +13,13 @@ namespace psinc
 {
 	using emg::byte;
 
-	/// USB transport implementation.
+	/// Transport interface.
 	///
-	/// Uses libusb to connect to and communicate with the physical
-	/// devices. This supports connecting to specific hardware based
-	/// on the bus or a serial number regex.
+	/// Everything that communicates with a device (the instrument, registers and
+	/// devices) does so through this interface using the command protocol defined
+	/// in driver/Commands.h. The UsbTransport talks to physical hardware whereas the
+	/// SimulatedTransport interprets the protocol in software so that the library
+	/// can be exercised without a camera attached.
 	class Transport
 	{
 		public:
@@ -36,138 +36,107 @@ namespace psinc
 			};
 
 
-			Transport();
-			virtual ~Transport();
+			virtual ~Transport() {}
 
 			/// Initialises the transport with the product ID and
 			/// serial of interest.
 			/// The serial string will be treated as a regex expression.
-			/// The netchip flag will enable the legacy vendor ID for older cameras
-			bool Initialise(const std::set<uint16_t> &vendors, uint16_t product, std::string serial, std::function<void(bool)> onConnection, int timeout = 500);
+			virtual bool Initialise(const std::set<uint16_t> &vendors, uint16_t product, std::string serial, std::function<void(bool)> onConnection, int timeout = 500) = 0;
 
 
-			void SetTimeout(int timeout);
+			virtual void SetTimeout(int timeout) = 0;
 
 
 			/// Poll to allow hotplug detection to work.
-			void Poll(int time);
+			virtual void Poll(int time) = 0;
 
 
-			/// Report whether or not the transport is connected.
-			bool Connected() const;
-
-
-			/// Transfer packets to and from the actual device
-			bool Transfer(std::vector<byte> *send, std::vector<byte> *receive, std::atomic<bool> &waiting, bool check = true, bool truncate = false);
-
-
-			/// Reset the connection to the actual device.
-			bool Reset(bool control = false);
-
-
-			/// Force a disconnection of this device (if connected)
-			/// No disconnect event will be emitted in this case.
-			void Disconnect();
-
-
-			/// Returns the USB major version of the connection and 0 if no device is connected
-			uint8_t UsbVersion() const;
-
+			/// Block until there is activity on the transport (such as a transfer completing or
+			/// a device arriving or leaving), Interrupt is called, or the time (ms) has elapsed.
+			virtual void Wait(int time) = 0;
 
-			/// Return a list of serial numbers and product descriptions for all
-			/// connected devices that match the given product ID.
-			static std::map<std::string, Info> List(const std::set<uint16_t> &vendors, uint16_t product);
 
+			/// Wake a thread that is blocked in Wait. If nothing is waiting then the next
+			/// call to Wait returns immediately.
+			virtual void Interrupt() = 0;
 
-		private:
 
-			/// Method for handling connection/disconnection events.
-			void Pending(libusb_device *device, libusb_hotplug_event event);
-
-			/// Retrieve the serial number of the device (then stored as id).
-			/// If a particular pattern is required then return true if there
-			/// is a match.
-			bool Match(libusb_device_handle *device, const uint8_t index);
+			/// Report whether or not the transport is connected.
+			virtual bool Connected() const = 0;
 
 
-			/// In the case where hotplug is not supported (looking at you Windows),
-			/// attempt a more expensive manual enumeration and connection. This can
-			/// be removed once Windows hotplugging support has been implemented.
-			void LegacyConnect();
+			/// Transfer packets to and from the actual device
+			virtual bool Transfer(std::vector<byte> *send, std::vector<byte> *receive, std::atomic<bool> &waiting, bool check = true, bool truncate = false) = 0;
 
 
-			/// Attempt to claim the given device.
-			bool Claim(libusb_device *device);
+			/// Transfer packets to the actual device and receive the response directly into
+			/// a buffer leased from the pool. If timing is supplied then the sent, first and
+			/// received stages are stamped. The last trailer bytes of the response are sent
+			/// by the device as a separate packet (see Queue).
+			virtual bool Transfer(std::vector<byte> *send, TransportBuffer &receive, std::atomic<bool> &waiting, FrameTiming *timing = nullptr, size_t trailer = 0) = 0;
 
 
-			/// Check that the device matches an expected vendor and product ID.
-			static bool Valid(libusb_device *device, const std::set<uint16_t> &vendors, uint16_t product);
+			/// Lease a receive buffer from the pool.
+			virtual TransportPool::Lease Lease(size_t size) = 0;
 
 
-			/// Tranfer the given data to the device (write) or from the device (!write)
-			bool Transfer(std::vector<byte> *buffer, bool write, bool check, bool truncate);
+			/// Retrieve the receive buffer pool counters
+			virtual TransportPool::Statistics BufferStatistics() = 0;
 
 
-			/// Releases the device.
-			void Release();
+			/// Queue an asynchronous frame request for streaming so that the next request can
+			/// be queued whilst the current frame is still being received. The waiting flag is
+			/// set once the command has been sent. The last trailer bytes of the response are
+			/// the result of a separate command, such as the count following a capture, which the
+			/// device sends after the rest of the response has been ended with a short packet.
+			virtual bool Queue(const std::vector<byte> &command, size_t size, std::atomic<bool> &waiting, size_t trailer = 0) = 0;
 
 
-			/// Safely read a string from a libusb descriptor
-			static std::string ReadDescriptor(libusb_device_handle *device, const uint8_t index);
+			/// Wait for the oldest queued frame to complete and hand over the leased buffer
+			/// containing its data. Returns false if the frame failed or nothing was queued.
+			/// If timing is supplied then the sent, first and received stages are stamped.
+			virtual bool Collect(TransportPool::Lease &receive, FrameTiming *timing = nullptr) = 0;
 
 
-			/// List of supported vendor IDs
-			std::set<uint16_t> vendors;
+			/// Returns true if the oldest queued frame has finished (successfully or not) so
+			/// that Collect will return without waiting.
+			virtual bool Ready() = 0;
 
-			/// Product ID that we are interested in
-			uint16_t product;
 
-			/// Full serial of the device connected to by this transport instance.
-			std::string id;
+			/// The number of frames that have been queued but not yet collected.
+			virtual size_t Queued() = 0;
 
-			/// Mutex used to prevent asynchronous calls to Transfer or Reset from
-			/// breaking things
-			std::mutex cs;
 
-			/// The serial number of interest, supports a regex string. If empty
-			/// the transport will connect to the first device it can find.
-			std::string serial;
+			/// Wait for any frames that are still in flight and then discard everything
+			/// that has been queued.
+			virtual void Flush() = 0;
 
-			/// The libusb handle to the actual device (if this transport has successfully
-			/// claimed one)
-			libusb_device_handle *handle = nullptr;
 
-			/// A thread specific context for dealing with libusb
-			libusb_context *context = nullptr;
+			/// Discard everything that has been queued without waiting. Any transfers still in
+			/// flight are cancelled and complete in the background.
+			virtual void Cancel() = 0;
 
-			/// Required timeout for bulk transfers
-			int timeout = 500;
 
-			/// Reference for registering hotplugging callback
-			libusb_hotplug_callback_handle hotplug;
+			/// Set the number of bulk read transfers kept in flight when streaming and the
+			/// size of each one.
+			virtual void SetTransfers(size_t count, size_t size = 256 * 1024) = 0;
 
-			/// Indicates whether or not a hotplug callback has been previously registered.
-			bool registered = false;
 
-			/// Storage for the registered callback (if required)
-			std::function<void(bool)> onConnection = nullptr;
+			/// Reset the connection to the actual device.
+			virtual bool Reset(bool control = false) = 0;
 
-			std::queue<libusb_device *> pending;
 
-			// Disconnection can happen for a number of reasons so use a flag to indicate
-			// that the onConnection event requires triggering at the next opportunity.
-			bool disconnect = false;
+			/// Force a disconnection of this device (if connected)
+			/// No disconnect event will be emitted in this case.
+			virtual void Disconnect() = 0;
 
-			// Windows does not yet support hotplugging so adapt accordingly
-			bool legacy = false;
 
-			// USB major version
-			uint8_t version = 0;
+			/// Returns the USB major version of the connection and 0 if no device is connected
+			virtual uint8_t UsbVersion() const = 0;
 
-			/// Attempt to allocate a DMA read buffer for bulk transfers
-			// TransportBuffer readBuffer;
 
-			/// Allows an internal global function to push onto the pending queue
-			friend int LIBUSB_CALL OnHotplug(libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *data);
+			/// Return a list of serial numbers and product descriptions for all
+			/// connected USB devices that match the given product ID.
+			static std::map<std::string, Info> List(const std::set<uint16_t> &vendors, uint16_t product);
 	};
 }
@@ -3,18 +3,26 @@
 
 #include <emergent/Emergent.hpp>
 #include <libusb-1.0/libusb.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
 // #include <iostream>
 
 namespace psinc
 {
 	// A buffer for receiving data at the transport layer. It attempts to
 	// allocate DMA memory first to optimise transfer, but falls back to
-	// allocating normal memory. Not used at this time.
+	// allocating normal (page-aligned) memory.
 
 	class TransportBuffer
 	{
 		public:
 
+			static constexpr size_t PAGE = 4096;
+
+
 			~TransportBuffer()
 			{
 				this->Dispose();
@@ -31,7 +39,7 @@ namespace psinc
 					}
 					else
 					{
-						delete [] this->data;
+						::operator delete(this->data, std::align_val_t(PAGE));
 					}
 					this->data				= nullptr;
 					this->handle			= nullptr;
@@ -41,20 +49,32 @@ namespace psinc
 			}
 
 
+			// Discard the memory without freeing it. Only used when device memory is
+			// still on loan after the associated handle has been closed.
+			void Abandon()
+			{
+				this->data				= nullptr;
+				this->handle			= nullptr;
+				this->deviceAllocated	= false;
+				this->size = this->max 	= 0;
+			}
 
 
 			// If the device handle has changed then the memory needs
 			// re-allocating. If the size is larger than max then the
-			// memory needs re-allocating.
-			void Resize(libusb_device_handle *handle, const size_t size)
+			// memory needs re-allocating. Returns true if allocation
+			// occurred.
+			bool Resize(libusb_device_handle *handle, const size_t size)
 			{
-				if (this->handle != handle || size > this->max)
+				const bool allocate = this->handle != handle || size > this->max;
+
+				if (allocate)
 				{
 					this->Dispose();
 
 					this->handle	= handle;
-					this->max		= size;
-					this->data		= libusb_dev_mem_alloc(handle, size);
+					this->max		= (size + PAGE - 1) & ~(PAGE - 1);
+					this->data		= handle ? libusb_dev_mem_alloc(handle, this->max) : nullptr;
 
 					if (data)
 					{
@@ -65,19 +85,30 @@ namespace psinc
 					{
 						// std::cout << "-" << std::flush;
 						// Log::Warning("Failed to allocate device memory");
-						this->data = new uint8_t[size];
+						this->data = static_cast<uint8_t *>(::operator new(this->max, std::align_val_t(PAGE)));
 					}
 				}
 
 				this->size = size;
+
+				return allocate;
 			}
 
 			/// Return the current size of the buffer (not the storage capacity)
 			size_t Size() const { return this->size; }
 
+			/// Return the storage capacity of the buffer
+			size_t Capacity() const { return this->max; }
+
 			/// Return the buffer data
 			uint8_t *Data() const { return this->data; }
 
+			/// Returns true if the memory was allocated by the device (zero-copy transfers)
+			bool Mapped() const { return this->deviceAllocated; }
+
+			/// The device associated with the memory allocation
+			libusb_device_handle *Handle() const { return this->handle; }
+
 
 		private:
 
@@ -97,4 +128,151 @@ namespace psinc
 			/// Storage capacity of the buffer
 			size_t max = 0;
 	};
+
+
+	// A pool of reusable transport buffers. Buffers are leased out for the duration of
+	// a transfer (and any subsequent processing) and automatically returned to the pool
+	// when the lease is released.
+	class TransportPool
+	{
+		public:
+
+			struct Statistics
+			{
+				uint64_t hits		= 0;	// Leases satisfied by an existing buffer
+				uint64_t misses		= 0;	// Leases that required an allocation
+				uint64_t fallbacks	= 0;	// Allocations where device memory was unavailable
+				uint64_t leased		= 0;	// Buffers currently on loan
+				uint64_t pooled		= 0;	// Buffers currently available in the pool
+			};
+
+
+			/// A buffer on loan from the pool
+			using Lease = std::shared_ptr<TransportBuffer>;
+
+
+			TransportPool() : state(std::make_shared<State>()) {}
+
+
+			~TransportPool()
+			{
+				std::lock_guard lock(this->state->cs);
+
+				// Anything still on loan will simply be freed when returned
+				this->state->detached = true;
+			}
+
+
+			/// Lease a buffer of the given size that is suitable for transfers with the given device.
+			Lease Acquire(libusb_device_handle *handle, const size_t size)
+			{
+				std::lock_guard lock(this->state->cs);
+
+				std::unique_ptr<TransportBuffer> buffer;
+				auto &free = this->state->free;
+
+				// Prefer a buffer that can be used as is, otherwise re-use any available buffer
+				auto match = std::find_if(free.begin(), free.end(), [&](auto &b) {
+					return b->Handle() == handle && b->Capacity() >= size;
+				});
+
+				if (match == free.end() && free.size())
+				{
+					match = free.begin();
+				}
+
+				if (match != free.end())
+				{
+					buffer = std::move(*match);
+					free.erase(match);
+				}
+				else
+				{
+					buffer = std::make_unique<TransportBuffer>();
+				}
+
+				if (buffer->Resize(handle, size))
+				{
+					this->state->statistics.misses++;
+
+					if (!buffer->Mapped())
+					{
+						this->state->statistics.fallbacks++;
+					}
+				}
+				else
+				{
+					this->state->statistics.hits++;
+				}
+
+				this->state->loaned.insert(buffer.get());
+
+				return Lease(buffer.release(), [state = this->state](TransportBuffer *b) {
+					std::lock_guard lock(state->cs);
+
+					state->loaned.erase(b);
+
+					if (state->detached || state->orphaned.erase(b))
+					{
+						// The device handle may be gone so mapped memory can no longer be freed safely
+						if (b->Mapped()) b->Abandon();
+						delete b;
+					}
+					else
+					{
+						state->free.emplace_back(b);
+					}
+				});
+			}
+
+
+			/// Must be called before a device handle is closed. Pooled memory associated
+			/// with the handle is freed and any mapped buffers still on loan are orphaned.
+			void Release(libusb_device_handle *handle)
+			{
+				std::lock_guard lock(this->state->cs);
+
+				auto &free = this->state->free;
+
+				free.erase(std::remove_if(free.begin(), free.end(), [&](auto &b) { return b->Handle() == handle; }), free.end());
+
+				for (auto b : this->state->loaned)
+				{
+					if (b->Handle() == handle && b->Mapped())
+					{
+						this->state->orphaned.insert(b);
+					}
+				}
+			}
+
+
+			/// Retrieve the pool usage counters
+			Statistics Stats()
+			{
+				std::lock_guard lock(this->state->cs);
+
+				auto result		= this->state->statistics;
+				result.leased	= this->state->loaned.size();
+				result.pooled	= this->state->free.size();
+
+				return result;
+			}
+
+
+		private:
+
+			// Shared with the leases so that buffers can be safely returned regardless
+			// of the lifetime of the pool itself.
+			struct State
+			{
+				std::mutex cs;
+				std::vector<std::unique_ptr<TransportBuffer>> free;
+				std::set<TransportBuffer *> loaned;
+				std::set<TransportBuffer *> orphaned;
+				Statistics statistics;
+				bool detached = false;
+			};
+
+			std::shared_ptr<State> state;
+	};
 }
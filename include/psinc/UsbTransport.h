@@ -0,0 +1,408 @@
+#pragma once
+
+#include <cstdint>
+#include <emergent/Emergent.hpp>
+#include <psinc/Transport.h>
+#include <libusb-1.0/libusb.h>
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+
+
+namespace psinc
+{
+	/// The libusb calls that a UsbTransport makes against a claimed device. The default
+	/// implementation forwards them to libusb, but a backend can be injected so that the
+	/// streaming pipeline can be driven without hardware (see SimulatedUsb).
+	class UsbBackend
+	{
+		public:
+
+			virtual ~UsbBackend() = default;
+
+			/// Submit an asynchronous transfer, returning 0 or a libusb error code.
+			virtual int Submit(libusb_transfer *transfer);
+
+			/// Cancel an asynchronous transfer. It still completes (with a cancelled status)
+			/// when events are next handled.
+			virtual int Cancel(libusb_transfer *transfer);
+
+			/// Handle pending events, waiting for up to the given time if there are none.
+			/// The callbacks of any completed transfers are invoked by the calling thread.
+			virtual int Handle(libusb_context *context, struct timeval *time);
+
+			/// Perform a synchronous bulk transfer.
+			virtual int Transfer(libusb_device_handle *handle, byte endpoint, byte *data, int size, int *transferred, unsigned int timeout);
+
+			/// Reset the device, either by asking the camera to reboot (control) or through a port reset.
+			virtual int Reset(libusb_device_handle *handle, bool control, unsigned int timeout);
+
+			/// Release the interface and close the device handle.
+			virtual void Close(libusb_device_handle *handle);
+
+			/// Returns true if receive buffers can be allocated by the device.
+			virtual bool Mapped() const { return true; }
+	};
+
+
+	/// A libusb context that can be shared by several transports so that the events
+	/// for all of their devices are handled by a single thread (see CameraGroup).
+	class UsbContext
+	{
+		public:
+
+			UsbContext();
+			~UsbContext();
+
+			UsbContext(const UsbContext &) = delete;
+			UsbContext &operator=(const UsbContext &) = delete;
+
+
+			/// The underlying libusb context
+			libusb_context *Get() const;
+
+
+			/// Handle any pending events for the transports using this context, waiting for
+			/// up to the given time (ms) if there are none. Returns as soon as events have been
+			/// handled or the wait is interrupted. Where supported, this blocks on the libusb
+			/// file descriptors alongside a wake pipe so the thread only runs when there is work.
+			void Handle(int time);
+
+
+			/// Wake a thread that is waiting in Handle. If nothing is waiting then the next
+			/// call to Handle returns immediately.
+			void Interrupt();
+
+
+		private:
+
+			libusb_context *context = nullptr;
+
+			/// Pipe used to interrupt a wait on the libusb file descriptors (read, write).
+			/// Unused on platforms where the descriptors cannot be polled.
+			int wake[2] = { -1, -1 };
+	};
+
+
+	/// USB transport implementation.
+	///
+	/// Uses libusb to connect to and communicate with the physical
+	/// devices. This supports connecting to specific hardware based
+	/// on the bus or a serial number regex.
+	class UsbTransport : public Transport
+	{
+		public:
+
+			/// Constructor. If a shared context is supplied then libusb events are not
+			/// handled when polling, since that is the responsibility of the thread driving
+			/// the shared context, but they are still handled whilst waiting for a transfer.
+			/// A backend can be supplied to replace the libusb calls made against the device.
+			explicit UsbTransport(std::shared_ptr<UsbContext> context = nullptr, std::shared_ptr<UsbBackend> backend = nullptr);
+			virtual ~UsbTransport();
+
+			/// Initialises the transport with the product ID and
+			/// serial of interest.
+			/// The serial string will be treated as a regex expression.
+			/// The netchip flag will enable the legacy vendor ID for older cameras
+			bool Initialise(const std::set<uint16_t> &vendors, uint16_t product, std::string serial, std::function<void(bool)> onConnection, int timeout = 500) override;
+
+
+			void SetTimeout(int timeout) override;
+
+
+			/// Poll to allow hotplug detection to work.
+			void Poll(int time) override;
+
+
+			/// Block until libusb has events to handle (transfers completing, hotplugging) or
+			/// the wait is interrupted. The events are handled before returning.
+			void Wait(int time) override;
+
+
+			/// Wake a thread that is blocked in Wait.
+			void Interrupt() override;
+
+
+			/// Report whether or not the transport is connected.
+			bool Connected() const override;
+
+
+			/// Transfer packets to and from the actual device
+			bool Transfer(std::vector<byte> *send, std::vector<byte> *receive, std::atomic<bool> &waiting, bool check = true, bool truncate = false) override;
+
+
+			/// Transfer packets to the actual device and receive the response directly into
+			/// a buffer leased from the pool. The response is read in a single bulk transfer
+			/// so the first data can only be stamped once the whole transfer completes.
+			bool Transfer(std::vector<byte> *send, TransportBuffer &receive, std::atomic<bool> &waiting, FrameTiming *timing = nullptr, size_t trailer = 0) override;
+
+
+			/// Lease a receive buffer from the pool. Where possible the memory is allocated
+			/// by the device so that bulk transfers avoid a kernel bounce copy.
+			TransportPool::Lease Lease(size_t size) override;
+
+
+			/// Retrieve the receive buffer pool counters
+			TransportPool::Statistics BufferStatistics() override;
+
+
+			/// Queue an asynchronous frame request for streaming. The command is written and
+			/// the read of the expected number of bytes is spread across a ring of in-flight
+			/// bulk transfers, so the next request can be queued whilst the current frame is
+			/// still being received. The waiting flag is set once the command has been sent.
+			/// Reads never span the start of the trailer, which is read by its own transfer.
+			bool Queue(const std::vector<byte> &command, size_t size, std::atomic<bool> &waiting, size_t trailer = 0) override;
+
+
+			/// Wait for the oldest queued frame to complete and hand over the leased buffer
+			/// containing its data. Returns false if the frame failed or nothing was queued.
+			/// The first data is stamped when the first read transfer for the frame completes.
+			bool Collect(TransportPool::Lease &receive, FrameTiming *timing = nullptr) override;
+
+
+			/// Returns true if the oldest queued frame has completed or failed.
+			bool Ready() override;
+
+
+			/// The number of frames that have been queued but not yet collected.
+			size_t Queued() override;
+
+
+			/// Wait for any frames that are still in flight and then discard everything
+			/// that has been queued.
+			void Flush() override;
+
+
+			/// Discard everything that has been queued without waiting. The transfers still in
+			/// flight are cancelled and complete whenever events are next handled.
+			void Cancel() override;
+
+
+			/// Set the number of bulk read transfers kept in flight when streaming and the
+			/// size of each one (which must be a multiple of the endpoint packet size).
+			void SetTransfers(size_t count, size_t size = 256 * 1024) override;
+
+
+			/// Reset the connection to the actual device.
+			bool Reset(bool control = false) override;
+
+
+			/// Force a disconnection of this device (if connected)
+			/// No disconnect event will be emitted in this case.
+			void Disconnect() override;
+
+
+			/// Returns the USB major version of the connection and 0 if no device is connected
+			uint8_t UsbVersion() const override;
+
+
+			/// Use a device that has been opened elsewhere, such as the device of a simulated
+			/// backend, releasing any that is currently claimed. No connection event is emitted.
+			void Attach(libusb_device_handle *handle, const std::string &id, uint8_t version = 2);
+
+
+			/// Return a list of serial numbers and product descriptions for all
+			/// connected devices that match the given product ID.
+			static std::map<std::string, Info> List(const std::set<uint16_t> &vendors, uint16_t product);
+
+
+		private:
+
+			/// Method for handling connection/disconnection events.
+			void Pending(libusb_device *device, libusb_hotplug_event event);
+
+			/// Retrieve the serial number of the device (then stored as id).
+			/// If a particular pattern is required then return true if there
+			/// is a match.
+			bool Match(libusb_device_handle *device, const uint8_t index);
+
+
+			/// In the case where hotplug is not supported (looking at you Windows),
+			/// attempt a more expensive manual enumeration and connection. This can
+			/// be removed once Windows hotplugging support has been implemented.
+			void LegacyConnect();
+
+
+			/// Attempt to claim the given device.
+			bool Claim(libusb_device *device);
+
+
+			/// Check that the device matches an expected vendor and product ID.
+			static bool Valid(libusb_device *device, const std::set<uint16_t> &vendors, uint16_t product);
+
+
+			/// Tranfer the given data to the device (write) or from the device (!write)
+			bool Transfer(std::vector<byte> *buffer, bool write, bool check, bool truncate);
+			bool Transfer(byte *data, size_t size, bool write, bool check, int &transferred);
+
+
+			/// Releases the device. Any streaming transfers are cancelled and the handle is
+			/// closed once they have all completed (see Close).
+			void Release();
+
+			/// Close the handle of a released device once none of its transfers remain in flight.
+			/// Cannot be called from within a libusb callback.
+			void Close();
+
+
+			/// A request for a frame that is part of an asynchronous stream.
+			struct Request
+			{
+				TransportPool::Lease data;				// Destination for the frame data
+				std::atomic<bool> *waiting = nullptr;	// Set once the command has been written
+				libusb_transfer *write	= nullptr;		// Transfer used to send the command
+				size_t split			= 0;			// Bytes that precede the trailer
+				size_t requested		= 0;			// Bytes submitted to read transfers so far
+				size_t received			= 0;			// Bytes successfully received so far
+				int outstanding			= 0;			// Number of transfers in flight for this frame
+				bool failed				= false;		// Set if any transfer for this frame failed
+				FrameTiming timing;						// Stamped as the command is written and data arrives
+
+				bool Complete() const { return !this->outstanding && !this->write && (this->failed || this->received == this->data->Size()); }
+			};
+
+
+			/// One of the ring of read transfers used when streaming.
+			struct Slot
+			{
+				UsbTransport *owner	= nullptr;
+				Request *frame			= nullptr;	// The frame this transfer is reading into (if any)
+				libusb_transfer *read	= nullptr;
+				TransportPool::Lease data;			// Keeps the destination alive even if the frame is discarded
+				bool busy				= false;	// Set whilst the transfer is owned by libusb
+			};
+
+
+			/// Allocate the ring of read transfers (if required) and submit as many of them
+			/// as possible against the frames that still have data outstanding.
+			/// Must be called with the stream lock held.
+			void Submit();
+
+			/// Handle libusb events until the given condition is satisfied or the stream stalls.
+			template <typename Condition> bool Await(Condition condition);
+
+			/// Returns true if all queued frames have either completed or failed.
+			/// Must be called with the stream lock held.
+			bool Idle() const;
+
+			/// Returns true if any streaming transfer is still owned by libusb, including those
+			/// belonging to frames that have been discarded. Must be called with the stream lock held.
+			bool Busy() const;
+
+			/// Handle events until no streaming transfers remain in flight or the stream stalls.
+			bool Drain();
+
+			/// Fail any queued frames and cancel their in-flight transfers without waiting for them
+			/// to complete, which they do the next time events are handled.
+			void Abort();
+
+			/// Discard all queued frames. Any of their transfers still in flight are detached.
+			/// Must be called with the stream lock held.
+			void Discard();
+
+			/// Completion handlers for the asynchronous transfers
+			static void LIBUSB_CALL OnWrite(libusb_transfer *transfer);
+			static void LIBUSB_CALL OnRead(libusb_transfer *transfer);
+
+
+			/// Safely read a string from a libusb descriptor
+			static std::string ReadDescriptor(libusb_device_handle *device, const uint8_t index);
+
+
+			/// List of supported vendor IDs
+			std::set<uint16_t> vendors;
+
+			/// Product ID that we are interested in
+			uint16_t product;
+
+			/// Full serial of the device connected to by this transport instance.
+			std::string id;
+
+			/// Mutex used to prevent asynchronous calls to Transfer or Reset from
+			/// breaking things
+			std::mutex cs;
+
+			/// The serial number of interest, supports a regex string. If empty
+			/// the transport will connect to the first device it can find.
+			std::string serial;
+
+			/// The libusb handle to the actual device (if this transport has successfully
+			/// claimed one)
+			libusb_device_handle *handle = nullptr;
+
+			/// The context for dealing with libusb, which is either owned by this transport
+			/// or shared with others
+			std::shared_ptr<UsbContext> shared;
+			libusb_context *context = nullptr;
+
+			/// The calls made against the claimed device
+			std::shared_ptr<UsbBackend> backend;
+
+			/// Set if this transport created its own context and so must handle its events
+			bool exclusive = true;
+
+			/// Required timeout for bulk transfers
+			int timeout = 500;
+
+			/// Reference for registering hotplugging callback
+			libusb_hotplug_callback_handle hotplug;
+
+			/// Indicates whether or not a hotplug callback has been previously registered.
+			bool registered = false;
+
+			/// Storage for the registered callback (if required)
+			std::function<void(bool)> onConnection = nullptr;
+
+			/// Devices that have arrived, which are claimed when next polled. Hotplug events
+			/// can be delivered by any thread handling events for a shared context.
+			std::queue<libusb_device *> pending;
+			std::mutex arrivals;
+
+			// Disconnection can happen for a number of reasons so use a flag to indicate
+			// that the onConnection event requires triggering at the next opportunity.
+			bool disconnect = false;
+
+			/// Set when the claimed device is unplugged. It is released when next polled rather than
+			/// within the hotplug callback, where its transfers could never complete.
+			std::atomic<bool> departed = false;
+
+			/// A released device that is closed once its cancelled transfers have completed
+			libusb_device_handle *closing = nullptr;
+
+			// Windows does not yet support hotplugging so adapt accordingly
+			bool legacy = false;
+
+			// USB major version
+			uint8_t version = 0;
+
+			/// Pool of receive buffers that attempts to use DMA memory for bulk transfers
+			TransportPool pool;
+
+			/// Protects the streaming state since transfer callbacks can be invoked by
+			/// whichever thread happens to be handling libusb events.
+			std::mutex stream;
+
+			/// Frames that have been queued for streaming in the order they were requested.
+			/// A deque is used so that references held by in-flight transfers remain valid.
+			std::deque<Request> frames;
+
+			/// Ring of read transfers used for streaming
+			std::vector<Slot> slots;
+
+			/// Number of command transfers owned by libusb
+			size_t writing = 0;
+
+			/// Number of read transfers to keep in flight when streaming
+			size_t transfers = 4;
+
+			/// Size of each streaming read transfer
+			size_t chunk = 256 * 1024;
+
+			/// Allows an internal global function to push onto the pending queue
+			friend int LIBUSB_CALL OnHotplug(libusb_context *context, libusb_device *device, libusb_hotplug_event event, void *data);
+	};
+}
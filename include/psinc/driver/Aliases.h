@@ -1,6 +1,7 @@
 #pragma once
 
 #include <psinc/driver/Feature.h>
+#include <string_view>
 
 namespace psinc
 {
@@ -29,48 +30,65 @@ namespace psinc
 			Feature *context			= &unused;
 
 
-			Feature *operator [](std::string key)
+			Feature *operator [](std::string_view key)
 			{
-				return this->lookup.count(key) ? *this->lookup[key] : &this->unused;
+				auto member = Lookup(key);
+
+				return member ? this->*member : &this->unused;
 			}
 
 
-			bool Contains(std::string key)
+			bool Contains(std::string_view key)
 			{
-				return this->lookup.count(key);
+				return Lookup(key);
 			}
 
 
-			void Set(std::string key, Feature &feature)
+			void Set(std::string_view key, Feature &feature)
 			{
-				if (this->lookup.count(key))
+				if (auto member = Lookup(key))
 				{
-					*this->lookup[key] = &feature;
+					this->*member = &feature;
 				}
 			}
 
 
 		private:
 
-			Feature unused;
+			using Member = Feature *Aliases::*;
 
-			std::map<std::string, Feature **> lookup = {
-				{ "Width",				&width },
-				{ "Height",				&height },
-				{ "Gain",				&gain },
-				{ "Exposure",			&exposure },
-				{ "AutoGain",			&autoGain },
-				{ "AutoExposure",		&autoExposure },
-				{ "ColumnStart",		&columnStart },
-				{ "ColumnEnd",			&columnEnd },
-				{ "RowStart",			&rowStart },
-				{ "RowEnd",				&rowEnd },
-				{ "Companding",			&companding },
-				{ "NoiseCorrection",	&noiseCorrection },
-				{ "ADCReference",		&adcReference },
-				{ "Context",			&context }
-			};
-	};
-}
+			/// Find the member for an alias name without allocating
+			static Member Lookup(std::string_view key)
+			{
+				static const std::pair<std::string_view, Member> lookup[] = {
+					{ "Width",				&Aliases::width },
+					{ "Height",				&Aliases::height },
+					{ "Gain",				&Aliases::gain },
+					{ "Exposure",			&Aliases::exposure },
+					{ "AutoGain",			&Aliases::autoGain },
+					{ "AutoExposure",		&Aliases::autoExposure },
+					{ "ColumnStart",		&Aliases::columnStart },
+					{ "ColumnEnd",			&Aliases::columnEnd },
+					{ "RowStart",			&Aliases::rowStart },
+					{ "RowEnd",				&Aliases::rowEnd },
+					{ "Companding",			&Aliases::companding },
+					{ "NoiseCorrection",	&Aliases::noiseCorrection },
+					{ "ADCReference",		&Aliases::adcReference },
+					{ "Context",			&Aliases::context }
+				};
+
+				for (auto &[name, member] : lookup)
+				{
+					if (name == key)
+					{
+						return member;
+					}
+				}
+
+				return nullptr;
+			}
 
 
+			Feature unused;
+	};
+}
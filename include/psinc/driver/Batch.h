@@ -0,0 +1,136 @@
+#pragma once
+
+#include <psinc/Transport.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+
+namespace psinc
+{
+	class Register;
+
+	/// Stages register writes so that they can be sent to the camera together.
+	///
+	/// Whilst a batch is open, setting a feature only updates the staged value of its
+	/// register, so that changes to several features within the same register coalesce
+	/// into a single write. The local register values are not updated until the batch
+	/// has been committed and all of the staged writes are packed into as few transfers
+	/// as possible.
+	///
+	/// In shadow mode the batch is permanently open and the registers report their staged
+	/// values, so that the register values act as a cache of the intended chip state. Only
+	/// the dirty registers are sent when the batch is flushed.
+	class Batch
+	{
+		public:
+
+			Batch(Transport *transport = nullptr) : transport(transport) {}
+
+
+			/// Open the batch. Batches can be nested, in which case nothing is sent until
+			/// the outermost one is committed.
+			void Begin();
+
+
+			/// Close the batch and, if it is the outermost one, send the staged writes
+			/// in the order that the registers were first changed. In shadow mode the
+			/// writes remain staged until the batch is flushed.
+			bool Commit();
+
+
+			/// Send all of the staged writes regardless of whether the batch is open. Any
+			/// writes that could not be sent remain staged so that they can be retried.
+			bool Flush();
+
+
+			/// Close the batch discarding anything that has been staged.
+			void Discard();
+
+
+			/// Returns true if the batch is open and writes should be staged.
+			bool Active();
+
+
+			/// Enable or disable shadow mode. Anything staged is kept when it is disabled
+			/// so that it can still be flushed.
+			void Shadow(bool enabled);
+
+
+			/// Returns true if shadow mode is enabled.
+			bool Shadowing();
+
+
+			/// Returns the number of registers with staged writes.
+			size_t Dirty();
+
+
+			/// If the batch is open then apply the masked value to the staged value of the
+			/// register (starting from its cached value if nothing has been staged yet).
+			/// Returns false if the batch is not open and the write should be sent directly.
+			bool Stage(Register *target, int offset, int mask, int value);
+
+
+			/// In shadow mode, move the staged writes that change a register into the packet
+			/// ahead of the command that it carries, so that they are sent as part of it rather
+			/// than as a separate round trip. Only as many writes as will fit are carried and the
+			/// rest remain staged for the next packet. Every call must be followed by Carried once
+			/// the packet has been sent (or has failed), and nothing else is sent in the meantime.
+			void Carry(std::vector<byte> &packet);
+
+
+			/// Complete the writes moved into a packet by Carry. If the packet could not be
+			/// sent then the writes are staged again so that they are retried.
+			void Carried(bool sent);
+
+
+			/// Retrieve the staged (or currently sending) value of a register when in shadow mode.
+			/// Returns false if shadow mode is disabled or nothing has been staged for the register.
+			bool Pending(const Register *target, int &value);
+
+
+		private:
+
+			/// Maximum number of commands in a single packet so that it fits within
+			/// the 512 byte buffer of the camera
+			static constexpr size_t MAX_COMMANDS = 100;
+
+			/// Guards the staged writes since features can be set from any thread
+			std::mutex cs;
+
+			/// Serialises sending so that the transfers can be made without holding the lock
+			/// on the staged writes, which would otherwise block every register read
+			std::mutex sending;
+
+			/// Reference to the transport layer (owned by the camera)
+			Transport *transport = nullptr;
+
+			/// Send the staged writes that change a register as packed transfers. Anything
+			/// that could not be sent is staged again, ahead of whatever was staged since.
+			bool Send();
+
+			/// Move the staged writes that change a register, up to the given number, into the
+			/// writes being sent. Must be called with both locks held.
+			void Prepare(size_t limit);
+
+			/// Append commands for a range of the writes being sent to a packet.
+			void Pack(std::vector<byte> &data, size_t from, size_t count);
+
+			/// Finish sending, staging the writes that were not sent again ahead of whatever
+			/// was staged since. Must be called with both locks held.
+			void Restage(size_t sent);
+
+
+			/// Nesting depth of the open batches
+			int depth = 0;
+
+			/// Set when in shadow mode (checked without the lock on every register read)
+			std::atomic<bool> shadow = false;
+
+			/// The registers and their new values in the order they were first changed
+			std::vector<std::pair<Register *, int>> staged;
+
+			/// The writes that are currently being sent
+			std::vector<std::pair<Register *, int>> inflight;
+	};
+}
@@ -3,9 +3,10 @@
 #include <emergent/Emergent.hpp>
 #include <emergent/struct/Bounds.hpp>
 #include <psinc/driver/Register.h>
+#include <psinc/xml/Description.h>
 #include <memory>
 #include <map>
-#include <set>
+#include <vector>
 
 
 namespace psinc
@@ -27,6 +28,11 @@ namespace psinc
 			/// @param[in] parent Pointer to the parent register (if there is one)
 			Feature(pugi::xml_node configuration, Register *parent);
 
+			/// Constructor.
+			/// @param[in] description Feature configuration from a compiled chip table
+			/// @param[in] parent Pointer to the parent register (if there is one)
+			Feature(const chip::FeatureDescription &description, Register *parent);
+
 			/// Check if a particular value is valid for this feature. Useful if a previous Set function
 			/// has failed to distinguish an invalid value from a communications problem.
 			bool Valid(int value);
@@ -96,8 +102,8 @@ namespace psinc
 			/// Default value for this feature
 			int defaultValue = 0;
 
-			/// Range(s) of valid values
-			std::set<int> invalid;
+			/// Range(s) of invalid values
+			std::vector<chip::Range> invalid;
 
 			/// Number of bits this feature uses
 			int bits = 0;
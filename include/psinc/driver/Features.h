@@ -0,0 +1,86 @@
+#pragma once
+
+#include <psinc/driver/Feature.h>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace psinc
+{
+	/// The features of the connected chip, held contiguously and sorted by name.
+	///
+	/// A name can be resolved once to a handle (an index into the storage) so that
+	/// frequently used features can then be accessed without a lookup. Since the
+	/// features are built from the chip tables, a handle remains valid across
+	/// reconnections to the same type of chip. Accessing an invalid or unknown
+	/// feature returns a placeholder that cannot be set.
+	class Features
+	{
+		public:
+
+			using Handle	= int;
+			using Entry		= std::pair<std::string, Feature>;
+
+			static constexpr Handle INVALID = -1;
+
+
+			/// Replace all of the features. If a name appears more than once then
+			/// the last one is kept.
+			void Assign(std::vector<Entry> &&entries)
+			{
+				auto same = [](auto &a, auto &b) { return a.first == b.first; };
+
+				std::stable_sort(entries.begin(), entries.end(), [](auto &a, auto &b) { return a.first < b.first; });
+				entries.erase(entries.begin(), std::unique(entries.rbegin(), entries.rend(), same).base());
+
+				this->entries = std::move(entries);
+			}
+
+
+			void Clear()
+			{
+				this->entries.clear();
+			}
+
+
+			/// Resolve a feature name to a handle, returns INVALID if there is no such feature.
+			Handle Find(std::string_view name) const
+			{
+				auto entry = std::lower_bound(this->entries.begin(), this->entries.end(), name, [](auto &e, auto n) { return e.first < n; });
+
+				return entry != this->entries.end() && entry->first == name ? Handle(entry - this->entries.begin()) : INVALID;
+			}
+
+
+			Feature &operator[](Handle handle)
+			{
+				return handle >= 0 && handle < (Handle)this->entries.size() ? this->entries[handle].second : this->unused;
+			}
+
+
+			Feature &operator[](std::string_view name)
+			{
+				return (*this)[this->Find(name)];
+			}
+
+
+			/// Returns 1 if the named feature exists (for compatibility with the map interface)
+			size_t count(std::string_view name) const	{ return this->Find(name) != INVALID; }
+			size_t size() const							{ return this->entries.size(); }
+			bool empty() const							{ return this->entries.empty(); }
+
+			auto begin()	{ return this->entries.begin(); }
+			auto end()		{ return this->entries.end(); }
+
+
+		private:
+
+			/// The features sorted by name
+			std::vector<Entry> entries;
+
+			/// Returned when an invalid handle or unknown name is used
+			Feature unused;
+	};
+}
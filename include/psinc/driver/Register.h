@@ -3,6 +3,7 @@
 #include <emergent/Emergent.hpp>
 #include <emergent/xml/pugixml.hpp>
 #include "psinc/Transport.h"
+#include "psinc/driver/Batch.h"
 
 
 namespace psinc
@@ -13,22 +14,40 @@ namespace psinc
 		public:
 
 			Register() {}
-			Register(pugi::xml_node configuration, Transport *transport, int addressSize);
+			Register(pugi::xml_node configuration, Transport *transport, int addressSize, Batch *batch = nullptr);
+			Register(int address, Transport *transport, int addressSize, Batch *batch = nullptr);
 
 
-			/// Get the value of this register
+			/// Get the value of this register. In shadow mode this includes any staged
+			/// changes, and a volatile register is always read from the camera.
 			int Get();
 
 
+			/// Get the value of this register as last read from or written to the camera
+			int Cached() const;
+
+
+			/// Mark this register as volatile, meaning that its value can be changed by
+			/// the camera (such as status or automatic exposure registers) and so must
+			/// be refreshed whenever it is read.
+			void SetVolatile(bool enabled);
+
+
+			/// Returns true if this register is volatile
+			bool Volatile() const;
+
+
 			/// Sets the value but without triggering messaging
 			void Initialise(int offset, int mask, int value);
 
 
-			/// Sets the value of this register and transmits to the camera
+			/// Sets the value of this register and transmits to the camera (or stages
+			/// the change if the batch is open)
 			bool Set(int offset, int mask, int value);
 
 
-			/// Sets an individual bit of this register and transmits to the camera
+			/// Sets an individual bit of this register and transmits to the camera (or
+			/// stages the change if the batch is open)
 			bool SetBit(int offset, bool value);
 
 
@@ -63,7 +82,13 @@ namespace psinc
 			/// The page that this register belongs to
 			byte page;
 
+			/// Set if the value must be refreshed whenever it is read
+			bool dynamic = false;
+
 			/// Reference to the transport layer (owned by the camera)
 			Transport *transport;
+
+			/// Reference to the batch that writes are staged in (owned by the camera)
+			Batch *batch = nullptr;
 	};
 }
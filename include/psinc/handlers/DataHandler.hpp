@@ -18,6 +18,17 @@ namespace psinc
 			/// Process the data in the supplied buffer using the known width and height of the image
 			virtual bool Process(bool monochrome, const bool hdr, const std::vector<emg::byte> &data, const size_t width, const size_t height, const emg::byte bayerMode) = 0;
 
+			/// Process data directly from a transport buffer. This is what the camera invokes, so
+			/// handlers that are able to work from the raw memory should override it to avoid the
+			/// copy made by this default implementation.
+			virtual bool Process(bool monochrome, const bool hdr, const emg::byte *data, const size_t size, const size_t width, const size_t height, const emg::byte bayerMode)
+			{
+				thread_local std::vector<emg::byte> buffer;
+				buffer.assign(data, data + size);
+
+				return this->Process(monochrome, hdr, buffer, width, height, bayerMode);
+			}
+
 			// This should only be written to by the acquisition system, but can be read
 			// from outside to know when the USB transport has prepped the camera for
 			// an image grab - only really useful when the camera is acting as a slave.
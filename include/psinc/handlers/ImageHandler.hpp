@@ -2,13 +2,13 @@
 
 #include <psinc/handlers/DataHandler.hpp>
 #include <psinc/handlers/helpers/Monochrome.hpp>
+#include <psinc/handlers/helpers/Demosaic.hpp>
+#include <psinc/handlers/helpers/Bayer.hpp>
+#include <psinc/handlers/helpers/Filter.hpp>
+#include <psinc/handlers/helpers/Layout.hpp>
+#include <psinc/handlers/helpers/ToneCurve.hpp>
 #include <emergent/image/Image.hpp>
-
-// #if __has_include(<execution>)
-// 	#include <psinc/handlers/helpers/Demosaic.hpp>
-// #else
-	#include <psinc/handlers/helpers/Bayer.hpp>
-// #endif
+#include <memory>
 
 
 namespace psinc
@@ -21,6 +21,12 @@ namespace psinc
 		ForceMono	= 3		// Force the sensor to be treated as mono
 	};
 
+	enum class BayerDecoder
+	{
+		Standard	= 0,	// Fast fixed-kernel decoder (the output is 4 pixels smaller in each dimension)
+		Gradient	= 1		// Gradient-weighted demosaic with fewer edge artefacts (the output is full size)
+	};
+
 	/// An image specific data handler. This provides the conversion from mono/bayer
 	/// formatted data in the buffer to a greyscale or colour image of the required
 	/// type.
@@ -30,7 +36,16 @@ namespace psinc
 
 			struct Configuration
 			{
-				DecodeMode mode = DecodeMode::Automatic;
+				DecodeMode mode			= DecodeMode::Automatic;
+				BayerDecoder decoder	= BayerDecoder::Standard;
+
+				// Row correction applied to each band of the image as it is decoded, which
+				// avoids a separate pass over the frame with Filter::Process
+				Filter::Configuration filter;
+
+				// Channel order of colour output. The orders with alpha resize a colour image
+				// to 4 channels, whereas a greyscale image is unaffected.
+				ChannelOrder order = ChannelOrder::RGB;
 			};
 
 			ImageHandler() {}
@@ -45,16 +60,44 @@ namespace psinc
 			void Initialise(emg::ImageBase<T> &image, const Configuration &configuration = {})
 			{
 				this->image			= &image;
+				this->target		= {};
 				this->configuration	= configuration;
 			}
 
 			void Initialise(emg::ImageBase<T> &image, bool invertSensorType)
 			{
 				this->image					= &image;
+				this->target				= {};
 				this->configuration.mode	= invertSensorType ? DecodeMode::Invert : DecodeMode::Automatic;
 			}
 
 
+			// Decode into memory owned by the caller rather than an image, such as a bitmap or a
+			// pinned array in another language, so that no further copy is required. The depth is 1
+			// for greyscale or otherwise must match the channel order, the stride is the number of
+			// elements from the start of one row to the next (0 if packed) and the capacity is the
+			// number of elements available. A frame that does not fit fails to decode, and the
+			// dimensions of the last decoded frame are available from Width and Height.
+			void Initialise(T *data, size_t capacity, byte depth, size_t stride = 0, const Configuration &configuration = {})
+			{
+				this->image			= nullptr;
+				this->target		= { data, capacity, depth, stride };
+				this->configuration	= configuration;
+			}
+
+
+			// Set the channel order of colour output
+			void Order(ChannelOrder order)
+			{
+				this->configuration.order = order;
+			}
+
+
+			// The dimensions of the last decoded frame
+			size_t Width() const	{ return this->view.width; }
+			size_t Height() const	{ return this->view.height; }
+
+
 			// Set the amount of bitshifting (right) to perform when dealing with HDR data
 			// stored to byte image.
 			void Shift(uint16_t bits)
@@ -63,9 +106,40 @@ namespace psinc
 			}
 
 
+			// Set a tone curve to use in place of the shift when dealing with HDR data stored
+			// to a byte image, or nullptr to return to shifting. The curve is applied by the
+			// decoders through a lookup table and may be shared between handlers.
+			void Tone(std::shared_ptr<const ToneCurve> curve)
+			{
+				this->curve = curve;
+			}
+
+
+			// Set the row correction that is applied as the image is decoded
+			void SetFilter(const Filter::Configuration &filter)
+			{
+				this->configuration.filter = filter;
+			}
+
+
+			// Set the number of worker threads used to decode bayer images in parallel bands.
+			// The pool is shared by all image handlers and the calling thread always takes
+			// part, so a count of zero will decode entirely on the calling thread.
+			static void Workers(size_t count)
+			{
+				WorkerPool::Shared().Resize(count);
+			}
+
+
 			bool Process(bool monochrome, const bool hdr, const std::vector<byte> &data, const size_t width, const size_t height, const byte bayerMode) override
 			{
-				if (!this->image)
+				return this->Process(monochrome, hdr, data.data(), data.size(), width, height, bayerMode);
+			}
+
+
+			bool Process(bool monochrome, const bool hdr, const byte *data, const size_t size, const size_t width, const size_t height, const byte bayerMode) override
+			{
+				if (!this->image && !this->target.data)
 				{
 					return false;
 				}
@@ -79,56 +153,166 @@ namespace psinc
 					default:													break;
 				}
 
-				if (data.size() != width * height * (hdr ? 2 : 1))
+				if (size != width * height * (hdr ? 2 : 1))
+				{
+					return false;
+				}
+
+				return this->Filtered([&](auto rows) {
+					if (!hdr)
+					{
+						return this->Decode(monochrome, data, width, height, bayerMode, this->shiftBits, rows);
+					}
+
+					if constexpr (std::is_same_v<T, byte>)
+					{
+						if (this->curve)
+						{
+							return this->Decode(monochrome, (uint16_t *)data, width, height, bayerMode, this->curve->Table(), rows);
+						}
+					}
+
+					return this->Decode(monochrome, (uint16_t *)data, width, height, bayerMode, this->shiftBits, rows);
+				});
+			}
+
+		protected:
+
+			// A destination owned by the caller
+			struct Target
+			{
+				T *data			= nullptr;
+				size_t capacity	= 0;
+				byte depth		= 1;
+				size_t stride	= 0;
+			};
+
+
+			// The destination of the frame being decoded
+			struct View
+			{
+				T *data			= nullptr;
+				size_t width	= 0;
+				size_t height	= 0;
+				byte depth		= 1;
+				Layout layout;
+			};
+
+
+			emg::ImageBase<T> *image = nullptr;
+			Target target;
+			View view;
+			Configuration configuration;
+
+
+			// Size the destination for a frame, returning false if it cannot hold it
+			bool Prepare(const size_t width, const size_t height)
+			{
+				Layout layout = { this->configuration.order };
+
+				if (this->image)
+				{
+					const byte depth	= this->image->Depth() == 1 ? 1 : layout.Channels();
+					auto matches		= [&] { return this->image->Width() == width && this->image->Height() == height && this->image->Depth() == depth; };
+
+					// An image may be unable to take on the layout (such as one with a fixed depth
+					// asked for the four channels of RGBA), in which case it cannot be decoded into
+					if (!matches() && (!this->image->Resize(width, height, depth) || !matches() || !this->image->Data()))
+					{
+						return false;
+					}
+
+					this->view = { this->image->Data(), width, height, depth, layout };
+
+					return true;
+				}
+
+				layout.stride		= this->target.stride;
+				const byte depth	= this->target.depth;
+				const size_t stride	= layout.Stride(width, depth);
+
+				if (!this->target.data || !width || !height || !layout.Valid(width, depth) || (height - 1) * stride + width * depth > this->target.capacity)
 				{
 					return false;
 				}
 
+				this->view = { this->target.data, width, height, depth, layout };
+
+				return true;
+			}
+
+
+
+			// Decode from the source type S, narrowing to the image type with either a shift or
+			// a lookup table.
+			template <typename S, typename N, typename Rows> bool Decode(const bool monochrome, S *data, const size_t width, const size_t height, const byte bayerMode, const N narrow, Rows rows)
+			{
+				auto &v = this->view;
+
 				if (monochrome)
 				{
-					this->image->Resize(width, height);
+					return this->Prepare(width, height)
+						&& Monochrome::Decode(data, v.data, width, height, v.depth, narrow, rows, v.layout);
+				}
 
-					return hdr
-						? Monochrome::Decode((uint16_t *)data.data(), this->image->Data(), width, height, this->image->Depth(), this->shiftBits)
-						: Monochrome::Decode(data.data(), this->image->Data(), width, height, this->image->Depth(), this->shiftBits);
+				if (this->configuration.decoder == BayerDecoder::Gradient)
+				{
+					return this->Prepare(width, height)
+						&& bayer::Demosaic<std::remove_const_t<S>, T>::Decode(bayerMode, data, width, height, v.depth, v.data, narrow, rows, v.layout);
 				}
 
-				// #if __has_include(<execution>)	// newer compilers only
-				// 	this->image->Resize(width, height);
+				if (width < 4 || height < 4 || !this->Prepare(width - 4, height - 4))
+				{
+					return false;
+				}
 
-				// 	return hdr
-				// 		? bayer::Demosaic<uint16_t, T>::Decode(bayerMode, (uint16_t *)data.data(), width, height, image->Depth(), image->Data(), shiftBits)
-				// 		: bayer::Demosaic<uint8_t, T>::Decode(bayerMode, data.data(), width, height, image->Depth(), image->Data(), shiftBits);
+				return v.depth == 1
+					? Bayer::Grey(data, v.data, width, height, bayerMode, narrow, rows, v.layout)
+					: Bayer::Colour(data, v.data, width, height, bayerMode, narrow, rows, v.layout);
+			}
 
-				// #else
-					const int w = monochrome ? width : width - 4;
-					const int h = monochrome ? height : height - 4;
 
-					this->image->Resize(w, h);
+			// Invoke the decode with a function that applies the row correction to each band of
+			// rows as it is completed, or with nullptr if there is nothing to apply.
+			template <typename Function> bool Filtered(Function decode)
+			{
+				const bool filter = this->configuration.filter.mode != Filter::Disabled;
+
+				if (!filter && !this->banded)
+				{
+					return decode(nullptr);
+				}
+
+				return decode([this, filter](const int y0, const int y1) {
+					auto &v = this->view;
 
-					if (this->image->Depth() == 3)
+					if (filter)
 					{
-						return hdr
-							? Bayer::Colour((uint16_t *)data.data(), image->Data(), width, height, bayerMode, shiftBits)
-							: Bayer::Colour(data.data(), image->Data(), width, height, bayerMode, shiftBits);
+						Filter::Process(this->configuration.filter, v.data, v.width, v.height, v.depth, v.layout.Stride(v.width, v.depth), y0, y1);
 					}
 
-					return hdr
-						? Bayer::Grey((uint16_t *)data.data(), image->Data(), width, height, bayerMode, shiftBits)
-						: Bayer::Grey(data.data(), image->Data(), width, height, bayerMode, shiftBits);
-				// #endif
+					if (this->banded)
+					{
+						this->Band(y0, y1);
+					}
+				});
 			}
 
-		protected:
 
-			emg::ImageBase<T> *image = nullptr;
-			Configuration configuration;
+			// Called on the worker as each band of rows [y0, y1) of the view is completed (and
+			// corrected), but only when banded is set by the derived handler. This allows further
+			// conversion of the rows while they are still in the cache.
+			virtual void Band(const int, const int) {}
+			bool banded = false;
 
 
 			// If dealing with HDR data, then apply this bit shift to incoming data
 			// before converting from ushort to byte. The default is 8 for using the
 			// most significant byte. This is only applied if the destination image is byte.
 			uint16_t shiftBits = 8;
+
+			// If set, this is used in place of the shift when converting HDR data to bytes
+			std::shared_ptr<const ToneCurve> curve;
 	};
 }
 
@@ -16,5 +16,10 @@ namespace psinc
 			{
 				return true;
 			}
+
+			bool Process(bool, const bool, const emg::byte *, const size_t, const size_t, const size_t, const emg::byte) override
+			{
+				return true;
+			}
 	};
 }
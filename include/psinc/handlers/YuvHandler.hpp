@@ -0,0 +1,145 @@
+#pragma once
+
+#include <psinc/handlers/ImageHandler.hpp>
+#include <psinc/handlers/helpers/Yuv.hpp>
+#include <atomic>
+
+
+namespace psinc
+{
+	enum class YuvFormat
+	{
+		YUYV	= 0,	// Packed 4:2:2 where each pair of pixels shares the chroma (Y0 U Y1 V)
+		NV12	= 1		// A luma plane followed by an interleaved UV plane at half resolution in both dimensions
+	};
+
+
+	/// A data handler that produces 8-bit YUV (BT.601, limited range, see Yuv) in memory owned
+	/// by the caller, such as a buffer that has been mapped from a video device. This is what most
+	/// video consumers expect and requires half of the bandwidth of RGB.
+	///
+	/// The frame is decoded to RGB and each band is converted to YUV on the worker that decoded
+	/// it, while those rows are still in the cache, so the RGB frame is never read back from
+	/// main memory. Any row correction is applied to the band before it is converted.
+	class YuvHandler : public ImageHandler<byte>
+	{
+		public:
+
+			YuvHandler()
+			{
+				this->banded = true;
+			}
+
+
+			// The stride is the number of bytes from the start of one row to the next (0 if packed)
+			// and, for NV12, applies to both planes with the UV plane immediately following the luma
+			// plane. A frame that does not fit within the capacity fails to decode. The dimensions
+			// of the last decoded frame are available from Width and Height, and Size can be used
+			// to determine the capacity required.
+			void Initialise(byte *data, size_t capacity, YuvFormat format, size_t stride = 0, const Configuration &configuration = {})
+			{
+				ImageHandler<byte>::Initialise(this->decoded, configuration);
+
+				this->configuration.order	= ChannelOrder::RGB;
+				this->output				= { data, capacity, format, stride };
+			}
+
+
+			// The number of bytes from the start of one row to the next
+			static size_t Stride(const YuvFormat format, const size_t width, const size_t stride = 0)
+			{
+				return stride ? stride : format == YuvFormat::YUYV ? width * 2 : width;
+			}
+
+
+			// The number of bytes required to hold a frame of the given dimensions
+			static size_t Size(const YuvFormat format, const size_t width, const size_t height, const size_t stride = 0)
+			{
+				const size_t row = Stride(format, width, stride);
+
+				return format == YuvFormat::NV12 ? row * (height + (height + 1) / 2) : row * height;
+			}
+
+
+			bool Process(bool monochrome, const bool hdr, const std::vector<byte> &data, const size_t width, const size_t height, const byte bayerMode) override
+			{
+				return this->Process(monochrome, hdr, data.data(), data.size(), width, height, bayerMode);
+			}
+
+
+			bool Process(bool monochrome, const bool hdr, const byte *data, const size_t size, const size_t width, const size_t height, const byte bayerMode) override
+			{
+				if (!this->output.data)
+				{
+					return false;
+				}
+
+				this->valid = true;
+
+				return ImageHandler<byte>::Process(monochrome, hdr, data, size, width, height, bayerMode) && this->valid;
+			}
+
+
+		protected:
+
+			void Band(const int y0, const int y1) override
+			{
+				auto &v				= this->view;
+				auto &o				= this->output;
+				const size_t stride	= Stride(o.format, v.width, o.stride);
+
+				// The chroma is shared between pairs of pixels so the dimensions must be even
+				const bool fits = v.width % 2 == 0 && (o.format == YuvFormat::YUYV || v.height % 2 == 0)
+					&& stride >= (o.format == YuvFormat::YUYV ? v.width * 2 : v.width)
+					&& Size(o.format, v.width, v.height, o.stride) <= o.capacity;
+
+				if (!fits)
+				{
+					this->valid = false;
+					return;
+				}
+
+				const size_t row = v.width * 3;
+
+				for (int y=y0; y<y1; y++)
+				{
+					const byte *src = v.data + y * row;
+
+					if (o.format == YuvFormat::YUYV)
+					{
+						Yuv::Packed(src, o.data + y * stride, v.width);
+						continue;
+					}
+
+					Yuv::Luma(src, o.data + y * stride, v.width);
+
+					// Each chroma row is produced by the band that holds the first of its pair of rows. The colour
+					// decoders use even bands, but where a band does end between the pair (a monochrome image, so
+					// the chroma is neutral regardless) the next row may not have been decoded yet.
+					if (y % 2 == 0)
+					{
+						Yuv::Chroma(src, y + 1 < y1 ? src + row : src, o.data + stride * v.height + (y / 2) * stride, v.width);
+					}
+				}
+			}
+
+
+		private:
+
+			// A destination owned by the caller
+			struct Output
+			{
+				byte *data			= nullptr;
+				size_t capacity		= 0;
+				YuvFormat format	= YuvFormat::YUYV;
+				size_t stride		= 0;
+			};
+
+
+			emg::Image<byte, emg::rgb> decoded;
+			Output output;
+
+			// Cleared by any band that cannot be converted
+			std::atomic<bool> valid = true;
+	};
+}
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <psinc/handlers/helpers/Layout.hpp>
+#include <psinc/handlers/helpers/Simd.hpp>
+#include <psinc/handlers/helpers/WorkerPool.hpp>
 #include <emergent/Maths.hpp>
-#include <emergent/thread/Persistent.hpp>
+#include <limits>
+#include <type_traits>
+#include <vector>
 
 
 namespace psinc
@@ -61,48 +66,157 @@ namespace psinc
 			static inline void Clamp(int value, const uint16_t*, byte *dst, const uint16_t shift)	{ value = value >> shift; *dst = value > 255 ? 255 : value < 0 ? 0 : value; }
 			static inline void Clamp(int value, const byte*, uint16_t *dst, const uint16_t)			{ *dst = value < 0 ? 0 : value; }
 			static inline void Clamp(int value, const byte*, byte *dst, const uint16_t)				{ *dst = value > 255 ? 255 : value < 0 ? 0 : value; }
+			static inline void Clamp(int value, const uint16_t*, byte *dst, const byte *table)		{ *dst = table[value > 65535 ? 65535 : value < 0 ? 0 : value]; }
 
 
-			// Even row
-			template <typename T, typename U> static inline void Even(T *src, U *dst, const int dw, const int dh, const int sw, const uint16_t shift, bool even)
+			template <typename T, typename U> using ColourRow	= int (*)(const T *, U *, int, int, int, bool, bool, bool);
+			template <typename T, typename U> using GreyRow		= int (*)(const T *, U *, int, int, int, bool);
+
+			// The destination type of the vectorised kernels, which is 16-bit when narrowing with a
+			// lookup table (N is a pointer to the table) rather than a shift
+			template <typename U, typename N> using Wide = std::conditional_t<std::is_pointer_v<N>, uint16_t, U>;
+
+
+			// The vectorised row decoders for the instruction set supported by this CPU (nullptr if unsupported)
+			template <typename T, typename U> static inline ColourRow<std::remove_const_t<T>, U> ColourKernel()
+			{
+				using S = std::remove_const_t<T>;
+				return simd::Dispatch<ColourRow<S, U>>([](auto k) { return &decltype(k)::template Colour<S, U>; });
+			}
+
+			template <typename T, typename U> static inline GreyRow<std::remove_const_t<T>, U> GreyKernel()
+			{
+				using S = std::remove_const_t<T>;
+				return simd::Dispatch<GreyRow<S, U>>([](auto k) { return &decltype(k)::template Grey<S, U>; });
+			}
+
+
+			// Decode as much of a row as possible with a vectorised kernel and advance
+			// the pointers accordingly, returning the number of pixels decoded.
+			// The kernel is told which colour occupies the first channel, which is blue rather than red
+			// when the order is swapped.
+			template <typename T, typename U> static inline int Vectorised(ColourRow<std::remove_const_t<T>, U> kernel, T *&src, U *&dst, const int dw, const int sw, const uint16_t shift, const Layout::Pixel &pixel, const bool red, const bool phase)
+			{
+				const int count = kernel ? kernel(src, dst, dw, sw, shift, red == (pixel.red == 0), phase, pixel.channels == 4) : 0;
+
+				src += count;
+				dst += pixel.channels * count;
+
+				return count;
+			}
+
+			template <typename T, typename U> static inline int Vectorised(GreyRow<std::remove_const_t<T>, U> kernel, T *&src, U *&dst, const int dw, const int sw, const uint16_t shift, const bool phase)
+			{
+				const int count = kernel ? kernel(src, dst, dw, sw, shift, phase) : 0;
+
+				src += count;
+				dst += count;
+
+				return count;
+			}
+
+
+			// When narrowing with a lookup table the row is decoded to 16-bit with the vectorised kernel
+			// and then mapped through the table into the destination.
+			template <typename T> static inline int Vectorised(ColourRow<uint16_t, uint16_t> kernel, T *&src, byte *&dst, const int dw, const int sw, const byte *table, const Layout::Pixel &pixel, const bool red, const bool phase)
+			{
+				thread_local std::vector<uint16_t> row;
+				row.resize(3 * dw);
+
+				const int count = kernel ? kernel(src, row.data(), dw, sw, 0, red == (pixel.red == 0), phase, false) : 0;
+
+				Map(row.data(), dst, count, pixel.channels, table);
+
+				src += count;
+				dst += pixel.channels * count;
+
+				return count;
+			}
+
+			template <typename T> static inline int Vectorised(GreyRow<uint16_t, uint16_t> kernel, T *&src, byte *&dst, const int dw, const int sw, const byte *table, const bool phase)
+			{
+				thread_local std::vector<uint16_t> row;
+				row.resize(dw);
+
+				const int count = kernel ? kernel(src, row.data(), dw, sw, 0, phase) : 0;
+
+				Map(row.data(), dst, count, 1, table);
+
+				src += count;
+				dst += count;
+
+				return count;
+			}
+
+
+			// Map packed pixels through the table, where the source never has an alpha channel
+			static inline void Map(const uint16_t *src, byte *dst, const int count, const int channels, const byte *table)
+			{
+				if (channels == 4)
+				{
+					for (int i=0; i<count; i++, src+=3, dst+=4)
+					{
+						dst[0] = table[src[0]];
+						dst[1] = table[src[1]];
+						dst[2] = table[src[2]];
+						dst[3] = 255;
+					}
+				}
+				else
+				{
+					for (int i=0; i<count * channels; i++)
+					{
+						dst[i] = table[src[i]];
+					}
+				}
+			}
+
+
+			// Write a pixel in the channel order of the destination and advance to the next
+			template <typename T, typename U, typename N> static inline void Put(const T *src, U *&dst, const Layout::Pixel &pixel, const int r, const int g, const int b, const N shift)
+			{
+				Clamp(r, src, dst + pixel.red, shift);
+				Clamp(g, src, dst + 1, shift);
+				Clamp(b, src, dst + pixel.blue, shift);
+
+				if (pixel.channels == 4)
+				{
+					dst[3] = std::numeric_limits<U>::max();
+				}
+
+				dst += pixel.channels;
+			}
+
+
+			// Even row. The stride is the distance between consecutive destination rows.
+			template <typename T, typename U, typename N> static inline void Even(T *src, U *dst, const int dw, const int dh, const int sw, const int stride, const N shift, const Layout::Pixel &pixel, bool even)
 			{
 				int x, y;
-				const int row	= dw * 3;
+				const int jump	= 2 * stride - dw * pixel.channels;
 				const int w2	= sw * 2;
+				const auto simd	= ColourKernel<T, Wide<U, N>>();
 
 				if (even)
 				{
 					// Even column
-					for (y=0; y<dh; y+=2, src+=sw+4, dst+=row)
+					for (y=0; y<dh; y+=2, src+=sw+4, dst+=jump)
 					{
-						for (x=0; x<dw; x+=2)
+						for (x=Vectorised(simd, src, dst, dw, sw, shift, pixel, true, true); x<dw; x+=2)
 						{
-							Clamp(*src, src, dst++, shift);					// R even
-							Clamp(Cross(src, sw, w2), src, dst++, shift);	// G even
-							Clamp(Checker(src, sw, w2), src, dst++, shift);	// B even
-							src++;
-							Clamp(Theta(src, sw, w2), src, dst++, shift);	// R odd
-							Clamp(*src, src, dst++, shift);					// G odd
-							Clamp(Phi(src, sw, w2), src, dst++, shift);		// B odd
-							src++;
+							Put(src, dst, pixel, *src, Cross(src, sw, w2), Checker(src, sw, w2), shift);	src++;	// Even
+							Put(src, dst, pixel, Theta(src, sw, w2), *src, Phi(src, sw, w2), shift);		src++;	// Odd
 						}
 					}
 				}
 				else
 				{
 					// Odd column
-					for (y=0; y<dh; y+=2, src+=sw+4, dst+=row)
+					for (y=0; y<dh; y+=2, src+=sw+4, dst+=jump)
 					{
-						for (x=0; x<dw; x+=2)
+						for (x=Vectorised(simd, src, dst, dw, sw, shift, pixel, true, false); x<dw; x+=2)
 						{
-							Clamp(Theta(src, sw, w2), src, dst++, shift);	// R odd
-							Clamp(*src, src, dst++, shift);					// G odd
-							Clamp(Phi(src, sw, w2), src, dst++, shift);		// B odd
-							src++;
-							Clamp(*src, src, dst++, shift);					// R even
-							Clamp(Cross(src, sw, w2), src, dst++, shift);	// G even
-							Clamp(Checker(src, sw, w2), src, dst++, shift);	// B even
-							src++;
+							Put(src, dst, pixel, Theta(src, sw, w2), *src, Phi(src, sw, w2), shift);		src++;	// Odd
+							Put(src, dst, pixel, *src, Cross(src, sw, w2), Checker(src, sw, w2), shift);	src++;	// Even
 						}
 					}
 				}
@@ -110,61 +224,65 @@ namespace psinc
 
 
 			// Odd row
-			template <typename T, typename U> static inline void Odd(T *src, U *dst, const int dw, const int dh, const int sw, const uint16_t shift, bool even)
+			template <typename T, typename U, typename N> static inline void Odd(T *src, U *dst, const int dw, const int dh, const int sw, const int stride, const N shift, const Layout::Pixel &pixel, bool even)
 			{
 				int x, y;
-				const int row	= dw * 3;
+				const int jump	= 2 * stride - dw * pixel.channels;
 				const int w2	= sw * 2;
+				const auto simd	= ColourKernel<T, Wide<U, N>>();
 
 				if (even)
 				{
 					// Even column
-					for (y=0; y<dh; y+=2, src+=sw+4, dst+=row)
+					for (y=0; y<dh; y+=2, src+=sw+4, dst+=jump)
 					{
-						for (x=0; x<dw; x+=2)
+						for (x=Vectorised(simd, src, dst, dw, sw, shift, pixel, false, false); x<dw; x+=2)
 						{
-							Clamp(Phi(src, sw, w2), src, dst++, shift);		// R even
-							Clamp(*src, src, dst++, shift);					// G even
-							Clamp(Theta(src, sw, w2), src, dst++, shift);	// B even
-							src++;
-							Clamp(Checker(src, sw, w2), src, dst++, shift);	// R odd
-							Clamp(Cross(src, sw, w2), src, dst++, shift);	// G odd
-							Clamp(*src, src, dst++, shift);					// B odd
-							src++;
+							Put(src, dst, pixel, Phi(src, sw, w2), *src, Theta(src, sw, w2), shift);		src++;	// Even
+							Put(src, dst, pixel, Checker(src, sw, w2), Cross(src, sw, w2), *src, shift);	src++;	// Odd
 						}
 					}
 				}
 				else
 				{
-					// Even column
-					for (y=0; y<dh; y+=2, src+=sw+4, dst+=row)
+					// Odd column
+					for (y=0; y<dh; y+=2, src+=sw+4, dst+=jump)
 					{
-						for (x=0; x<dw; x+=2)
+						for (x=Vectorised(simd, src, dst, dw, sw, shift, pixel, false, true); x<dw; x+=2)
 						{
-							Clamp(Checker(src, sw, w2), src, dst++, shift);	// R odd
-							Clamp(Cross(src, sw, w2), src, dst++, shift);	// G odd
-							Clamp(*src, src, dst++, shift);					// B odd
-							src++;
-							Clamp(Phi(src, sw, w2), src, dst++, shift);		// R even
-							Clamp(*src, src, dst++, shift);					// G even
-							Clamp(Theta(src, sw, w2), src, dst++, shift);	// B even
-							src++;
+							Put(src, dst, pixel, Checker(src, sw, w2), Cross(src, sw, w2), *src, shift);	src++;	// Odd
+							Put(src, dst, pixel, Phi(src, sw, w2), *src, Theta(src, sw, w2), shift);		src++;	// Even
 						}
 					}
 				}
 			}
 
 
-			#if defined(_MSC_VER)
-				// The MSVC compiler and runtimes have an issue with joining threads
-				// that have been created within a thread_local object. Instead use
-				// std::async which is implemented using a threadpool in MSVC.
-				#define PSINC_ASYNC(x) std::async(std::launch::async, x)
-			#else
-				// GCC/Clang/MinGW do not use a threadpool for std::async so
-				// use PersistentThread instead
-				#define PSINC_ASYNC(x) thread.Run(x)
-			#endif
+			// Rows in a band are limited so that the source rows (including the 2-row halo
+			// above and below required by the 5x5 kernels) fit comfortably within the cache.
+			static constexpr int BAND_BYTES = 128 * 1024;
+
+
+			// Determine an even number of destination rows per band so that each band stays cache-sized
+			// while still providing several bands per worker to balance the load.
+			template <typename T> static inline int BandRows(const int rows, const int width, const size_t workers)
+			{
+				const int cache	= BAND_BYTES / int(width * sizeof(T)) - 4;
+				const int share	= rows / int(4 * (workers + 1));
+
+				return std::max(2, std::min(cache, share) & ~1);
+			}
+
+
+			// Process the destination rows as a set of bands spread across the shared worker pool.
+			// Each band reads directly from the shared source, so the halo requires no copying.
+			template <typename Function> static inline void Bands(const int rows, const int band, Function function)
+			{
+				WorkerPool::Shared().Parallel((rows + band - 1) / band, [&](const size_t i) {
+					const int y = i * band;
+					function(y, std::min(band, rows - y));
+				});
+			}
 
 
 			// Decode data from a bayer sensor to an RGB image
@@ -173,47 +291,48 @@ namespace psinc
 			//		1: GB,RG
 			//		2: GR,BG
 			//		3: BG,GR
-			template <typename T, typename U> static bool Colour(T *src, U *dst, int width, int height, byte bayerMode, uint16_t shift)
+			// The shift may instead be a lookup table (see ToneCurve) when decoding 16-bit data to bytes.
+			// If a rows function is provided then it is called on the worker as each band of destination
+			// rows [y0, y1) is completed so that further processing can be applied while they are cached.
+			// The layout determines the channel order and row stride of the destination.
+			template <typename T, typename U, typename N, typename Rows = std::nullptr_t> static bool Colour(T *src, U *dst, int width, int height, byte bayerMode, N shift, Rows rows = nullptr, const Layout &layout = {})
 			{
-				#if !defined(_MSC_VER)
-					// This function tends to be called repeatedly, so to avoid the overhead of thread construction when using std::async
-					// it uses a persistent thread instead. The PersistentThread is used by emergent::ThreadPool but even a ThreadPool of
-					// size 1 will create another thread to manage the queue, so using the PersistentThread directly is more efficient.
-					static thread_local emg::PersistentThread thread;
-				#endif
+				const auto pixel = layout.Resolve();
 
 				// If there are not an even number of rows and columns then do not convert
-				if (width % 2 || height % 2)
+				if (width % 2 || height % 2 || bayerMode > 3 || !layout.Valid(width - 4, pixel.channels))
 				{
 					return false;
 				}
 
-				int dw	= width - 4;
-				int dh	= height - 4;
-				src 	+= width + width + 2;
-
-				std::future<void> f;
+				const int dw		= width - 4;
+				const int dh		= height - 4;
+				const int row		= layout.Stride(dw, pixel.channels);
+				const bool even		= bayerMode < 2;						// Whether the first row starts with an even column
+				const bool red		= bayerMode == 0 || bayerMode == 2;		// Whether the first row is a red row
+				src 				+= width + width + 2;
 
-				switch (bayerMode)
-				{
-					case 0: f = PSINC_ASYNC([=] { Even(src, dst, dw, dh, width, shift, true); });
-							Odd(src + width, dst + 3 * dw, dw, dh, width, shift, true);
-							break;
-
-					case 1: f = PSINC_ASYNC([=] { Odd(src, dst, dw, dh, width, shift, true); });
-							Even(src + width, dst + 3 * dw, dw, dh, width, shift, true);
-							break;
-
-					case 2: f = PSINC_ASYNC([=] { Even(src, dst, dw, dh, width, shift, false); });
-							Odd(src + width, dst + 3 * dw, dw, dh, width, shift, false);
-							break;
+				// Bands always start on an even row so the row pattern is the same for each
+				Bands(dh, BandRows<T>(dh, width, WorkerPool::Shared().Size()), [&](const int y, const int count) {
+					T *s = src + y * width;
+					U *d = dst + (size_t)y * row;
 
-					case 3: f = PSINC_ASYNC([=] { Odd(src, dst, dw, dh, width, shift, false); });
-							Even(src + width, dst + 3 * dw, dw, dh, width, shift, false);
-							break;
-				}
+					if (red)
+					{
+						Even(s, d, dw, count, width, row, shift, pixel, even);
+						Odd(s + width, d + row, dw, count, width, row, shift, pixel, even);
+					}
+					else
+					{
+						Odd(s, d, dw, count, width, row, shift, pixel, even);
+						Even(s + width, d + row, dw, count, width, row, shift, pixel, even);
+					}
 
-				f.wait();
+					if constexpr (!std::is_null_pointer_v<Rows>)
+					{
+						rows(y, y + count);
+					}
+				});
 
 				return true;
 			}
@@ -233,58 +352,82 @@ namespace psinc
 			}
 
 
-			// Decode data from a bayer sensor to a greyscale image
-			// Bayer mode offsets (see above)
-			template <typename T, typename U> static bool Grey(T *src, U *dst, int width, int height, byte bayerMode, uint16_t shift)
+			// Decode rows of data from a bayer sensor to greyscale, where phase indicates
+			// that the first row starts on a non-green pixel
+			template <typename T, typename U, typename N> static inline void GreyRows(T *src, U *dst, const int dw, const int dh, const int width, const int stride, const N shift, const bool phase)
 			{
-				// If there are not an even number of rows and columns then do not convert
-				if (width % 2 || height % 2)
-				{
-					return false;
-				}
-
 				int x, y;
-				int w2	= width * 2;
-				int dw	= width - 4;
-				int dh	= height - 4;
-				src 	+= width + width + 2;
+				const int w2	= width * 2;
+				const int jump	= stride - dw;
+				const auto simd	= GreyKernel<T, Wide<U, N>>();
 
-				if (bayerMode == 0 || bayerMode == 3)
+				if (phase)
 				{
 					for (y=0; y<dh; y+=2)
 					{
-						for (x=0; x<dw; x+=2)
+						for (x=Vectorised(simd, src, dst, dw, width, shift, true); x<dw; x+=2)
 						{
 							Clamp(GreyN(src, width, w2), src, dst++, shift);	src++;
 							Clamp(GreyG(src, width, w2), src, dst++, shift);	src++;
 						}
 						src += 4;
-						for (x=0; x<dw; x+=2)
+						dst += jump;
+						for (x=Vectorised(simd, src, dst, dw, width, shift, false); x<dw; x+=2)
 						{
 							Clamp(GreyG(src, width, w2), src, dst++, shift);	src++;
 							Clamp(GreyN(src, width, w2), src, dst++, shift);	src++;
 						}
 						src += 4;
+						dst += jump;
 					}
 				}
 				else
 				{
 					for (y=0; y<dh; y+=2)
 					{
-						for (x=0; x<dw; x+=2)
+						for (x=Vectorised(simd, src, dst, dw, width, shift, false); x<dw; x+=2)
 						{
 							Clamp(GreyG(src, width, w2), src, dst++, shift);	src++;
 							Clamp(GreyN(src, width, w2), src, dst++, shift);	src++;
 						}
 						src += 4;
-						for (x=0; x<dw; x+=2)
+						dst += jump;
+						for (x=Vectorised(simd, src, dst, dw, width, shift, true); x<dw; x+=2)
 						{
 							Clamp(GreyN(src, width, w2), src, dst++, shift);	src++;
 							Clamp(GreyG(src, width, w2), src, dst++, shift);	src++;
 						}
 						src += 4;
+						dst += jump;
 					}
 				}
+			}
+
+
+			// Decode data from a bayer sensor to a greyscale image
+			// Bayer mode offsets, the rows function and the layout (of which only the stride applies)
+			template <typename T, typename U, typename N, typename Rows = std::nullptr_t> static bool Grey(T *src, U *dst, int width, int height, byte bayerMode, N shift, Rows rows = nullptr, const Layout &layout = {})
+			{
+				// If there are not an even number of rows and columns then do not convert
+				if (width % 2 || height % 2 || !layout.Valid(width - 4, 1))
+				{
+					return false;
+				}
+
+				const int dw		= width - 4;
+				const int dh		= height - 4;
+				const int row		= layout.Stride(dw, 1);
+				const bool phase	= bayerMode == 0 || bayerMode == 3;
+				src 				+= width + width + 2;
+
+				Bands(dh, BandRows<T>(dh, width, WorkerPool::Shared().Size()), [&](const int y, const int count) {
+					GreyRows(src + y * width, dst + (size_t)y * row, dw, count, width, row, shift, phase);
+
+					if constexpr (!std::is_null_pointer_v<Rows>)
+					{
+						rows(y, y + count);
+					}
+				});
 
 				return true;
 			}
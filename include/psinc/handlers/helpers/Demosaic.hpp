@@ -1,11 +1,12 @@
 #pragma once
 
-#include <emergent/Timer.hpp>
-
+#include <psinc/handlers/helpers/Layout.hpp>
+#include <psinc/handlers/helpers/WorkerPool.hpp>
 #include <emergent/Emergent.hpp>
-#include <emergent/parallel/Generator.hpp>
-#include <execution>
+#include <algorithm>
+#include <array>
 #include <limits>
+#include <vector>
 #include <cmath>
 
 
@@ -24,32 +25,35 @@ namespace psinc::bayer
 			// some of the artefacts found with the original bayer decoder, such as zippering around coloured edges, by using gradient-based weighting
 			// when determining the missing green values. The red and blue channel interpolation uses a very simple local neighbourhood colour differential
 			// algorithm which assumes that chromaticity changes at a much lower frequency than intensity.
-			static bool Decode(const byte bayerMode, const T *src, const size_t width, const size_t height, const byte depth, U *dst, const size_t shift)
+			//
+			// The image is processed as a set of horizontal strips spread across the shared worker pool. Each strip is interpolated within
+			// a small cache-sized buffer (with a 2-row halo above and below) and written directly to the destination type. If a
+			// rows function is provided then it is called as each strip of destination rows [y0, y1) is completed. When decoding
+			// 16-bit data to bytes the shift may instead be a lookup table (see ToneCurve). The layout determines the channel order
+			// and row stride of the destination, where a depth of 1 is greyscale and otherwise must match the channels of the layout.
+			template <typename N, typename Rows = std::nullptr_t> static bool Decode(const byte bayerMode, const T *src, const size_t width, const size_t height, const byte depth, U *dst, const N shift, Rows rows = nullptr, const Layout &layout = {})
 			{
-				if constexpr (std::is_same_v<T, U>)
+				if (bayerMode > 3 || !layout.Valid(width, depth))
 				{
-					if (depth == 3)
-					{
-						return Decode(CFA[bayerMode], src, width, height, dst);
-					}
+					return false;
 				}
 
-				thread_local std::vector<T> buffer;
-				buffer.resize(width * height * 3);
+				const auto pixel	= layout.Resolve();
+				const size_t stride	= layout.Stride(width, depth);
 
-				Decode(CFA[bayerMode], src, width, height, buffer.data());
+				const int count		= StripRows(width, height, WorkerPool::Shared().Size());
+				const size_t strips	= (height + count - 1) / count;
 
-				if (depth == 1)
-				{
-					return Greyscale(buffer.data(), width * height, dst, shift);
-				}
+				WorkerPool::Shared().Parallel(strips, [&](const size_t i) {
+					const int y		= i * count;
+					const int end	= std::min<int>(y + count, height);
+
+					Strip(CFA[bayerMode], src, width, height, y, end, depth, pixel, dst, stride, shift);
 
-				std::transform(std::execution::par_unseq, buffer.begin(), buffer.end(), dst, [&](const auto &v) {
-					if constexpr (sizeof(U) < sizeof(T))
+					if constexpr (!std::is_null_pointer_v<Rows>)
 					{
-						return std::clamp<T>(v >> shift, 0, std::numeric_limits<U>::max());
+						rows(y, end);
 					}
-					return v;
 				});
 
 				return true;
@@ -59,6 +63,8 @@ namespace psinc::bayer
 		private:
 
 			static constexpr float EPSILON 							= 1e-6;
+			static constexpr int BORDER								= 4;
+			static constexpr int STRIP_BYTES						= 256 * 1024;
 			static constexpr std::array<const byte[2][2], 4> CFA	= {{
 				{{ 0, 1 }, { 1, 2 }},	// 0: RG,GB
 				{{ 1, 2 }, { 0, 1 }},	// 1: GB,RG
@@ -73,213 +79,254 @@ namespace psinc::bayer
 			}
 
 
-			static bool Greyscale(const T *src, const size_t size, U *dst, const size_t shift)
+			// The even number of rows per strip such that the intermediate buffer (including the halo) remains
+			// within the cache, while still providing several strips per worker to balance the load. Even strips
+			// keep pairs of rows together for any processing that subsamples vertically (see YuvHandler).
+			static int StripRows(const int width, const int height, const size_t workers)
 			{
-				const emg::Generator<size_t> generator(0, size, 1);
+				const int cache	= STRIP_BYTES / int(width * 3 * sizeof(T)) - 4;
+				const int share	= height / int(4 * (workers + 1));
 
-				std::for_each(
-					std::execution::par_unseq, generator.begin(), generator.end(),
-					[&](const size_t i) {
-						const T *ps		= src + i * 3;
-						const T value	= (ps[0] + ps[1] + ps[2]) / 3;
+				return std::max(2, std::min(cache, share) & ~1);
+			}
 
-						if constexpr (sizeof(U) < sizeof(T))
-						{
-							dst[i] = std::clamp<T>(value >> shift, 0, std::numeric_limits<U>::max());
-						}
-						else
-						{
-							dst[i] = value;
-						}
-					}
-				);
 
-				return true;
+			static inline T Round(const float value)
+			{
+				if constexpr (std::is_floating_point_v<T>)
+				{
+					return value;
+				}
+				else
+				{
+					return std::clamp<int>(std::lrint(value), 0, std::numeric_limits<T>::max());
+				}
 			}
 
 
-			static bool Decode(const byte cfa[2][2], const T *src, const size_t width, const size_t height, T *dst)
+			// Convert an interpolated value to the destination type
+			static inline U Narrow(const T value, const size_t shift)
 			{
-				// std::array<uint64_t, 5> times = { 0 };
-				// emg::Timer timer;
+				if constexpr (sizeof(U) < sizeof(T))
+				{
+					return std::clamp<T>(value >> shift, 0, std::numeric_limits<U>::max());
+				}
+				else
+				{
+					return value;
+				}
+			}
 
-				const emg::Generator<size_t> generator(0, height, 1);
 
-				// Populate the channels that are known
-				std::for_each(
-					std::execution::par_unseq, generator.begin(), generator.end(),
-					[&](const size_t y) {
-						const T *ps = src + y * width;
-						T *pd		= dst + y * width * 3;
+			// Convert an interpolated 16-bit value to a byte through a lookup table
+			static inline U Narrow(const T value, const byte *table)
+			{
+				return table[value];
+			}
 
-						for (size_t x=0; x<width; x++, ps++, pd+=3)
-						{
-							pd[channel(cfa, x, y)] = ps[0];
-						}
+
+			template <typename N> static inline void Store(const T *rgb, U *pd, const byte depth, const Layout::Pixel &pixel, const N shift)
+			{
+				if (depth == 1)
+				{
+					pd[0] = Narrow((rgb[0] + rgb[1] + rgb[2]) / 3, shift);
+				}
+				else
+				{
+					pd[pixel.red]	= Narrow(rgb[0], shift);
+					pd[1]			= Narrow(rgb[1], shift);
+					pd[pixel.blue]	= Narrow(rgb[2], shift);
+
+					if (depth == 4)
+					{
+						pd[3] = std::numeric_limits<U>::max();
 					}
-				);
+				}
+			}
 
-				// times[0] = timer.MicroElapsed();	timer.Reset();
 
-				PopulateGreen(cfa, src, width, height, dst);		// times[1] = timer.MicroElapsed(); timer.Reset();
-				PopulateRedBlue(cfa, dst, width, height);			// times[2] = timer.MicroElapsed(); timer.Reset();
-				PopulateRedBlueAtGreen(cfa, dst, width, height);	// times[3] = timer.MicroElapsed(); timer.Reset();
-				InterpolateBorder(cfa, 4, dst, width, height);		// times[4] = timer.MicroElapsed(); timer.Reset();
+			// Interpolate the rows [y0, y1) of the destination. The interior of the image is interpolated within
+			// the buffer (which holds rows [i0 - 2, i1 + 2) in 3-channel space) and the border is calculated from
+			// the source directly. Green is interpolated across the whole halo, including the two rows below the
+			// interior of the image, since the red and blue interpolation of the last interior rows depends upon it.
+			// The original full-frame decoder did not populate green in those two rows and so the last two rows of
+			// its interior were derived from whatever the destination (or its buffer) held beforehand.
+			template <typename N> static void Strip(const byte cfa[2][2], const T *src, const int width, const int height, const int y0, const int y1, const byte depth, const Layout::Pixel &pixel, U *dst, const size_t stride, const N shift)
+			{
+				thread_local std::vector<T> buffer;
 
-				// for (size_t i=0; i<times.size(); i++)
-				// {
-				// 	std::printf("%zu : %lu\n", i, times[i]);
-				// }
-				// std::printf("\n");
+				const int row	= width * 3;
+				const int i0	= std::max(y0, BORDER);
+				const int i1	= std::min(y1, height - BORDER);
+				const int first	= i0 - 2;
 
-				return true;
-			}
+				auto buffered = [&](const int y) { return buffer.data() + (y - first) * row; };
 
+				if (i0 < i1)
+				{
+					buffer.resize((i1 - i0 + 4) * row);
 
+					for (int y=first; y<i1+2; y++)	PopulateKnown(cfa, src, buffered(y), width, y);
+					for (int y=first; y<i1+2; y++)	PopulateGreen(cfa, src, buffered(y), width, y);
+					for (int y=i0-1; y<i1+1; y++)	PopulateRedBlue(cfa, buffered(y), width, y);
+					for (int y=i0; y<i1; y++)		PopulateRedBlueAtGreen(cfa, buffered(y), width, y);
+				}
 
-			// Calculate the gradients at the RB positions and use this to populate the green values
-			// Using a 5x5 matrix incorporates the differentials in all 3 colour channels
-			static void PopulateGreen(const byte cfa[2][2], const T *src, const size_t width, const size_t height, T *dst)
-			{
-				const emg::Generator<size_t> generator(2, height - 4, 1);
-				const int w1 = width * 1;
-				const int w2 = width * 2;
+				T rgb[3];
 
-				std::for_each(
-					std::execution::par_unseq, generator.begin(), generator.end(),
-					[&](const size_t y) {
-						// Start the row on a non-green pixel
-						const size_t sx = 2 + (channel(cfa, 0, y) & 1);
-						auto *ps		= src + y * width + sx;
-						T *pd			= dst + y * width * 3 + sx * 3;
+				for (int y=y0; y<y1; y++)
+				{
+					U *pd = dst + y * stride;
+
+					if (y < i0 || y >= i1)
+					{
+						// Top and bottom
+						for (int x=0; x<width; x++, pd+=depth)
+						{
+							CalculateMeans(cfa, src, x, y, width, height, rgb);
+							Store(rgb, pd, depth, pixel, shift);
+						}
+					}
+					else
+					{
+						const T *pb		= buffered(y);
+						const int edge	= width - BORDER;
 
-						for (size_t x=sx; x<width-2; x+=2, ps+=2, pd+=6)
+						for (int x=0; x<width; x++, pd+=depth)
 						{
-							// Calculate the intensity gradients between like colour channels in each direction
-							//
-							// Example layout when on the red pixel
-							//   R00 G01 R02 G03 R04
-							//   G10 B11 G12 B13 G14
-							//   R20 G21 R22 G23 R24
-							//   G30 B31 G32 B33 G34
-							//   R40 G41 R42 G43 R44
-							//
-							// Vertical gradient   = | 0.5 * (R02 + R42) - R22 | + | G12 - G32 |
-							// Horizontal gradient = | 0.5 * (R20 + R24) - R22 | + | G21 - G23 |
-							const float gradV = EPSILON + std::abs(0.5f * (ps[-w2] + ps[w2]) - ps[0]) + std::abs(ps[-w1] - ps[w1]);
-							const float gradH = EPSILON + std::abs(0.5f * (ps[ -2] + ps[ 2]) - ps[0]) + std::abs(ps[-1] - ps[1]);
-
-							// Based on the original -1 2 4 2 -1 filter but with a directional gradient bias
-							const float value = 0.5f * ps[0] + 0.5f * (
-								  gradV * (ps[-1] + ps[1] - 0.5f * (ps[ -2] + ps[ 2]))		// strength of vertical edge contributes power to horizontal values
-								+ gradH * (ps[-w1] + ps[w1] - 0.5f * (ps[-w2] + ps[w2]))	// strength of horizontal edge contributes power to vertical values
-							) / (gradV + gradH);
-
-							if constexpr (std::is_floating_point_v<T>)
+							if (x < BORDER || x >= edge)
 							{
-								pd[1] = value;
+								// Left and right border
+								CalculateMeans(cfa, src, x, y, width, height, rgb);
+								Store(rgb, pd, depth, pixel, shift);
 							}
 							else
 							{
-								pd[1] = std::clamp<int>(std::lrint(value), 0, std::numeric_limits<T>::max());
+								Store(pb + x * 3, pd, depth, pixel, shift);
 							}
 						}
 					}
-				);
+				}
+			}
+
+
+			// Populate the channels that are known
+			static inline void PopulateKnown(const byte cfa[2][2], const T *src, T *pd, const int width, const int y)
+			{
+				const T *ps = src + y * width;
+
+				for (int x=0; x<width; x++, ps++, pd+=3)
+				{
+					pd[channel(cfa, x, y)] = ps[0];
+				}
+			}
+
+
+			// Calculate the gradients at the RB positions and use this to populate the green values
+			// Using a 5x5 matrix incorporates the differentials in all 3 colour channels
+			static inline void PopulateGreen(const byte cfa[2][2], const T *src, T *pd, const int width, const int y)
+			{
+				const int w1 = width * 1;
+				const int w2 = width * 2;
+
+				// Start the row on a non-green pixel
+				const int sx	= 2 + (channel(cfa, 0, y) & 1);
+				const T *ps		= src + y * width + sx;
+				pd				+= sx * 3;
+
+				for (int x=sx; x<width-2; x+=2, ps+=2, pd+=6)
+				{
+					// Calculate the intensity gradients between like colour channels in each direction
+					//
+					// Example layout when on the red pixel
+					//   R00 G01 R02 G03 R04
+					//   G10 B11 G12 B13 G14
+					//   R20 G21 R22 G23 R24
+					//   G30 B31 G32 B33 G34
+					//   R40 G41 R42 G43 R44
+					//
+					// Vertical gradient   = | 0.5 * (R02 + R42) - R22 | + | G12 - G32 |
+					// Horizontal gradient = | 0.5 * (R20 + R24) - R22 | + | G21 - G23 |
+					const float gradV = EPSILON + std::abs(0.5f * (ps[-w2] + ps[w2]) - ps[0]) + std::abs(ps[-w1] - ps[w1]);
+					const float gradH = EPSILON + std::abs(0.5f * (ps[ -2] + ps[ 2]) - ps[0]) + std::abs(ps[-1] - ps[1]);
+
+					// Based on the original -1 2 4 2 -1 filter but with a directional gradient bias
+					const float value = 0.5f * ps[0] + 0.5f * (
+						  gradV * (ps[-1] + ps[1] - 0.5f * (ps[ -2] + ps[ 2]))		// strength of vertical edge contributes power to horizontal values
+						+ gradH * (ps[-w1] + ps[w1] - 0.5f * (ps[-w2] + ps[w2]))	// strength of horizontal edge contributes power to vertical values
+					) / (gradV + gradH);
+
+					pd[1] = Round(value);
+				}
 			}
 
 
 			// Populate red and blue at blue and red positions
-			static void PopulateRedBlue(const byte cfa[2][2], T *dst, const size_t width, const size_t height)
+			static inline void PopulateRedBlue(const byte cfa[2][2], T *pd, const int width, const int y)
 			{
-				const emg::Generator<size_t> generator(2, height - 4, 1);
 				// Offsets in 3-channel space
 				const int nw = -width * 3 - 3;
 				const int ne = -width * 3 + 3;
 				const int sw =  width * 3 - 3;
 				const int se =  width * 3 + 3;
 
-				std::for_each(
-					std::execution::par_unseq, generator.begin(), generator.end(),
-					[&](const size_t y) {
-						// Start the row on a non-green pixel
-						const size_t sx = 2 + (channel(cfa, 0, y) & 1);
-						const size_t ch = 2 - channel(cfa, sx, y);		// blue if on red / red if on blue
-						T *pd			= dst + y * width * 3 + sx * 3;
-
-						for (size_t x=sx; x<width-2; x+=2, pd+=6)
-						{
-							// mean colour differential of the surrounding pixels for the channel we are interpolating
-							// compared with the previously interpolated green value at the same location
-							const float diff = 0.25f * (
-								  (pd[nw + ch] - pd[nw + 1])
-								+ (pd[ne + ch] - pd[ne + 1])
-								+ (pd[sw + ch] - pd[sw + 1])
-								+ (pd[se + ch] - pd[se + 1])
-							);
-
-							if constexpr (std::is_floating_point_v<T>)
-							{
-								pd[ch] = pd[1] + diff;
-							}
-							else
-							{
-								pd[ch] = std::clamp<int>(std::lrint(pd[1] + diff), 0, std::numeric_limits<T>::max());
-							}
+				// Start the row on a non-green pixel
+				const int sx	= 2 + (channel(cfa, 0, y) & 1);
+				const int ch	= 2 - channel(cfa, sx, y);		// blue if on red / red if on blue
+				pd				+= sx * 3;
 
-						}
-					}
-				);
+				for (int x=sx; x<width-2; x+=2, pd+=6)
+				{
+					// mean colour differential of the surrounding pixels for the channel we are interpolating
+					// compared with the previously interpolated green value at the same location
+					const float diff = 0.25f * (
+						  (pd[nw + ch] - pd[nw + 1])
+						+ (pd[ne + ch] - pd[ne + 1])
+						+ (pd[sw + ch] - pd[sw + 1])
+						+ (pd[se + ch] - pd[se + 1])
+					);
+
+					pd[ch] = Round(pd[1] + diff);
+				}
 			}
 
 
 			// Populate red and blue at green positions
 			// Possibly use the neighbourhood gradients to direct this?
-			static void PopulateRedBlueAtGreen(const byte cfa[2][2], T *dst, const size_t width, const size_t height)
+			static inline void PopulateRedBlueAtGreen(const byte cfa[2][2], T *pd, const int width, const int y)
 			{
-				const emg::Generator<size_t> generator(2, height - 4, 1);
 				// Offsets in 3-channel space
 				const int n = -width * 3;
 				const int s =  width * 3;
 				const int e = -3;
 				const int w =  3;
 
-				std::for_each(
-					std::execution::par_unseq, generator.begin(), generator.end(),
-					[&](const size_t y) {
-						// Start the row on a green pixel
-						const size_t sx = 2 + (channel(cfa, 1, y) & 1);
-						T *pd			= dst + y * width * 3 + sx * 3;
+				// Start the row on a green pixel
+				const int sx	= 2 + (channel(cfa, 1, y) & 1);
+				pd				+= sx * 3;
 
-						for (size_t x=sx; x<width-2; x+=2, pd+=6)
-						{
-							for (size_t ch : { 0, 2 }) // red and blue
-							{
-								// mean colour differential of the surrounding pixels for the channel we are interpolating
-								// compared with the previously interpolated green value at the same location
-								const float diff = 0.25f * (
-									  (pd[n + ch] - pd[n + 1])
-									+ (pd[e + ch] - pd[e + 1])
-									+ (pd[s + ch] - pd[s + 1])
-									+ (pd[w + ch] - pd[w + 1])
-								);
-
-								if constexpr (std::is_floating_point_v<T>)
-								{
-									pd[ch] = pd[1] + diff;
-								}
-								else
-								{
-									pd[ch] = std::clamp<int>(std::lrint(pd[1] + diff), 0, std::numeric_limits<T>::max());
-								}
-							}
-						}
+				for (int x=sx; x<width-2; x+=2, pd+=6)
+				{
+					for (int ch : { 0, 2 }) // red and blue
+					{
+						// mean colour differential of the surrounding pixels for the channel we are interpolating
+						// compared with the previously interpolated green value at the same location
+						const float diff = 0.25f * (
+							  (pd[n + ch] - pd[n + 1])
+							+ (pd[e + ch] - pd[e + 1])
+							+ (pd[s + ch] - pd[s + 1])
+							+ (pd[w + ch] - pd[w + 1])
+						);
+
+						pd[ch] = Round(pd[1] + diff);
 					}
-				);
+				}
 			}
 
 
-			static inline void CalculateMeans(const byte cfa[2][2], T *pd, const int x, const int y, const int width, const int height)
+			// The mean of each channel within the 3x3 neighbourhood, which only depends upon the known
+			// values and so can be calculated from the source directly.
+			static inline void CalculateMeans(const byte cfa[2][2], const T *src, const int x, const int y, const int width, const int height, T *rgb)
 			{
 				using Sum = std::conditional_t<std::is_floating_point_v<T>, double, int64_t>;
 
@@ -289,14 +336,14 @@ namespace psinc::bayer
 				const int ey	= y < height-1 ? 2 : 1;
 				const int sx	= x > 0 ? -1 : 0;
 				const int ex	= x < width - 1 ? 2 : 1;
-				const int row	= width * 3;
+				const T *ps		= src + y * width + x;
 
 				for (int dy=sy; dy<ey; dy++)
 				{
 					for (int dx=sx; dx<ex; dx++)
 					{
 						const byte ch = channel(cfa, x+dx, y+dy);
-						sum[ch] += pd[dy * row + dx * 3 + ch];
+						sum[ch] += ps[dy * width + dx];
 						tally[ch]++;
 					}
 				}
@@ -305,46 +352,8 @@ namespace psinc::bayer
 
 				for (byte c=0; c<3; c++)
 				{
-					pd[c] = c == ch ? pd[c] : sum[c] / tally[c];
+					rgb[c] = c == ch ? ps[0] : sum[c] / tally[c];
 				}
 			}
-
-
-			// Border must be greater than zero otherwise this might be unhappy
-			static void InterpolateBorder(const byte cfa[2][2], const size_t border, T *dst, const size_t width, const size_t height)
-			{
-				const size_t edge = width - border;
-				const emg::Generator<size_t> generator(0, height, 1);
-
-				std::for_each(
-					std::execution::par_unseq, generator.begin(), generator.end(),
-					[&](const size_t y) {
-						T *pd = dst + y * width * 3;
-
-						if (y < border || y >= height - border)
-						{
-							// Top and bottom
-							for (size_t x=0; x<width; x++, pd+=3)
-							{
-								CalculateMeans(cfa, pd, x, y, width, height);
-							}
-						}
-						else
-						{
-							// Left border
-							for (size_t x=0; x<border; x++)
-							{
-								CalculateMeans(cfa, pd + x * 3, x, y, width, height);
-							}
-
-							// Right border
-							for (size_t x=edge; x<width; x++)
-							{
-								CalculateMeans(cfa, pd + x * 3, x, y, width, height);
-							}
-						}
-					}
-				);
-			}
 	};
 }
@@ -2,6 +2,9 @@
 
 #include <emergent/Maths.hpp>
 #include <emergent/image/Image.hpp>
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
 
 
 namespace psinc
@@ -28,41 +31,126 @@ namespace psinc
 			};
 
 
+			/// Apply the correction to a whole image
 			template <typename T> static void Process(const Configuration &configuration, emg::ImageBase<T> &image)
 			{
+				Process(configuration, image, 0, image.Height());
+			}
+
+
+			/// Apply the correction to the rows [y0, y1) of an image. This allows the correction to be
+			/// fused with a decoder so that each band of rows is corrected while it is still in the cache.
+			template <typename T> static void Process(const Configuration &configuration, emg::ImageBase<T> &image, int y0, int y1)
+			{
+				Process(configuration, image.Data(), image.Width(), image.Height(), image.Depth(), image.Width() * image.Depth(), y0, y1);
+			}
+
+
+			/// Apply the correction to the rows [y0, y1) of a destination with the given dimensions and
+			/// stride (in elements) between rows. The alpha channel of a 4-channel destination is left
+			/// untouched.
+			template <typename T> static void Process(const Configuration &configuration, T *data, size_t width, size_t height, emg::byte depth, size_t stride, int y0, int y1)
+			{
+				const Region<T> region = { data, width, height, depth, stride };
+
 				switch (configuration.mode)
 				{
 					case Mode::Disabled:	break;
-					case Mode::RowOffset:	Apply(configuration, image, [=](const T s) { return s + configuration.offset; });			break;
-					case Mode::RowGain:		Apply(configuration, image,	[=](const T s) { return std::lrint(configuration.gain * s); });	break;
+					case Mode::RowOffset:	Apply(configuration, region, y0, y1, [=](const T s) { return s + configuration.offset; });	break;
+					case Mode::RowGain:
+					{
+						if constexpr (std::is_integral_v<T>)
+						{
+							// Fixed-point multiplier rather than converting each pixel to and from a double
+							const int64_t multiplier = std::llrint(configuration.gain * (1 << PRECISION));
+
+							Apply(configuration, region, y0, y1, [=](const T s) { return (s * multiplier + ROUNDING) >> PRECISION; });
+						}
+						else
+						{
+							Apply(configuration, region, y0, y1, [=](const T s) { return std::lrint(configuration.gain * s); });
+						}
+						break;
+					}
 				}
 			}
 
 
 		private:
 
+			/// Number of fractional bits used for the fixed-point gain
+			static constexpr int PRECISION			= 16;
+			static constexpr int64_t ROUNDING		= 1 << (PRECISION - 1);
+
+
+			template <typename T> struct Region
+			{
+				T *data;
+				size_t width;
+				size_t height;
+				emg::byte depth;
+				size_t stride;
+			};
+
 
-			template <typename T, typename Operation> static void Apply(const Configuration &configuration, emg::ImageBase<T> &image, Operation operation)
+			template <typename T, typename Operation> static void Apply(const Configuration &configuration, const Region<T> &region, int y0, int y1, Operation operation)
 			{
-				int x, y;
-				const int width		= image.Width();
-				const int height	= image.Height();
-				const int depth		= image.Depth();
-				const int row		= width * depth;
-				const int mark		= configuration.mark * row;
-				const int space		= configuration.space * row;
-				const int limit		= height - configuration.mark;
+				const size_t row	= region.width * region.depth;
+				const bool packed	= region.stride == row && region.depth != 4;
 				const int window	= configuration.mark + configuration.space;
-				T *src				= image + configuration.start * row;
 
-				for (y=configuration.start; y<height; y+=window, src+=space)
+				if (configuration.mark <= 0 || configuration.space < 0)
+				{
+					return;
+				}
+
+				y0 = std::max(y0, configuration.start);
+				y1 = std::min<int>(y1, region.height);
+
+				while (y0 < y1)
 				{
-					const int end = y < limit ? mark : (height - y) * row;
+					const int phase = (y0 - configuration.start) % window;
 
-					for (x=0; x<end; x++, src++)
+					if (phase < configuration.mark)
 					{
-						*src = emg::Maths::clamp<T>(operation(*src));
+						// Within the mark, so correct the rows up to the end of it
+						const int end = std::min(y1, y0 + configuration.mark - phase);
+
+						if (packed)
+						{
+							Correct(region.data + y0 * row, (end - y0) * row, operation);
+						}
+						else
+						{
+							for (int y=y0; y<end; y++)
+							{
+								T *src = region.data + y * region.stride;
+
+								if (region.depth == 4)
+								{
+									for (size_t x=0; x<region.width; x++, src+=4)
+									{
+										Correct(src, 3, operation);
+									}
+								}
+								else
+								{
+									Correct(src, row, operation);
+								}
+							}
+						}
 					}
+
+					y0 += window - phase;
+				}
+			}
+
+
+			template <typename T, typename Operation> static inline void Correct(T *src, const size_t count, Operation operation)
+			{
+				for (T *last = src + count; src<last; src++)
+				{
+					*src = emg::Maths::clamp<T>(operation(*src));
 				}
 			}
 	};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <emergent/Emergent.hpp>
+#include <cstddef>
+
+
+namespace psinc
+{
+	using emg::byte;
+
+	/// The order of the channels within a decoded colour pixel. The alpha channel, where
+	/// present, is always fully opaque.
+	enum class ChannelOrder : byte
+	{
+		RGB		= 0,
+		BGR		= 1,
+		RGBA	= 2,
+		BGRA	= 3		// Matches QImage::Format_RGB32 and 32-bit Windows bitmaps on little-endian machines
+	};
+
+
+	/// The arrangement of the destination that a decoder writes to. This allows the decoders to
+	/// emit the final layout required by the consumer (such as OpenCV, Qt or a bitmap with padded
+	/// rows) directly rather than with a further pass over the image.
+	struct Layout
+	{
+		/// Applies to colour destinations only
+		ChannelOrder order = ChannelOrder::RGB;
+
+		/// Elements from the start of one row to the next, or 0 if the rows are packed
+		size_t stride = 0;
+
+
+		/// The offsets of the channels within a colour pixel, resolved once before decoding
+		struct Pixel
+		{
+			int red			= 0;
+			int blue		= 2;
+			int channels	= 3;
+		};
+
+
+		Pixel Resolve() const
+		{
+			const bool swapped = this->order == ChannelOrder::BGR || this->order == ChannelOrder::BGRA;
+
+			return { swapped ? 2 : 0, swapped ? 0 : 2, this->Channels() };
+		}
+
+
+		/// The number of channels in a colour pixel
+		byte Channels() const
+		{
+			return this->order == ChannelOrder::RGBA || this->order == ChannelOrder::BGRA ? 4 : 3;
+		}
+
+
+		/// The stride of a destination with the given row width (in pixels) and depth
+		size_t Stride(const size_t width, const byte depth) const
+		{
+			return this->stride ? this->stride : width * depth;
+		}
+
+
+		/// Whether a destination of the given width and depth is compatible with this layout
+		bool Valid(const size_t width, const byte depth) const
+		{
+			return (depth == 1 || depth == this->Channels()) && this->Stride(width, depth) >= width * depth;
+		}
+	};
+}
@@ -1,12 +1,15 @@
 #pragma once
 
+#include <psinc/handlers/helpers/Layout.hpp>
+#include <psinc/handlers/helpers/Simd.hpp>
+#include <psinc/handlers/helpers/WorkerPool.hpp>
 #include <emergent/Maths.hpp>
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
+#include <limits>
+#include <type_traits>
 
-// #if __has_include(<execution>)
-// 	#include <emergent/parallel/Generator.hpp>
-// 	#include <execution>
-// #endif
 
 namespace psinc
 {
@@ -18,99 +21,163 @@ namespace psinc
 	{
 		public:
 
-			// #if __has_include(<execution>)
-			// 	template <typename T, typename U> static bool Decode(const T *src, U *dst, const size_t width, const size_t height, const byte depth, const uint16_t shift)
-			// 	{
-			// 		const emg::Generator<size_t> generator(0, width * height, 1);
-
-			// 		if (depth == 3)
-			// 		{
-			// 			std::for_each(
-			// 				std::execution::par_unseq, generator.begin(), generator.end(),
-			// 				[&](const size_t i) {
-			// 					U *pd = dst + i * 3;
-
-			// 					if constexpr (sizeof(U) < sizeof(T))
-			// 					{
-			// 						pd[0] = pd[1] = pd[2] = std::clamp<T>(src[i] >> shift, 0, std::numeric_limits<U>::max());
-			// 					}
-			// 					else
-			// 					{
-			// 						pd[0] = pd[1] = pd[2] = src[i];
-			// 					}
-			// 				}
-			// 			);
-			// 		}
-			// 		else if (std::is_same_v<T, U>)
-			// 		{
-			// 			std::memcpy(dst, src, generator.count * sizeof(T));
-			// 		}
-			// 		else
-			// 		{
-			// 			std::for_each(
-			// 				std::execution::par_unseq, generator.begin(), generator.end(),
-			// 				[&](const size_t i)
-			// 				{
-			// 					if constexpr (sizeof(U) < sizeof(T))
-			// 					{
-			// 						dst[i] = std::clamp<T>(src[i] >> shift, 0, std::numeric_limits<U>::max());
-			// 					}
-			// 					else
-			// 					{
-			// 						dst[i] = src[i];
-			// 					}
-			// 				}
-			// 			);
-			// 		}
-
-			// 		return true;
-			// 	}
-
-			// #else
-
-				template <typename T, typename U> static bool Decode(const T *src, U *dst, const size_t width, const size_t height, const byte depth, const uint16_t shift)
+			// Decode the image. When decoding 16-bit data to bytes the shift may instead be a lookup
+			// table (see ToneCurve). If a rows function is provided then it is called as each band
+			// of destination rows [y0, y1) is completed so that further processing can be applied
+			// while those rows are still in the cache. Large images are decoded as a set of bands
+			// spread across the shared worker pool, in which case the rows function is called on
+			// the worker that decoded the band. A depth greater than 1 replicates each pixel into the
+			// channels of the layout (with an opaque alpha where present) and the layout also
+			// provides the row stride of the destination.
+			template <typename T, typename U, typename N, typename Rows = std::nullptr_t> static bool Decode(const T *src, U *dst, const size_t width, const size_t height, const byte depth, const N shift, Rows rows = nullptr, const Layout &layout = {})
+			{
+				if (!layout.Valid(width, depth))
 				{
-					using emg::Maths;
+					return false;
+				}
+
+				const size_t row	= width * depth;
+				const size_t stride	= layout.Stride(width, depth);
+				const size_t band	= std::max<size_t>(1, BAND_BYTES / std::max<size_t>(1, row * sizeof(U)));
+				const size_t bands	= (height + band - 1) / band;
 
-					const size_t size = width * height;
+				auto decode = [&](const size_t i) {
+					const size_t y		= i * band;
+					const size_t end	= std::min(y + band, height);
 
-					if (depth == 3)
+					if (stride == row)
 					{
-						for (size_t i=0; i<size; i++, dst+=3)
+						Pixels(src + y * width, dst + y * row, (end - y) * width, depth, shift);
+					}
+					else
+					{
+						for (size_t j=y; j<end; j++)
 						{
-							if constexpr (sizeof(U) < sizeof(T))
-							{
-								dst[0] = dst[1] = dst[2] = std::clamp<T>(*src++ >> shift, 0, std::numeric_limits<U>::max());
-							}
-							else
-							{
-								dst[0] = dst[1] = dst[2] = *src++;
-							}
+							Pixels(src + j * width, dst + j * stride, width, depth, shift);
 						}
 					}
-					else if (std::is_same_v<T, U>)
+
+					if constexpr (!std::is_null_pointer_v<Rows>)
+					{
+						rows(int(y), int(end));
+					}
+				};
+
+				if (width * height < PARALLEL_PIXELS)
+				{
+					for (size_t i=0; i<bands; i++)
+					{
+						decode(i);
+					}
+				}
+				else
+				{
+					WorkerPool::Shared().Parallel(bands, decode);
+				}
+
+				return true;
+			}
+
+
+			template <typename T, typename U> using Row = int (*)(const T *, U *, int, int, int);
+
+
+			// The vectorised conversion for the instruction set supported by this CPU (nullptr if unsupported)
+			template <typename T, typename U> static inline Row<T, U> Kernel()
+			{
+				return simd::Dispatch<Row<T, U>>([](auto k) { return &decltype(k)::template Monochrome<T, U>; });
+			}
+
+
+		private:
+
+			// Destination rows in a band are limited so that they remain in the cache until processed
+			static constexpr size_t BAND_BYTES = 64 * 1024;
+
+			// Images smaller than this are not worth spreading across the worker pool
+			static constexpr size_t PARALLEL_PIXELS = 256 * 1024;
+
+
+			template <typename T, typename U, typename N> static void Pixels(const T *src, U *dst, const size_t size, const byte depth, const N shift)
+			{
+				if constexpr (std::is_pointer_v<N>)
+				{
+					// Narrowing through a lookup table
+					if (depth > 1)
 					{
-						std::memcpy(dst, src, size * sizeof(T));
+						for (size_t i=0; i<size; i++, dst+=depth)
+						{
+							Replicate(dst, depth, shift[*src++]);
+						}
 					}
 					else
 					{
 						for (size_t i=0; i<size; i++)
 						{
-							if constexpr (sizeof(U) < sizeof(T))
-							{
-								// *dst++ = Maths::clamp<U>(*src++ >> shift);
-								*dst++ = std::clamp<T>(*src++ >> shift, 0, std::numeric_limits<U>::max());
-							}
-							else
-							{
-								*dst++ = *src++;
-							}
+							*dst++ = shift[*src++];
 						}
 					}
+				}
+				else if (depth > 1 || !std::is_same_v<T, U>)
+				{
+					const auto simd		= Kernel<T, U>();
+					const size_t done	= simd ? simd(src, dst, size, depth, shift) : 0;
+
+					src		+= done;
+					dst		+= done * depth;
+
+					Scalar(src, dst, size - done, depth, shift);
+				}
+				else
+				{
+					std::memcpy(dst, src, size * sizeof(T));
+				}
+			}
+
 
-					return true;
+			// Replicate a value into the colour channels of a pixel, where a fourth channel is alpha
+			template <typename U, typename V> static inline void Replicate(U *dst, const byte depth, const V value)
+			{
+				dst[0] = dst[1] = dst[2] = value;
+
+				if (depth == 4)
+				{
+					dst[3] = std::numeric_limits<U>::max();
 				}
+			}
 
-			// #endif
+
+			template <typename T, typename U> static void Scalar(const T *src, U *dst, const size_t size, const byte depth, const uint16_t shift)
+			{
+				if (depth > 1)
+				{
+					for (size_t i=0; i<size; i++, dst+=depth)
+					{
+						if constexpr (sizeof(U) < sizeof(T))
+						{
+							Replicate(dst, depth, std::clamp<T>(*src++ >> shift, 0, std::numeric_limits<U>::max()));
+						}
+						else
+						{
+							Replicate(dst, depth, *src++);
+						}
+					}
+				}
+				else
+				{
+					for (size_t i=0; i<size; i++)
+					{
+						if constexpr (sizeof(U) < sizeof(T))
+						{
+							// *dst++ = Maths::clamp<U>(*src++ >> shift);
+							*dst++ = std::clamp<T>(*src++ >> shift, 0, std::numeric_limits<U>::max());
+						}
+						else
+						{
+							*dst++ = *src++;
+						}
+					}
+				}
+			}
 	};
 }
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <emergent/Emergent.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define PSINC_SIMD_X86
+	#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__)
+	#define PSINC_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+#define PSINC_STRINGIFY(x) #x
+
+// Enable a specific instruction set for all functions (including templates) defined
+// between a push and pop so that runtime dispatch can select the best implementation
+// without requiring the whole library to be compiled for a particular CPU.
+#if defined(__clang__)
+	#define PSINC_TARGET_PUSH(x)	_Pragma(PSINC_STRINGIFY(clang attribute push(__attribute__((target(x))), apply_to = function)))
+	#define PSINC_TARGET_POP		_Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+	#define PSINC_TARGET_PUSH(x)	_Pragma("GCC push_options") _Pragma(PSINC_STRINGIFY(GCC target(x)))
+	#define PSINC_TARGET_POP		_Pragma("GCC pop_options")
+#endif
+
+
+namespace psinc::simd
+{
+	using emg::byte;
+
+	/// Instruction sets supported by the vectorised kernels in order of preference
+	enum class Level
+	{
+		None	= 0,
+		Sse41	= 1,
+		Neon	= 2,
+		Avx2	= 3
+	};
+
+
+	/// The best instruction set supported by this CPU
+	inline Level Detect()
+	{
+		#if defined(PSINC_SIMD_X86)
+			__builtin_cpu_init();
+
+			if (__builtin_cpu_supports("avx2"))		return Level::Avx2;
+			if (__builtin_cpu_supports("sse4.1"))	return Level::Sse41;
+
+		#elif defined(PSINC_SIMD_NEON)
+			return Level::Neon;
+		#endif
+
+		return Level::None;
+	}
+
+
+	// Upper limit on the instruction set that may be used, primarily to allow the
+	// scalar implementations to be selected for comparison.
+	inline std::atomic<Level> &Limit()
+	{
+		static std::atomic<Level> limit = Level::Avx2;
+		return limit;
+	}
+
+
+	/// Restrict the kernels to a particular instruction set (Level::None for scalar only)
+	inline void Restrict(Level level)
+	{
+		Limit() = level;
+	}
+
+
+	/// The instruction set that will be used by the kernels
+	inline Level Active()
+	{
+		static const Level detected = Detect();
+		return std::min(detected, Limit().load());
+	}
+}
+
+
+// Each instruction set has a vector abstraction (V) and the generic kernels are then
+// compiled against it within a region targeting that instruction set.
+#if defined(PSINC_SIMD_X86)
+	PSINC_TARGET_PUSH("sse4.1")
+	namespace psinc::simd::sse41
+	{
+		#include <psinc/handlers/helpers/simd/Sse41.hpp>
+		#include <psinc/handlers/helpers/simd/Kernels.hpp>
+	}
+	PSINC_TARGET_POP
+
+	PSINC_TARGET_PUSH("avx2")
+	namespace psinc::simd::avx2
+	{
+		#include <psinc/handlers/helpers/simd/Avx2.hpp>
+		#include <psinc/handlers/helpers/simd/Kernels.hpp>
+	}
+	PSINC_TARGET_POP
+
+#elif defined(PSINC_SIMD_NEON)
+	namespace psinc::simd::neon
+	{
+		#include <psinc/handlers/helpers/simd/Neon.hpp>
+		#include <psinc/handlers/helpers/simd/Kernels.hpp>
+	}
+#endif
+
+
+namespace psinc::simd
+{
+	/// Select the implementation of a kernel for the active instruction set. The selector
+	/// is given the kernels compiled for each instruction set and must return a pointer to
+	/// the required function. Returns nullptr when the scalar implementation should be used.
+	template <typename Function, typename Selector> inline Function Dispatch(Selector selector)
+	{
+		switch (Active())
+		{
+			#if defined(PSINC_SIMD_X86)
+				case Level::Avx2:	return selector(avx2::Kernels {});
+				case Level::Sse41:	return selector(sse41::Kernels {});
+			#elif defined(PSINC_SIMD_NEON)
+				case Level::Neon:	return selector(neon::Kernels {});
+			#endif
+			default:				return nullptr;
+		}
+	}
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <emergent/Emergent.hpp>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+
+namespace psinc
+{
+	using emg::byte;
+
+	/// A precomputed mapping from 16-bit HDR values to bytes.
+	///
+	/// The table holds an entry for every possible 16-bit value so that the conversion
+	/// is a single lookup per pixel, regardless of how costly the curve is to evaluate.
+	/// It is applied by the decoders in place of the right shift when an ImageHandler is
+	/// decoding HDR data to a byte image (see ImageHandler::Tone), which avoids a further
+	/// pass over the image and retains the precision of the original data.
+	///
+	/// Most of the curves operate over a window [low, high] of the input range so that the
+	/// full output range can be used for sensors that only produce 10 or 12 bits of data.
+	/// Values outside of the window are clamped.
+	class ToneCurve
+	{
+		public:
+
+			static constexpr size_t SIZE = 65536;
+
+
+			/// Equivalent to the default conversion (a right shift of 8)
+			ToneCurve() : ToneCurve(Shift(8)) {}
+
+
+			/// Use a table supplied by the caller, which must contain SIZE entries
+			explicit ToneCurve(std::vector<byte> table) : table(std::move(table))
+			{
+				this->table.resize(SIZE, this->table.empty() ? 0 : this->table.back());
+			}
+
+
+			/// Equivalent to ImageHandler::Shift, the value is shifted right and then clamped
+			static ToneCurve Shift(uint16_t bits)
+			{
+				std::vector<byte> table(SIZE);
+
+				for (size_t i=0; i<SIZE; i++)
+				{
+					table[i] = std::min<size_t>(i >> std::min<uint16_t>(bits, 16), 255);
+				}
+
+				return ToneCurve(std::move(table));
+			}
+
+
+			/// Linear mapping of the window [low, high] to the output range (window/level)
+			static ToneCurve Window(uint16_t low, uint16_t high)
+			{
+				return Custom([](double x) { return x; }, low, high);
+			}
+
+
+			/// Gamma correction of the window [low, high], where a gamma greater than 1 brightens
+			/// the darker regions of the image (output = input ^ (1 / gamma))
+			static ToneCurve Gamma(double gamma, uint16_t low = 0, uint16_t high = SIZE - 1)
+			{
+				const double exponent = gamma > 0 ? 1.0 / gamma : 1.0;
+
+				return Custom([=](double x) { return std::pow(x, exponent); }, low, high);
+			}
+
+
+			/// Logarithmic compression of the window [low, high]. The strength controls how much of
+			/// the output range is given to the darker regions and must be greater than 0.
+			static ToneCurve Log(double strength = 100, uint16_t low = 0, uint16_t high = SIZE - 1)
+			{
+				const double scale = strength > 0 ? strength : 1.0;
+
+				return Custom([=](double x) { return std::log1p(scale * x) / std::log1p(scale); }, low, high);
+			}
+
+
+			/// A curve supplied by the caller. The input within the window [low, high] is normalised
+			/// to [0, 1] and the curve must return a value in the range [0, 1], which is then scaled
+			/// to the output range.
+			static ToneCurve Custom(std::function<double(double)> curve, uint16_t low = 0, uint16_t high = SIZE - 1)
+			{
+				std::vector<byte> table(SIZE);
+
+				const double range = high > low ? high - low : 1;
+
+				for (size_t i=0; i<SIZE; i++)
+				{
+					const double x	= std::clamp((double(i) - low) / range, 0.0, 1.0);
+					table[i]		= std::lrint(std::clamp(curve(x), 0.0, 1.0) * 255.0);
+				}
+
+				return ToneCurve(std::move(table));
+			}
+
+
+			/// The table to be used by the decoders
+			const byte *Table() const
+			{
+				return this->table.data();
+			}
+
+
+			byte operator[](uint16_t value) const
+			{
+				return this->table[value];
+			}
+
+
+		private:
+
+			std::vector<byte> table;
+	};
+}
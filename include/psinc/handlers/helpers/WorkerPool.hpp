@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace psinc
+{
+	// A pool of worker threads used by the decoders to process an image as a set of
+	// independent bands. A single pool is shared by all handlers so that the number of
+	// threads does not grow with the number of cameras. The calling thread always takes
+	// part in the work, so progress is guaranteed even if every worker is busy serving
+	// another caller (or the pool has been resized to zero).
+	class WorkerPool
+	{
+		public:
+
+			/// The pool shared by all image handlers. By default it has one less worker
+			/// than the number of hardware threads since the caller also does work.
+			static WorkerPool &Shared()
+			{
+				static WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+				return pool;
+			}
+
+
+			explicit WorkerPool(const size_t count)
+			{
+				this->Resize(count);
+			}
+
+
+			~WorkerPool()
+			{
+				this->Stop();
+			}
+
+
+			/// Change the number of worker threads. Any work in progress is unaffected.
+			void Resize(const size_t count)
+			{
+				std::lock_guard lock(this->resizing);
+
+				this->Stop();
+
+				std::lock_guard lock2(this->cs);
+				this->run = true;
+
+				for (size_t i=0; i<count; i++)
+				{
+					this->threads.emplace_back(&WorkerPool::Entry, this);
+				}
+			}
+
+
+			/// The number of worker threads (excluding the caller)
+			size_t Size()
+			{
+				std::lock_guard lock(this->cs);
+				return this->threads.size();
+			}
+
+
+			/// Invoke job(i) for every i in [0, count) spread across the workers and the calling
+			/// thread. Returns once every job has completed. Jobs must not throw.
+			template <typename Job> void Parallel(const size_t count, Job job)
+			{
+				if (count < 2)
+				{
+					if (count) job(0);
+					return;
+				}
+
+				Batch batch(job, count);
+
+				{
+					std::lock_guard lock(this->cs);
+
+					const size_t helpers = std::min(count - 1, this->threads.size());
+
+					for (size_t i=0; i<helpers; i++)
+					{
+						this->queue.push_back(&batch);
+					}
+				}
+
+				this->condition.notify_all();
+
+				batch.Work();
+
+				std::unique_lock lock(this->cs);
+
+				// Every job has been claimed so withdraw any requests for help that have not
+				// been picked up and wait for the workers that did respond to finish.
+				this->queue.erase(std::remove(this->queue.begin(), this->queue.end(), &batch), this->queue.end());
+				batch.finished.wait(lock, [&] { return batch.running == 0; });
+			}
+
+
+		private:
+
+			// A set of jobs that are claimed by the caller and workers in turn
+			struct Batch
+			{
+				std::function<void(size_t)> job;
+				const size_t count;
+				std::atomic<size_t> next	= 0;
+				size_t running				= 0;	// Workers currently helping (guarded by cs)
+				std::condition_variable finished;
+
+				Batch(std::function<void(size_t)> job, const size_t count) : job(std::move(job)), count(count) {}
+
+				void Work()
+				{
+					for (size_t i = this->next++; i < this->count; i = this->next++)
+					{
+						this->job(i);
+					}
+				}
+			};
+
+
+			void Entry()
+			{
+				std::unique_lock lock(this->cs);
+
+				while (true)
+				{
+					this->condition.wait(lock, [&] { return !this->run || this->queue.size(); });
+
+					if (!this->run)
+					{
+						return;
+					}
+
+					auto batch = this->queue.front();
+					this->queue.pop_front();
+					batch->running++;
+
+					lock.unlock();
+					batch->Work();
+					lock.lock();
+
+					if (--batch->running == 0)
+					{
+						batch->finished.notify_all();
+					}
+				}
+			}
+
+
+			void Stop()
+			{
+				std::vector<std::thread> stopping;
+
+				{
+					std::lock_guard lock(this->cs);
+					this->run = false;
+					stopping.swap(this->threads);
+				}
+
+				this->condition.notify_all();
+
+				for (auto &t : stopping)
+				{
+					t.join();
+				}
+			}
+
+
+			std::mutex cs;
+			std::mutex resizing;
+			std::condition_variable condition;
+			std::vector<std::thread> threads;
+			std::deque<Batch *> queue;
+			bool run = false;
+	};
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <psinc/handlers/helpers/Simd.hpp>
+
+
+namespace psinc
+{
+	using emg::byte;
+
+
+	// Conversion of rows of 8-bit RGB pixels to YUV (BT.601, limited range). The coefficients have
+	// 7 bits of precision so that the vectorised kernels can work within 16-bit lanes. The chroma is
+	// calculated from the rounded average of each pair of pixels (4:2:2) or each 2x2 block (4:2:0)
+	// and so the width must be even.
+	class Yuv
+	{
+		public:
+
+			// Convert a row to packed YUYV, where each pair of pixels shares the chroma
+			static void Packed(const byte *src, byte *dst, const int width)
+			{
+				const auto simd	= Kernel<Row>([](auto k) { return &decltype(k)::Packed; });
+				const int done	= simd ? simd(src, dst, width) : 0;
+
+				src += done * 3;
+				dst += done * 2;
+
+				for (int x=done; x<width; x+=2, src+=6, dst+=4)
+				{
+					const int r = (src[0] + src[3] + 1) >> 1;
+					const int g = (src[1] + src[4] + 1) >> 1;
+					const int b = (src[2] + src[5] + 1) >> 1;
+
+					dst[0] = Y(src[0], src[1], src[2]);
+					dst[1] = U(r, g, b);
+					dst[2] = Y(src[3], src[4], src[5]);
+					dst[3] = V(r, g, b);
+				}
+			}
+
+
+			// Convert a row to luma only
+			static void Luma(const byte *src, byte *dst, const int width)
+			{
+				const auto simd	= Kernel<Row>([](auto k) { return &decltype(k)::Luma; });
+				const int done	= simd ? simd(src, dst, width) : 0;
+
+				src += done * 3;
+
+				for (int x=done; x<width; x++, src+=3)
+				{
+					dst[x] = Y(src[0], src[1], src[2]);
+				}
+			}
+
+
+			// Convert a pair of rows (which may be the same row) to a row of interleaved UV values,
+			// where each 2x2 block of pixels shares the chroma (as in the second plane of NV12)
+			static void Chroma(const byte *top, const byte *bottom, byte *dst, const int width)
+			{
+				const auto simd	= Kernel<Rows>([](auto k) { return &decltype(k)::Chroma; });
+				const int done	= simd ? simd(top, bottom, dst, width) : 0;
+
+				top		+= done * 3;
+				bottom	+= done * 3;
+				dst		+= done;
+
+				for (int x=done; x<width; x+=2, top+=6, bottom+=6, dst+=2)
+				{
+					const int r = (top[0] + top[3] + bottom[0] + bottom[3] + 2) >> 2;
+					const int g = (top[1] + top[4] + bottom[1] + bottom[4] + 2) >> 2;
+					const int b = (top[2] + top[5] + bottom[2] + bottom[5] + 2) >> 2;
+
+					dst[0] = U(r, g, b);
+					dst[1] = V(r, g, b);
+				}
+			}
+
+
+		private:
+
+			using Row	= int (*)(const byte *, byte *, int);
+			using Rows	= int (*)(const byte *, const byte *, byte *, int);
+
+
+			// The vectorised conversion for the instruction set supported by this CPU (nullptr if unsupported)
+			template <typename Function, typename Selector> static inline Function Kernel(Selector selector)
+			{
+				return simd::Dispatch<Function>(selector);
+			}
+
+
+			// The offsets of 16 and 128 are folded into the rounding constants
+			static inline byte Y(const int r, const int g, const int b)
+			{
+				return (33 * r + 64 * g + 13 * b + 2112) >> 7;
+			}
+
+			static inline byte U(const int r, const int g, const int b)
+			{
+				return (56 * b - 19 * r - 37 * g + 16448) >> 7;
+			}
+
+			static inline byte V(const int r, const int g, const int b)
+			{
+				return (56 * r - 47 * g - 9 * b + 16448) >> 7;
+			}
+	};
+}
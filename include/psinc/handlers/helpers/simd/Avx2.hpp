@@ -0,0 +1,112 @@
+// AVX2 vector abstractions of signed 16-bit and 32-bit lanes. This is included
+// within the psinc::simd::avx2 namespace by Simd.hpp and so has no include guard.
+
+struct V16
+{
+	using I = __m256i;
+	using M = __m256i;
+
+	static constexpr int W = 16;
+
+	static inline I Load(const byte *src)		{ return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))); }
+
+	// Load the even or odd bytes of the next 2W bytes
+	static inline I Even(const byte *src)		{ return _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), _mm256_set1_epi16(0xff)); }
+	static inline I Odd(const byte *src)		{ return _mm256_srli_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), 8); }
+
+	static inline I Set(int a)					{ return _mm256_set1_epi16(a); }
+
+	// Store with saturation to the range of the destination type
+	static inline void Store(byte *dst, I a)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(a, a), 0x08)));
+	}
+
+	static inline void Store(uint16_t *dst, I a)	{ _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_max_epi16(a, _mm256_setzero_si256())); }
+
+	static inline I Add(I a, I b)				{ return _mm256_add_epi16(a, b); }
+	static inline I Sub(I a, I b)				{ return _mm256_sub_epi16(a, b); }
+	static inline I Mul(I a, int b)				{ return _mm256_mullo_epi16(a, _mm256_set1_epi16(b)); }
+	static inline I Sra(I a, int b)				{ return _mm256_sra_epi16(a, _mm_cvtsi32_si128(b)); }
+
+	// Truncating division by 48 (as per integer division)
+	static inline I Div48(I a)
+	{
+		return _mm256_sub_epi16(_mm256_srai_epi16(_mm256_mulhi_epi16(a, _mm256_set1_epi16(10923)), 3), _mm256_srai_epi16(a, 15));
+	}
+
+	// Lanes alternate between a and b starting with a if first is set
+	static inline M Alternate(bool first)		{ return first ? _mm256_set1_epi32(0x0000ffff) : _mm256_set1_epi32(static_cast<int>(0xffff0000)); }
+	static inline I Select(M mask, I a, I b)	{ return _mm256_blendv_epi8(b, a, mask); }
+};
+
+
+struct V32
+{
+	using I = __m256i;
+	using M = __m256i;
+
+	static constexpr int W = 8;
+
+	static inline I Load(const uint16_t *src)	{ return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))); }
+
+	// Store with saturation to the range of the destination type
+	static inline void Store(uint16_t *dst, I a)
+	{
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(a, a), 0x08)));
+	}
+
+	static inline void Store(byte *dst, I a)
+	{
+		const __m128i words = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(a, a), 0x08));
+		_mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(words, words));
+	}
+
+	static inline I Add(I a, I b)				{ return _mm256_add_epi32(a, b); }
+	static inline I Sub(I a, I b)				{ return _mm256_sub_epi32(a, b); }
+	static inline I Mul(I a, int b)				{ return _mm256_mullo_epi32(a, _mm256_set1_epi32(b)); }
+	static inline I Sra(I a, int b)				{ return _mm256_sra_epi32(a, _mm_cvtsi32_si128(b)); }
+
+	// Truncating division by 48 (as per integer division). This is exact provided
+	// that the magnitude of the quotient is less than 2^17.
+	static inline I Div48(I a)					{ return _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a), _mm256_set1_ps(48.0f))); }
+
+	// Lanes alternate between a and b starting with a if first is set
+	static inline M Alternate(bool first)
+	{
+		return first ? _mm256_set1_epi64x(0x00000000ffffffff) : _mm256_set1_epi64x(static_cast<int64_t>(0xffffffff00000000));
+	}
+
+	static inline I Select(M mask, I a, I b)	{ return _mm256_blendv_epi8(b, a, mask); }
+};
+
+
+// The 128-bit interleaving is sufficient for a block of pixels
+using Rgb			= sse41::Rgb;
+using Rgba			= sse41::Rgba;
+using Subsampled	= sse41::Subsampled;
+
+
+// Conversion of 16 monochrome pixels, where the 128-bit expansion is sufficient
+struct Mono : sse41::Mono
+{
+	// Narrow with a logical shift and saturation (as per Monochrome::Decode)
+	static inline void Convert(const uint16_t *src, byte *dst, const int shift)
+	{
+		const __m256i a = _mm256_min_epu16(
+			_mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)), _mm_cvtsi32_si128(shift)), _mm256_set1_epi16(255)
+		);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(a, a), 0x08)));
+	}
+
+	static inline void Convert(const byte *src, uint16_t *dst, const int)
+	{
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))));
+	}
+
+	template <typename T> static inline void Convert(const T *src, T *dst, const int)
+	{
+		std::memcpy(dst, src, 16 * sizeof(T));
+	}
+};
@@ -0,0 +1,313 @@
+// Vectorised kernels written against the vector abstractions (V16 and V32) of the enclosing
+// namespace. This is included once per instruction set by Simd.hpp and so has no include
+// guard. All kernels must produce results identical to the scalar implementations.
+
+struct Kernels
+{
+	// Number of pixels handled per iteration
+	static constexpr int BLOCK = 16;
+
+
+	// The intermediate values for 8-bit sources fit within 16-bit lanes, allowing
+	// twice as many pixels per instruction, otherwise 32-bit lanes are required.
+	template <typename T> using Lanes = std::conditional_t<sizeof(T) == 1, V16, V32>;
+
+
+	// Apply the shift required when narrowing (as per Bayer::Clamp), the clamping
+	// itself is handled by the saturating store.
+	template <typename T, typename U, typename L> static inline typename L::I Narrow(typename L::I value, const int shift)
+	{
+		if constexpr (sizeof(T) > sizeof(U))
+		{
+			return L::Sra(value, shift);
+		}
+
+		return value;
+	}
+
+
+	// The neighbourhood of a bayer pixel required by the stencils
+	template <typename L> struct Neighbourhood
+	{
+		typename L::I c, n1, s1, w1, e1, n2, s2, w2, e2, diagonal;
+
+		template <typename T> Neighbourhood(const T *src, const int w)
+		{
+			const int row2	= 2 * w;
+			c				= L::Load(src);
+			n1				= L::Load(src - w);
+			s1				= L::Load(src + w);
+			w1				= L::Load(src - 1);
+			e1				= L::Load(src + 1);
+			n2				= L::Load(src - row2);
+			s2				= L::Load(src + row2);
+			w2				= L::Load(src - 2);
+			e2				= L::Load(src + 2);
+			diagonal		= L::Add(
+				L::Add(L::Load(src - w - 1), L::Load(src - w + 1)),
+				L::Add(L::Load(src + w - 1), L::Load(src + w + 1))
+			);
+		}
+	};
+
+
+	// Decode a single row of colour data (see Bayer::Colour). Red indicates that the row contains
+	// red rather than blue pixels (or blue rather than red when the channel order is swapped) and
+	// phase indicates that the row starts on a non-green pixel. Alpha appends an opaque fourth
+	// channel to each pixel. Returns the number of pixels processed, leaving any remainder to the
+	// scalar implementation.
+	template <typename T, typename U> static int Colour(const T *src, U *dst, const int dw, const int sw, const int shift, const bool red, const bool phase, const bool alpha)
+	{
+		using L = Lanes<T>;
+
+		alignas(32) U channels[3][BLOCK];
+
+		const int count		= dw - dw % BLOCK;
+		const int depth		= alpha ? 4 : 3;
+		const auto site		= L::Alternate(phase);
+		U *a				= channels[red ? 0 : 2];
+		U *g				= channels[1];
+		U *b				= channels[red ? 2 : 0];
+
+		for (int x=0; x<count; x+=BLOCK, src+=BLOCK, dst+=depth*BLOCK)
+		{
+			for (int i=0; i<BLOCK; i+=L::W)
+			{
+				const Neighbourhood<L> p(src + i, sw);
+
+				const auto vertical		= L::Add(p.n2, p.s2);
+				const auto horizontal	= L::Add(p.w2, p.e2);
+				const auto far			= L::Add(vertical, horizontal);
+
+				const auto cross = L::Sra(L::Sub(
+					L::Add(L::Mul(p.c, 4), L::Mul(L::Add(L::Add(p.n1, p.s1), L::Add(p.w1, p.e1)), 2)), far
+				), 3);
+
+				const auto checker = L::Sra(L::Sub(
+					L::Add(L::Mul(p.c, 12), L::Mul(p.diagonal, 4)), L::Mul(far, 3)
+				), 4);
+
+				const auto theta = L::Sra(L::Add(
+					L::Sub(L::Add(L::Mul(p.c, 10), L::Mul(L::Add(p.w1, p.e1), 8)), L::Mul(L::Add(p.diagonal, horizontal), 2)), vertical
+				), 4);
+
+				const auto phi = L::Sra(L::Add(
+					L::Sub(L::Add(L::Mul(p.c, 10), L::Mul(L::Add(p.n1, p.s1), 8)), L::Mul(L::Add(p.diagonal, vertical), 2)), horizontal
+				), 4);
+
+				// At a red/blue site the pixel value is retained, green uses the cross and the opposing colour
+				// uses the checker. At a green site the colour in this row uses theta and the other uses phi.
+				L::Store(a + i, Narrow<T, U, L>(L::Select(site, p.c, theta), shift));
+				L::Store(g + i, Narrow<T, U, L>(L::Select(site, cross, p.c), shift));
+				L::Store(b + i, Narrow<T, U, L>(L::Select(site, checker, phi), shift));
+			}
+
+			if (alpha)
+			{
+				Rgba::Store(dst, channels[0], channels[1], channels[2]);
+			}
+			else
+			{
+				Rgb::Store(dst, channels[0], channels[1], channels[2]);
+			}
+		}
+
+		return count;
+	}
+
+
+	// Decode a single row of greyscale data (see Bayer::Grey). Phase indicates that the row
+	// starts on a non-green pixel. Returns the number of pixels processed.
+	template <typename T, typename U> static int Grey(const T *src, U *dst, const int dw, const int sw, const int shift, const bool phase)
+	{
+		using L = Lanes<T>;
+
+		const int count	= dw - dw % BLOCK;
+		const auto site	= L::Alternate(phase);
+
+		for (int x=0; x<count; x+=BLOCK, src+=BLOCK, dst+=BLOCK)
+		{
+			for (int i=0; i<BLOCK; i+=L::W)
+			{
+				const Neighbourhood<L> p(src + i, sw);
+
+				const auto far		= L::Add(L::Add(p.n2, p.s2), L::Add(p.w2, p.e2));
+				const auto near		= L::Add(L::Add(p.n1, p.s1), L::Add(p.w1, p.e1));
+				const auto centre	= L::Mul(p.c, 36);
+
+				const auto green = L::Div48(L::Sub(
+					L::Sub(L::Add(centre, L::Mul(near, 8)), L::Mul(p.diagonal, 4)), far
+				));
+
+				const auto other = L::Div48(L::Sub(
+					L::Add(centre, L::Mul(L::Add(p.diagonal, near), 4)), L::Mul(far, 5)
+				));
+
+				L::Store(dst + i, Narrow<T, U, L>(L::Select(site, other, green), shift));
+			}
+		}
+
+		return count;
+	}
+
+
+	// Convert a run of monochrome pixels (see Monochrome::Decode), narrowing or widening to the
+	// destination type and replicating each pixel into three channels (plus an opaque alpha for
+	// a depth of 4) if expanding. Returns the number of pixels processed.
+	template <typename T, typename U> static int Monochrome(const T *src, U *dst, const int size, const int depth, const int shift)
+	{
+		alignas(32) U block[BLOCK];
+
+		const int count = size - size % BLOCK;
+
+		for (int x=0; x<count; x+=BLOCK, src+=BLOCK, dst+=depth*BLOCK)
+		{
+			if (depth == 1)
+			{
+				Mono::Convert(src, dst, shift);
+				continue;
+			}
+
+			const U *values = block;
+
+			if constexpr (std::is_same_v<T, U>)
+			{
+				values = src;
+			}
+			else
+			{
+				Mono::Convert(src, block, shift);
+			}
+
+			if (depth == 3)
+			{
+				Mono::Expand(values, dst);
+			}
+			else
+			{
+				Rgba::Store(dst, values, values, values);
+			}
+		}
+
+		return count;
+	}
+
+
+	// The fixed-point conversion of 8-bit RGB to BT.601 YUV (see Yuv), where the intermediate
+	// values fit within 16-bit lanes
+	static inline V16::I ToY(V16::I r, V16::I g, V16::I b)
+	{
+		return V16::Sra(V16::Add(V16::Add(V16::Mul(r, 33), V16::Mul(g, 64)), V16::Add(V16::Mul(b, 13), V16::Set(2112))), 7);
+	}
+
+	static inline V16::I ToU(V16::I r, V16::I g, V16::I b)
+	{
+		return V16::Sra(V16::Add(V16::Sub(V16::Mul(b, 56), V16::Add(V16::Mul(r, 19), V16::Mul(g, 37))), V16::Set(16448)), 7);
+	}
+
+	static inline V16::I ToV(V16::I r, V16::I g, V16::I b)
+	{
+		return V16::Sra(V16::Add(V16::Sub(V16::Mul(r, 56), V16::Add(V16::Mul(g, 47), V16::Mul(b, 9))), V16::Set(16448)), 7);
+	}
+
+
+	// Convert a row of RGB pixels to luma (see Yuv::Luma). Returns the number of pixels processed.
+	static int Luma(const byte *src, byte *dst, const int width)
+	{
+		alignas(32) byte channels[3][BLOCK];
+
+		const int count = width - width % BLOCK;
+
+		for (int x=0; x<count; x+=BLOCK, src+=3*BLOCK, dst+=BLOCK)
+		{
+			Rgb::Load(src, channels[0], channels[1], channels[2]);
+
+			for (int i=0; i<BLOCK; i+=V16::W)
+			{
+				V16::Store(dst + i, ToY(V16::Load(channels[0] + i), V16::Load(channels[1] + i), V16::Load(channels[2] + i)));
+			}
+		}
+
+		return count;
+	}
+
+
+	// Convert a row of RGB pixels to packed YUYV (see Yuv::Packed). Returns the number of pixels processed.
+	static int Packed(const byte *src, byte *dst, const int width)
+	{
+		alignas(32) byte channels[3][2 * BLOCK];
+		alignas(32) byte y[2 * BLOCK], u[BLOCK], v[BLOCK];
+
+		const int count = width - width % (2 * BLOCK);
+
+		for (int x=0; x<count; x+=2*BLOCK, src+=6*BLOCK, dst+=4*BLOCK)
+		{
+			Rgb::Load(src,				channels[0],			channels[1],			channels[2]);
+			Rgb::Load(src + 3 * BLOCK,	channels[0] + BLOCK,	channels[1] + BLOCK,	channels[2] + BLOCK);
+
+			for (int i=0; i<2*BLOCK; i+=V16::W)
+			{
+				V16::Store(y + i, ToY(V16::Load(channels[0] + i), V16::Load(channels[1] + i), V16::Load(channels[2] + i)));
+			}
+
+			// The rounded average of each pair of pixels
+			for (int i=0; i<2*BLOCK; i+=2*V16::W)
+			{
+				V16::I c[3];
+
+				for (int k=0; k<3; k++)
+				{
+					c[k] = V16::Sra(V16::Add(V16::Add(V16::Even(channels[k] + i), V16::Odd(channels[k] + i)), V16::Set(1)), 1);
+				}
+
+				V16::Store(u + i / 2, ToU(c[0], c[1], c[2]));
+				V16::Store(v + i / 2, ToV(c[0], c[1], c[2]));
+			}
+
+			Subsampled::Packed(dst,				y,			u,				v);
+			Subsampled::Packed(dst + 2 * BLOCK,	y + BLOCK,	u + BLOCK / 2,	v + BLOCK / 2);
+		}
+
+		return count;
+	}
+
+
+	// Convert a pair of rows of RGB pixels to interleaved chroma (see Yuv::Chroma). Returns the number
+	// of pixels processed in each row.
+	static int Chroma(const byte *top, const byte *bottom, byte *dst, const int width)
+	{
+		alignas(32) byte a[3][2 * BLOCK], b[3][2 * BLOCK];
+		alignas(32) byte u[BLOCK], v[BLOCK];
+
+		const int count = width - width % (2 * BLOCK);
+
+		for (int x=0; x<count; x+=2*BLOCK, top+=6*BLOCK, bottom+=6*BLOCK, dst+=2*BLOCK)
+		{
+			for (int k=0; k<2; k++)
+			{
+				Rgb::Load(top + 3 * BLOCK * k,		a[0] + BLOCK * k, a[1] + BLOCK * k, a[2] + BLOCK * k);
+				Rgb::Load(bottom + 3 * BLOCK * k,	b[0] + BLOCK * k, b[1] + BLOCK * k, b[2] + BLOCK * k);
+			}
+
+			// The rounded average of each 2x2 block of pixels
+			for (int i=0; i<2*BLOCK; i+=2*V16::W)
+			{
+				V16::I c[3];
+
+				for (int k=0; k<3; k++)
+				{
+					c[k] = V16::Sra(V16::Add(
+						V16::Add(V16::Add(V16::Even(a[k] + i), V16::Odd(a[k] + i)), V16::Add(V16::Even(b[k] + i), V16::Odd(b[k] + i))), V16::Set(2)
+					), 2);
+				}
+
+				V16::Store(u + i / 2, ToU(c[0], c[1], c[2]));
+				V16::Store(v + i / 2, ToV(c[0], c[1], c[2]));
+			}
+
+			Subsampled::Interleave(dst, u, v);
+		}
+
+		return count;
+	}
+};
@@ -0,0 +1,177 @@
+// NEON (AArch64) vector abstractions of signed 16-bit and 32-bit lanes. This is included
+// within the psinc::simd::neon namespace by Simd.hpp and so has no include guard.
+
+struct V16
+{
+	using I = int16x8_t;
+	using M = uint16x8_t;
+
+	static constexpr int W = 8;
+
+	static inline I Load(const byte *src)		{ return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(src))); }
+
+	// Load the even or odd bytes of the next 2W bytes
+	static inline I Even(const byte *src)		{ return vreinterpretq_s16_u16(vandq_u16(vreinterpretq_u16_u8(vld1q_u8(src)), vdupq_n_u16(0xff))); }
+	static inline I Odd(const byte *src)		{ return vreinterpretq_s16_u16(vshrq_n_u16(vreinterpretq_u16_u8(vld1q_u8(src)), 8)); }
+
+	static inline I Set(int a)					{ return vdupq_n_s16(a); }
+
+	// Store with saturation to the range of the destination type
+	static inline void Store(byte *dst, I a)		{ vst1_u8(dst, vqmovun_s16(a)); }
+	static inline void Store(uint16_t *dst, I a)	{ vst1q_u16(dst, vreinterpretq_u16_s16(vmaxq_s16(a, vdupq_n_s16(0)))); }
+
+	static inline I Add(I a, I b)				{ return vaddq_s16(a, b); }
+	static inline I Sub(I a, I b)				{ return vsubq_s16(a, b); }
+	static inline I Mul(I a, int b)				{ return vmulq_n_s16(a, b); }
+	static inline I Sra(I a, int b)				{ return vshlq_s16(a, vdupq_n_s16(-b)); }
+
+	// Truncating division by 48 (as per integer division)
+	static inline I Div48(I a)					{ return vsubq_s16(vshrq_n_s16(vqdmulhq_n_s16(a, 10923), 4), vshrq_n_s16(a, 15)); }
+
+	// Lanes alternate between a and b starting with a if first is set
+	static inline M Alternate(bool first)		{ return vreinterpretq_u16_u32(vdupq_n_u32(first ? 0x0000ffff : 0xffff0000)); }
+	static inline I Select(M mask, I a, I b)	{ return vbslq_s16(mask, a, b); }
+};
+
+
+struct V32
+{
+	using I = int32x4_t;
+	using M = uint32x4_t;
+
+	static constexpr int W = 4;
+
+	static inline I Load(const uint16_t *src)	{ return vreinterpretq_s32_u32(vmovl_u16(vld1_u16(src))); }
+
+	// Store with saturation to the range of the destination type
+	static inline void Store(uint16_t *dst, I a)	{ vst1_u16(dst, vqmovun_s32(a)); }
+	static inline void Store(byte *dst, I a)
+	{
+		const uint16x4_t words	= vqmovun_s32(a);
+		const uint32_t value	= vget_lane_u32(vreinterpret_u32_u8(vqmovn_u16(vcombine_u16(words, words))), 0);
+		std::memcpy(dst, &value, sizeof(value));
+	}
+
+	static inline I Add(I a, I b)				{ return vaddq_s32(a, b); }
+	static inline I Sub(I a, I b)				{ return vsubq_s32(a, b); }
+	static inline I Mul(I a, int b)				{ return vmulq_n_s32(a, b); }
+	static inline I Sra(I a, int b)				{ return vshlq_s32(a, vdupq_n_s32(-b)); }
+
+	// Truncating division by 48 (as per integer division). This is exact provided
+	// that the magnitude of the quotient is less than 2^17.
+	static inline I Div48(I a)					{ return vcvtq_s32_f32(vdivq_f32(vcvtq_f32_s32(a), vdupq_n_f32(48.0f))); }
+
+	// Lanes alternate between a and b starting with a if first is set
+	static inline M Alternate(bool first)		{ return vreinterpretq_u32_u64(vdupq_n_u64(first ? 0x00000000ffffffff : 0xffffffff00000000)); }
+	static inline I Select(M mask, I a, I b)	{ return vbslq_s32(mask, a, b); }
+};
+
+
+// Conversion of 16 monochrome pixels between types and expansion into three channels
+struct Mono
+{
+	// Narrow with a logical shift and saturation (as per Monochrome::Decode)
+	static inline void Convert(const uint16_t *src, byte *dst, const int shift)
+	{
+		const int16x8_t count = vdupq_n_s16(-shift);
+
+		vst1q_u8(dst, vcombine_u8(vqmovn_u16(vshlq_u16(vld1q_u16(src), count)), vqmovn_u16(vshlq_u16(vld1q_u16(src + 8), count))));
+	}
+
+	static inline void Convert(const byte *src, uint16_t *dst, const int)
+	{
+		const uint8x16_t a = vld1q_u8(src);
+
+		vst1q_u16(dst,		vmovl_u8(vget_low_u8(a)));
+		vst1q_u16(dst + 8,	vmovl_u8(vget_high_u8(a)));
+	}
+
+	template <typename T> static inline void Convert(const T *src, T *dst, const int)
+	{
+		std::memcpy(dst, src, 16 * sizeof(T));
+	}
+
+
+	// Replicate 16 pixels into three channels
+	static inline void Expand(const byte *src, byte *dst)
+	{
+		const uint8x16_t a = vld1q_u8(src);
+		vst3q_u8(dst, uint8x16x3_t {{ a, a, a }});
+	}
+
+	static inline void Expand(const uint16_t *src, uint16_t *dst)
+	{
+		const uint16x8_t a = vld1q_u16(src);
+		const uint16x8_t b = vld1q_u16(src + 8);
+
+		vst3q_u16(dst,		uint16x8x3_t {{ a, a, a }});
+		vst3q_u16(dst + 24,	uint16x8x3_t {{ b, b, b }});
+	}
+};
+
+
+// Interleaving of three planar channels into packed pixels
+struct Rgb
+{
+	// Interleave 16 pixels
+	static inline void Store(byte *dst, const byte *a, const byte *b, const byte *c)
+	{
+		vst3q_u8(dst, uint8x16x3_t {{ vld1q_u8(a), vld1q_u8(b), vld1q_u8(c) }});
+	}
+
+	static inline void Store(uint16_t *dst, const uint16_t *a, const uint16_t *b, const uint16_t *c)
+	{
+		vst3q_u16(dst,		uint16x8x3_t {{ vld1q_u16(a), vld1q_u16(b), vld1q_u16(c) }});
+		vst3q_u16(dst + 24,	uint16x8x3_t {{ vld1q_u16(a + 8), vld1q_u16(b + 8), vld1q_u16(c + 8) }});
+	}
+
+
+	// Separate 16 pixels into planar channels
+	static inline void Load(const byte *src, byte *a, byte *b, byte *c)
+	{
+		const uint8x16x3_t channels = vld3q_u8(src);
+
+		vst1q_u8(a, channels.val[0]);
+		vst1q_u8(b, channels.val[1]);
+		vst1q_u8(c, channels.val[2]);
+	}
+};
+
+
+// Interleaving of three planar channels into packed pixels with an opaque fourth channel
+struct Rgba
+{
+	// Interleave 16 pixels
+	static inline void Store(byte *dst, const byte *a, const byte *b, const byte *c)
+	{
+		vst4q_u8(dst, uint8x16x4_t {{ vld1q_u8(a), vld1q_u8(b), vld1q_u8(c), vdupq_n_u8(0xff) }});
+	}
+
+	static inline void Store(uint16_t *dst, const uint16_t *a, const uint16_t *b, const uint16_t *c)
+	{
+		const uint16x8_t alpha = vdupq_n_u16(0xffff);
+
+		vst4q_u16(dst,		uint16x8x4_t {{ vld1q_u16(a), vld1q_u16(b), vld1q_u16(c), alpha }});
+		vst4q_u16(dst + 32,	uint16x8x4_t {{ vld1q_u16(a + 8), vld1q_u16(b + 8), vld1q_u16(c + 8), alpha }});
+	}
+};
+
+
+// Interleaving of subsampled chroma with luma (YUYV) or with the other chroma channel (NV12)
+struct Subsampled
+{
+	// Interleave 16 luma values with the 8 pairs of chroma values that they share
+	static inline void Packed(byte *dst, const byte *y, const byte *u, const byte *v)
+	{
+		const uint8x8x2_t luma = vuzp_u8(vld1_u8(y), vld1_u8(y + 8));
+
+		vst4_u8(dst, uint8x8x4_t {{ luma.val[0], vld1_u8(u), luma.val[1], vld1_u8(v) }});
+	}
+
+
+	// Interleave 16 pairs of chroma values
+	static inline void Interleave(byte *dst, const byte *u, const byte *v)
+	{
+		vst2q_u8(dst, uint8x16x2_t {{ vld1q_u8(u), vld1q_u8(v) }});
+	}
+};
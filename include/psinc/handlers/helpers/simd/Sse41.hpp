@@ -0,0 +1,327 @@
+// SSE4.1 vector abstractions of signed 16-bit and 32-bit lanes. This is included
+// within the psinc::simd::sse41 namespace by Simd.hpp and so has no include guard.
+
+struct V16
+{
+	using I = __m128i;
+	using M = __m128i;
+
+	static constexpr int W = 8;
+
+	static inline I Load(const byte *src)		{ return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src))); }
+
+	// Load the even or odd bytes of the next 2W bytes
+	static inline I Even(const byte *src)		{ return _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), _mm_set1_epi16(0xff)); }
+	static inline I Odd(const byte *src)		{ return _mm_srli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), 8); }
+
+	static inline I Set(int a)					{ return _mm_set1_epi16(a); }
+
+	// Store with saturation to the range of the destination type
+	static inline void Store(byte *dst, I a)		{ _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(a, a)); }
+	static inline void Store(uint16_t *dst, I a)	{ _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_max_epi16(a, _mm_setzero_si128())); }
+
+	static inline I Add(I a, I b)				{ return _mm_add_epi16(a, b); }
+	static inline I Sub(I a, I b)				{ return _mm_sub_epi16(a, b); }
+	static inline I Mul(I a, int b)				{ return _mm_mullo_epi16(a, _mm_set1_epi16(b)); }
+	static inline I Sra(I a, int b)				{ return _mm_sra_epi16(a, _mm_cvtsi32_si128(b)); }
+
+	// Truncating division by 48 (as per integer division)
+	static inline I Div48(I a)					{ return _mm_sub_epi16(_mm_srai_epi16(_mm_mulhi_epi16(a, _mm_set1_epi16(10923)), 3), _mm_srai_epi16(a, 15)); }
+
+	// Lanes alternate between a and b starting with a if first is set
+	static inline M Alternate(bool first)		{ return first ? _mm_set1_epi32(0x0000ffff) : _mm_set1_epi32(static_cast<int>(0xffff0000)); }
+	static inline I Select(M mask, I a, I b)	{ return _mm_blendv_epi8(b, a, mask); }
+};
+
+
+struct V32
+{
+	using I = __m128i;
+	using M = __m128i;
+
+	static constexpr int W = 4;
+
+	static inline I Load(const uint16_t *src)	{ return _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src))); }
+
+	// Store with saturation to the range of the destination type
+	static inline void Store(uint16_t *dst, I a)	{ _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi32(a, a)); }
+	static inline void Store(byte *dst, I a)
+	{
+		const int32_t value = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(a, a), a));
+		std::memcpy(dst, &value, sizeof(value));
+	}
+
+	static inline I Add(I a, I b)				{ return _mm_add_epi32(a, b); }
+	static inline I Sub(I a, I b)				{ return _mm_sub_epi32(a, b); }
+	static inline I Mul(I a, int b)				{ return _mm_mullo_epi32(a, _mm_set1_epi32(b)); }
+	static inline I Sra(I a, int b)				{ return _mm_sra_epi32(a, _mm_cvtsi32_si128(b)); }
+
+	// Truncating division by 48 (as per integer division). This is exact provided
+	// that the magnitude of the quotient is less than 2^17.
+	static inline I Div48(I a)					{ return _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a), _mm_set1_ps(48.0f))); }
+
+	// Lanes alternate between a and b starting with a if first is set
+	static inline M Alternate(bool first)		{ return first ? _mm_set1_epi64x(0x00000000ffffffff) : _mm_set1_epi64x(static_cast<int64_t>(0xffffffff00000000)); }
+	static inline I Select(M mask, I a, I b)	{ return _mm_blendv_epi8(b, a, mask); }
+};
+
+
+// Conversion of 16 monochrome pixels between types and expansion into three channels
+struct Mono
+{
+	// Narrow with a logical shift and saturation (as per Monochrome::Decode)
+	static inline void Convert(const uint16_t *src, byte *dst, const int shift)
+	{
+		const __m128i count	= _mm_cvtsi32_si128(shift);
+		const __m128i limit	= _mm_set1_epi16(255);
+		const __m128i a		= _mm_min_epu16(_mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)), count), limit);
+		const __m128i b		= _mm_min_epu16(_mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 8)), count), limit);
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(a, b));
+	}
+
+	static inline void Convert(const byte *src, uint16_t *dst, const int)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst),		_mm_cvtepu8_epi16(a));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 8),	_mm_unpackhi_epi8(a, _mm_setzero_si128()));
+	}
+
+	template <typename T> static inline void Convert(const T *src, T *dst, const int)
+	{
+		std::memcpy(dst, src, 16 * sizeof(T));
+	}
+
+
+	// Shuffle masks indexed by output vector that replicate each value three times
+	static constexpr int8_t BYTES[3][16] = {
+		{  0,  0,  0,  1,  1,  1,  2,  2,  2,  3,  3,  3,  4,  4,  4,  5 },
+		{  5,  5,  6,  6,  6,  7,  7,  7,  8,  8,  8,  9,  9,  9, 10, 10 },
+		{ 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15 }
+	};
+
+	static constexpr int8_t WORDS[3][16] = {
+		{  0,  1,  0,  1,  0,  1,  2,  3,  2,  3,  2,  3,  4,  5,  4,  5 },
+		{  4,  5,  6,  7,  6,  7,  6,  7,  8,  9,  8,  9,  8,  9, 10, 11 },
+		{ 10, 11, 10, 11, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15 }
+	};
+
+
+	static inline void Replicate(const int8_t (&masks)[3][16], const void *src, void *dst)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+
+		for (int k=0; k<3; k++)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + k, _mm_shuffle_epi8(a, _mm_loadu_si128(reinterpret_cast<const __m128i *>(masks[k]))));
+		}
+	}
+
+
+	// Replicate 16 pixels into three channels
+	static inline void Expand(const byte *src, byte *dst)
+	{
+		Replicate(BYTES, src, dst);
+	}
+
+	static inline void Expand(const uint16_t *src, uint16_t *dst)
+	{
+		Replicate(WORDS, src, dst);
+		Replicate(WORDS, src + 8, dst + 24);
+	}
+};
+
+
+// Interleaving of three planar channels into packed pixels. Each output vector is
+// the combination of a byte shuffle of each channel, with -1 zeroing the byte.
+struct Rgb
+{
+	// Shuffle masks indexed by output vector and then channel for 8-bit values
+	static constexpr int8_t BYTES[3][3][16] = {
+		{
+			{  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1,  5 },
+			{ -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1, -1 },
+			{ -1, -1,  0, -1, -1,  1, -1, -1,  2, -1, -1,  3, -1, -1,  4, -1 }
+		},
+		{
+			{ -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10, -1 },
+			{  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1, 10 },
+			{ -1,  5, -1, -1,  6, -1, -1,  7, -1, -1,  8, -1, -1,  9, -1, -1 }
+		},
+		{
+			{ -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 },
+			{ -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 },
+			{ 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 }
+		}
+	};
+
+	// Shuffle masks indexed by output vector and then channel for 16-bit values
+	static constexpr int8_t WORDS[3][3][16] = {
+		{
+			{  0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1,  4,  5, -1, -1 },
+			{ -1, -1,  0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1,  4,  5 },
+			{ -1, -1, -1, -1,  0,  1, -1, -1, -1, -1,  2,  3, -1, -1, -1, -1 }
+		},
+		{
+			{ -1, -1,  6,  7, -1, -1, -1, -1,  8,  9, -1, -1, -1, -1, 10, 11 },
+			{ -1, -1, -1, -1,  6,  7, -1, -1, -1, -1,  8,  9, -1, -1, -1, -1 },
+			{  4,  5, -1, -1, -1, -1,  6,  7, -1, -1, -1, -1,  8,  9, -1, -1 }
+		},
+		{
+			{ -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1, -1, -1 },
+			{ 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15, -1, -1 },
+			{ -1, -1, 10, 11, -1, -1, -1, -1, 12, 13, -1, -1, -1, -1, 14, 15 }
+		}
+	};
+
+
+	template <typename U> static inline void Interleave(const int8_t (&masks)[3][3][16], const U *a, const U *b, const U *c, U *dst)
+	{
+		const __m128i channels[3] = {
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(a)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(b)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(c))
+		};
+
+		for (int k=0; k<3; k++)
+		{
+			__m128i result = _mm_setzero_si128();
+
+			for (int i=0; i<3; i++)
+			{
+				result = _mm_or_si128(result, _mm_shuffle_epi8(channels[i], _mm_loadu_si128(reinterpret_cast<const __m128i *>(masks[k][i]))));
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + k, result);
+		}
+	}
+
+
+	// Shuffle masks indexed by channel and then input vector that gather a channel of 8-bit values
+	static constexpr int8_t PLANES[3][3][16] = {
+		{
+			{  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+			{ -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+			{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 }
+		},
+		{
+			{  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+			{ -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+			{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 }
+		},
+		{
+			{  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+			{ -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+			{ -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 }
+		}
+	};
+
+
+	// Interleave 16 pixels
+	static inline void Store(byte *dst, const byte *a, const byte *b, const byte *c)
+	{
+		Interleave(BYTES, a, b, c, dst);
+	}
+
+
+	// Separate 16 pixels into planar channels
+	static inline void Load(const byte *src, byte *a, byte *b, byte *c)
+	{
+		const __m128i packed[3] = {
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(src) + 1),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(src) + 2)
+		};
+
+		byte *channels[3] = { a, b, c };
+
+		for (int i=0; i<3; i++)
+		{
+			__m128i result = _mm_setzero_si128();
+
+			for (int k=0; k<3; k++)
+			{
+				result = _mm_or_si128(result, _mm_shuffle_epi8(packed[k], _mm_loadu_si128(reinterpret_cast<const __m128i *>(PLANES[i][k]))));
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(channels[i]), result);
+		}
+	}
+
+	static inline void Store(uint16_t *dst, const uint16_t *a, const uint16_t *b, const uint16_t *c)
+	{
+		Interleave(WORDS, a, b, c, dst);
+		Interleave(WORDS, a + 8, b + 8, c + 8, dst + 24);
+	}
+};
+
+
+// Interleaving of three planar channels into packed pixels with an opaque fourth channel
+struct Rgba
+{
+	static inline __m128i Load(const void *src)
+	{
+		return _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+	}
+
+
+	// Interleave 16 pixels
+	static inline void Store(byte *dst, const byte *a, const byte *b, const byte *c)
+	{
+		const __m128i alpha	= _mm_set1_epi8(-1);
+		const __m128i ab[2]	= { _mm_unpacklo_epi8(Load(a), Load(b)), _mm_unpackhi_epi8(Load(a), Load(b)) };
+		const __m128i cd[2]	= { _mm_unpacklo_epi8(Load(c), alpha), _mm_unpackhi_epi8(Load(c), alpha) };
+		__m128i *out		= reinterpret_cast<__m128i *>(dst);
+
+		for (int k=0; k<2; k++)
+		{
+			_mm_storeu_si128(out++, _mm_unpacklo_epi16(ab[k], cd[k]));
+			_mm_storeu_si128(out++, _mm_unpackhi_epi16(ab[k], cd[k]));
+		}
+	}
+
+	static inline void Store(uint16_t *dst, const uint16_t *a, const uint16_t *b, const uint16_t *c)
+	{
+		const __m128i alpha	= _mm_set1_epi16(-1);
+		__m128i *out		= reinterpret_cast<__m128i *>(dst);
+
+		for (int i=0; i<16; i+=8)
+		{
+			const __m128i ab[2] = { _mm_unpacklo_epi16(Load(a + i), Load(b + i)), _mm_unpackhi_epi16(Load(a + i), Load(b + i)) };
+			const __m128i cd[2] = { _mm_unpacklo_epi16(Load(c + i), alpha), _mm_unpackhi_epi16(Load(c + i), alpha) };
+
+			for (int k=0; k<2; k++)
+			{
+				_mm_storeu_si128(out++, _mm_unpacklo_epi32(ab[k], cd[k]));
+				_mm_storeu_si128(out++, _mm_unpackhi_epi32(ab[k], cd[k]));
+			}
+		}
+	}
+};
+
+
+// Interleaving of subsampled chroma with luma (YUYV) or with the other chroma channel (NV12)
+struct Subsampled
+{
+	// Interleave 16 luma values with the 8 pairs of chroma values that they share
+	static inline void Packed(byte *dst, const byte *y, const byte *u, const byte *v)
+	{
+		const __m128i luma		= _mm_loadu_si128(reinterpret_cast<const __m128i *>(y));
+		const __m128i chroma	= _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(u)), _mm_loadl_epi64(reinterpret_cast<const __m128i *>(v)));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst),		_mm_unpacklo_epi8(luma, chroma));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + 1,	_mm_unpackhi_epi8(luma, chroma));
+	}
+
+
+	// Interleave 16 pairs of chroma values
+	static inline void Interleave(byte *dst, const byte *u, const byte *v)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(u));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst),		_mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + 1,	_mm_unpackhi_epi8(a, b));
+	}
+};
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+
+namespace psinc
+{
+	namespace chip
+	{
+		/// An inclusive range of values
+		struct Range
+		{
+			int start	= 0;
+			int end		= 0;
+		};
+
+
+		/// A feature as described by a <feature> element
+		struct FeatureDescription
+		{
+			/// Maximum number of invalid ranges that a single feature can describe
+			static constexpr size_t MAX_INVALID = 8;
+
+			std::string_view name;
+			int address			= 0;	// Address of the parent register
+			int offset			= 0;
+			int bits			= 0;
+			int minimum			= 0;
+			int maximum			= 1;
+			int defaultValue	= 0;
+			bool readonly		= false;
+
+			std::array<Range, MAX_INVALID> invalid = {};
+			size_t invalidCount = 0;
+		};
+
+
+		/// An alias as described by an <alias> element
+		struct AliasDescription
+		{
+			std::string_view name;
+			std::string_view feature;
+			int context = -1;	// The alias applies to all contexts if not assigned
+		};
+
+
+		/// A chip as described by the <camera> element. This is a view of a Table, which
+		/// must outlive it.
+		struct Description
+		{
+			std::string_view chip;
+			int contexts		= 1;
+			int addressSize		= 1;
+			int bayer			= 0;
+			bool hdr			= false;
+			bool sizeByRange	= false;
+
+			const int *registers						= nullptr;	// Register addresses in document order
+			size_t registerCount						= 0;
+			const FeatureDescription *features			= nullptr;	// Features in document order
+			size_t featureCount							= 0;
+			const AliasDescription *aliases				= nullptr;
+			size_t aliasCount							= 0;
+		};
+
+
+		/// Storage for a parsed chip description
+		template <size_t R, size_t F, size_t A> struct Table
+		{
+			Description header;
+
+			std::array<int, R> registers						= {};
+			std::array<FeatureDescription, F> features			= {};
+			std::array<AliasDescription, A> aliases				= {};
+
+
+			/// Retrieve the description referring to this table
+			constexpr Description View() const
+			{
+				auto result = this->header;
+
+				result.registers		= this->registers.data();
+				result.registerCount	= R;
+				result.features			= this->features.data();
+				result.featureCount		= F;
+				result.aliases			= this->aliases.data();
+				result.aliasCount		= A;
+
+				return result;
+			}
+		};
+
+
+		/// The number of each element type in a chip description
+		struct Counts
+		{
+			size_t registers	= 0;
+			size_t features		= 0;
+			size_t aliases		= 0;
+		};
+
+
+		/// A compile-time reader for the subset of XML used by the chip descriptions (elements,
+		/// quoted attributes, comments and declarations). Since the functions are evaluated as
+		/// constant expressions any malformed input is reported as a build error.
+		namespace reader
+		{
+			struct Attribute
+			{
+				std::string_view key;
+				std::string_view value;
+			};
+
+
+			struct Element
+			{
+				static constexpr size_t MAX_ATTRIBUTES = 16;
+
+				std::string_view name;
+				std::array<Attribute, MAX_ATTRIBUTES> attributes = {};
+				size_t count = 0;
+
+
+				constexpr std::string_view Get(std::string_view key) const
+				{
+					for (size_t i=0; i<this->count; i++)
+					{
+						if (this->attributes[i].key == key)
+						{
+							return this->attributes[i].value;
+						}
+					}
+
+					return {};
+				}
+			};
+
+
+			constexpr bool Space(char c)
+			{
+				return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+			}
+
+
+			/// Integer conversion that follows the behaviour of strtol with a base of 0 (for hex)
+			constexpr int Integer(std::string_view text, int fallback)
+			{
+				if (text.empty())
+				{
+					return fallback;
+				}
+
+				size_t i		= 0;
+				int base		= 10;
+				int result		= 0;
+				bool negative	= text[0] == '-';
+
+				if (negative || text[0] == '+')
+				{
+					i++;
+				}
+
+				if (text.size() > i + 1 && text[i] == '0' && (text[i + 1] == 'x' || text[i + 1] == 'X'))
+				{
+					base	= 16;
+					i		+= 2;
+				}
+
+				for (; i<text.size(); i++)
+				{
+					const char c	= text[i];
+					const int digit	= c >= '0' && c <= '9' ? c - '0'
+						: c >= 'a' && c <= 'f' ? c - 'a' + 10
+						: c >= 'A' && c <= 'F' ? c - 'A' + 10
+						: base;
+
+					if (digit >= base)
+					{
+						throw "invalid integer in chip description";
+					}
+
+					result = result * base + digit;
+				}
+
+				return negative ? -result : result;
+			}
+
+
+			/// Boolean conversion that follows the behaviour of pugixml
+			constexpr bool Boolean(std::string_view text)
+			{
+				return !text.empty() && (text[0] == '1' || text[0] == 't' || text[0] == 'T' || text[0] == 'y' || text[0] == 'Y');
+			}
+
+
+			/// Parse a list of invalid values and ranges such as "2,4-6,8"
+			constexpr void Invalid(std::string_view text, FeatureDescription &feature)
+			{
+				while (!text.empty())
+				{
+					const size_t comma	= text.find(',');
+					const auto item		= text.substr(0, comma);
+					const size_t dash	= item.find('-', 1);
+
+					if (!item.empty())
+					{
+						if (feature.invalidCount == FeatureDescription::MAX_INVALID)
+						{
+							throw "too many invalid ranges for a feature in chip description";
+						}
+
+						auto &range	= feature.invalid[feature.invalidCount++];
+						range.start	= Integer(item.substr(0, dash), 0);
+						range.end	= dash == std::string_view::npos ? range.start : Integer(item.substr(dash + 1), 0);
+					}
+
+					text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+				}
+			}
+
+
+			/// Find the next element from the given position (skipping comments, declarations and closing
+			/// tags). Returns false when the end of the document is reached.
+			constexpr bool Next(std::string_view xml, size_t &position, Element &element)
+			{
+				while ((position = xml.find('<', position)) != std::string_view::npos)
+				{
+					const auto rest = xml.substr(position);
+
+					if (rest.substr(0, 4) == "<!--")
+					{
+						position = xml.find("-->", position);
+
+						if (position == std::string_view::npos)
+						{
+							throw "unterminated comment in chip description";
+						}
+
+						continue;
+					}
+
+					if (rest.substr(0, 2) == "<?" || rest.substr(0, 2) == "</")
+					{
+						position = xml.find('>', position);
+						continue;
+					}
+
+					size_t i = position + 1;
+
+					while (i < xml.size() && !Space(xml[i]) && xml[i] != '/' && xml[i] != '>') i++;
+
+					element			= {};
+					element.name	= xml.substr(position + 1, i - position - 1);
+
+					while (true)
+					{
+						while (i < xml.size() && Space(xml[i])) i++;
+
+						if (i >= xml.size())
+						{
+							throw "unterminated element in chip description";
+						}
+
+						if (xml[i] == '/' || xml[i] == '>')
+						{
+							break;
+						}
+
+						const size_t equals = xml.find('=', i);
+						const size_t open	= equals + 1;
+						const size_t close	= xml.find('"', open + 1);
+
+						if (equals == std::string_view::npos || xml[open] != '"' || close == std::string_view::npos)
+						{
+							throw "malformed attribute in chip description";
+						}
+
+						if (element.count == Element::MAX_ATTRIBUTES)
+						{
+							throw "too many attributes for an element in chip description";
+						}
+
+						element.attributes[element.count++] = { xml.substr(i, equals - i), xml.substr(open + 1, close - open - 1) };
+
+						i = close + 1;
+					}
+
+					position = i;
+					return true;
+				}
+
+				return false;
+			}
+		}
+
+
+		/// Count the registers, features and aliases in a chip description so that
+		/// the storage for the table can be sized.
+		constexpr Counts Measure(std::string_view xml)
+		{
+			Counts result;
+			reader::Element element;
+			size_t position = 0;
+
+			while (reader::Next(xml, position, element))
+			{
+				if (element.name == "register")	result.registers++;
+				if (element.name == "feature")	result.features++;
+				if (element.name == "alias")	result.aliases++;
+			}
+
+			return result;
+		}
+
+
+		/// Parse a chip description into a table. This is intended to be evaluated at compile
+		/// time with the counts taken from Measure.
+		template <size_t R, size_t F, size_t A> constexpr Table<R, F, A> Parse(std::string_view xml)
+		{
+			Table<R, F, A> result;
+			reader::Element element;
+			size_t position	= 0;
+			size_t r		= 0;
+			size_t f		= 0;
+			size_t a		= 0;
+
+			while (reader::Next(xml, position, element))
+			{
+				if (element.name == "camera")
+				{
+					result.header.chip			= element.Get("chip");
+					result.header.contexts		= reader::Integer(element.Get("contexts"), 1);
+					result.header.addressSize	= reader::Integer(element.Get("addressSize"), 1);
+					result.header.bayer			= reader::Integer(element.Get("bayer"), 0);
+					result.header.hdr			= reader::Boolean(element.Get("hdr"));
+					result.header.sizeByRange	= reader::Boolean(element.Get("sizeByRange"));
+				}
+				else if (element.name == "register")
+				{
+					result.registers[r++] = reader::Integer(element.Get("address"), 0);
+				}
+				else if (element.name == "feature")
+				{
+					if (!r)
+					{
+						throw "feature outside of a register in chip description";
+					}
+
+					auto &feature			= result.features[f++];
+					feature.name			= element.Get("name");
+					feature.address			= result.registers[r - 1];
+					feature.offset			= reader::Integer(element.Get("offset"), 0);
+					feature.bits			= reader::Integer(element.Get("bits"), 0);
+					feature.minimum			= reader::Integer(element.Get("min"), 0);
+					feature.maximum			= reader::Integer(element.Get("max"), 1);
+					feature.defaultValue	= reader::Integer(element.Get("default"), 0);
+					feature.readonly		= reader::Boolean(element.Get("readonly"));
+
+					reader::Invalid(element.Get("invalid"), feature);
+				}
+				else if (element.name == "alias")
+				{
+					auto &alias		= result.aliases[a++];
+					alias.name		= element.Get("name");
+					alias.feature	= element.Get("feature");
+					alias.context	= reader::Integer(element.Get("context"), -1);
+				}
+			}
+
+			return result;
+		}
+	}
+}
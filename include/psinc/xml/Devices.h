@@ -1,14 +1,24 @@
 #pragma once
 
+#include <psinc/xml/Description.h>
+
 
 namespace psinc
 {
 	/// This namespace contains the declarations for device specific XML
 	/// compiled into the library as string constants. Please look in
-	/// the src/capture/xml folder for the actual inline XML.
+	/// the src/psinc/xml folder for the actual inline XML.
 	namespace chip
 	{
 		extern const char *v024;
 		extern const char *mt9;
+
+		/// The register, feature and alias tables for each chip, which are parsed
+		/// from the XML above at compile time.
+		namespace table
+		{
+			extern const Description v024;
+			extern const Description mt9;
+		}
 	}
 }
@@ -0,0 +1,999 @@
+// Decode benchmarks for the image handler helpers.
+//
+// Synthetic bayer and mono frames are generated at the real sensor sizes and
+// each decoder is timed across every combination of bayer mode, source depth,
+// destination type and image depth. The results can be written as CSV and then
+// used as a baseline for subsequent runs, in which case any case that has slowed
+// by more than the tolerance is reported and the exit code is non-zero. Optionally,
+// full capture throughput is measured using simulated cameras (individually and in a
+// group alongside any camera connected over USB) and the decode of real
+// sensor data is timed using frames replayed from a recording. The capture cases
+// also stream through the USB transport with a simulated libusb backend, injecting
+// faults part way through a frame, and the exit code is non-zero if any fault is
+// handled incorrectly.
+
+#include <psinc/Camera.h>
+#include <psinc/CameraGroup.h>
+#include <psinc/SimulatedTransport.h>
+#include <psinc/SimulatedUsb.h>
+#include <psinc/Recording.h>
+#include <psinc/handlers/ImageHandler.hpp>
+#include <psinc/handlers/YuvHandler.hpp>
+#include <psinc/handlers/helpers/Monochrome.hpp>
+#include <psinc/handlers/helpers/Demosaic.hpp>
+#include <psinc/handlers/helpers/Filter.hpp>
+#include <psinc/handlers/helpers/Bayer.hpp>
+#include <psinc/handlers/helpers/ToneCurve.hpp>
+#include <emergent/image/Image.hpp>
+#include <emergent/Clap.hpp>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <map>
+#include <mutex>
+#include <deque>
+#include <limits>
+
+using namespace psinc;
+using std::string;
+using std::vector;
+using std::cout;
+using std::cerr;
+using std::endl;
+
+
+struct Sensor
+{
+	string name;
+	int width;
+	int height;
+};
+
+
+const vector<Sensor> SENSORS = {
+	{ "v024",	752,	480 },	// Full frame of the v024 series
+	{ "mt9",	1280,	960 }	// Full frame of the mt9 series
+};
+
+
+struct Params
+{
+	int iterations		= 50;
+	int warmup			= 3;
+	bool csv			= false;
+	double bandwidth	= 0;	// Bandwidth of the simulated camera link in bytes per second (0 is unlimited)
+	string only;
+};
+
+
+struct Result
+{
+	string name;
+	double mpix	= 0;	// Throughput in megapixels per second (based upon the mean)
+	double p50	= 0;	// Frame latency percentiles in milliseconds
+	double p90	= 0;
+	double p99	= 0;
+	double max	= 0;
+};
+
+
+// A smooth gradient with a small amount of noise so that the gradient-based
+// decoders do not take any unrealistic shortcuts. The HDR frames hold 12-bit data.
+template <typename T> vector<T> generate(const Sensor &sensor)
+{
+	const int limit		= sizeof(T) == 1 ? 255 : 4095;
+	const int noise		= limit / 32;
+	uint32_t seed		= 0x2545f491;
+	vector<T> result(sensor.width * sensor.height);
+	T *pd				= result.data();
+
+	for (int y=0; y<sensor.height; y++)
+	{
+		for (int x=0; x<sensor.width; x++)
+		{
+			seed = seed * 1664525 + 1013904223;
+
+			const int value = (x + y) * (limit - noise) / (sensor.width + sensor.height) + (seed >> 16) % noise;
+			*pd++ = std::clamp(value, 0, limit);
+		}
+	}
+
+	return result;
+}
+
+
+double percentile(const vector<double> &sorted, const double p)
+{
+	return sorted[std::min<size_t>(sorted.size() - 1, std::lrint(p * (sorted.size() - 1)))];
+}
+
+
+// Summarise the frame times (in ms) of a case and report it
+void record(const Params &params, vector<Result> &results, const string &name, const size_t pixels, vector<double> &times)
+{
+	if (times.empty())
+	{
+		cerr << name << ": no frames were timed" << endl;
+		return;
+	}
+
+	std::sort(times.begin(), times.end());
+
+	Result result;
+	double total = 0;
+
+	for (auto t : times) total += t;
+
+	result.name	= name;
+	result.mpix	= total > 0 ? 1e-3 * pixels * times.size() / total : 0;
+	result.p50	= percentile(times, 0.50);
+	result.p90	= percentile(times, 0.90);
+	result.p99	= percentile(times, 0.99);
+	result.max	= times.back();
+
+	if (!params.csv)
+	{
+		cout << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << result.mpix << std::setprecision(3)
+			<< std::setw(10) << result.p50
+			<< std::setw(10) << result.p90
+			<< std::setw(10) << result.p99
+			<< std::setw(10) << result.max << endl;
+	}
+
+	results.push_back(result);
+}
+
+
+bool selected(const Params &params, const string &name)
+{
+	return params.only.empty() || name.find(params.only) != string::npos;
+}
+
+
+template <typename Operation> void run(const Params &params, vector<Result> &results, const string &name, const size_t pixels, Operation operation)
+{
+	if (!selected(params, name))
+	{
+		return;
+	}
+
+	vector<double> times;
+	times.reserve(params.iterations);
+
+	for (int i=0; i<params.warmup; i++)
+	{
+		operation();
+	}
+
+	for (int i=0; i<params.iterations; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		operation();
+		times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	record(params, results, name, pixels, times);
+}
+
+
+string label(const string &decoder, const Sensor &sensor, const string &source, const string &destination, const int depth, const int mode = -1)
+{
+	std::ostringstream result;
+
+	result << decoder << '/' << sensor.name << '/' << source << '>' << destination << '/' << depth;
+
+	if (mode >= 0) result << "/m" << mode;
+
+	return result.str();
+}
+
+
+// The shift applied when narrowing HDR data to a byte destination (12-bit data)
+template <typename T, typename U> uint16_t shift()
+{
+	return sizeof(U) < sizeof(T) ? 4 : 0;
+}
+
+
+template <typename T, typename U> void decoders(const Params &params, vector<Result> &results, const Sensor &sensor, const string &source, const string &destination)
+{
+	auto src			= generate<T>(sensor);
+	const size_t pixels	= sensor.width * sensor.height;
+	const int w			= sensor.width;
+	const int h			= sensor.height;
+	vector<U> dst(pixels * 3);
+
+	for (byte mode=0; mode<4; mode++)
+	{
+		run(params, results, label("bayer-colour", sensor, source, destination, 3, mode), pixels, [&] {
+			Bayer::Colour(src.data(), dst.data(), w, h, mode, shift<T, U>());
+		});
+
+		run(params, results, label("bayer-grey", sensor, source, destination, 1, mode), pixels, [&] {
+			Bayer::Grey(src.data(), dst.data(), w, h, mode, shift<T, U>());
+		});
+	}
+
+	// BGRA output with padded rows (as required by Qt and Windows bitmaps) emitted directly by the
+	// decoder compared with a separate conversion pass over the RGB output
+	const Layout bgra	= { ChannelOrder::BGRA, size_t(w - 4) * 4 + 16 };
+	const int dw		= w - 4;
+	vector<U> padded(bgra.stride * h);
+
+	run(params, results, label("bayer-colour-bgra", sensor, source, destination, 4, 0), pixels, [&] {
+		Bayer::Colour(src.data(), padded.data(), w, h, 0, shift<T, U>(), nullptr, bgra);
+	});
+
+	run(params, results, label("bayer-colour+bgra", sensor, source, destination, 4, 0), pixels, [&] {
+		Bayer::Colour(src.data(), dst.data(), w, h, 0, shift<T, U>());
+
+		for (int y=0; y<h-4; y++)
+		{
+			const U *ps	= dst.data() + y * dw * 3;
+			U *pd		= padded.data() + y * bgra.stride;
+
+			for (int x=0; x<dw; x++, ps+=3, pd+=4)
+			{
+				pd[0] = ps[2];
+				pd[1] = ps[1];
+				pd[2] = ps[0];
+				pd[3] = std::numeric_limits<U>::max();
+			}
+		}
+	});
+
+	for (byte depth : { 1, 3 })
+	{
+		for (byte mode=0; mode<4; mode++)
+		{
+			run(params, results, label("demosaic", sensor, source, destination, depth, mode), pixels, [&] {
+				bayer::Demosaic<T, U>::Decode(mode, src.data(), w, h, depth, dst.data(), shift<T, U>());
+			});
+		}
+
+		run(params, results, label("monochrome", sensor, source, destination, depth), pixels, [&] {
+			Monochrome::Decode(src.data(), dst.data(), w, h, depth, shift<T, U>());
+		});
+	}
+
+	// YUV output converted from each band as it is decoded (compare with bayer-colour)
+	if constexpr (std::is_same_v<U, byte>)
+	{
+		YuvHandler yuv;
+		vector<byte> planes(YuvHandler::Size(YuvFormat::YUYV, w, h));
+
+		yuv.Shift(shift<T, U>());
+
+		for (auto [name, format] : { std::pair { "bayer-yuyv", YuvFormat::YUYV }, std::pair { "bayer-nv12", YuvFormat::NV12 } })
+		{
+			yuv.Initialise(planes.data(), planes.size(), format);
+
+			run(params, results, label(name, sensor, source, destination, 2, 0), pixels, [&] {
+				yuv.Process(false, sizeof(T) > 1, (const byte *)src.data(), src.size() * sizeof(T), w, h, 0);
+			});
+		}
+	}
+
+	// HDR to byte through a tone curve lookup table rather than a shift
+	if constexpr (sizeof(T) > sizeof(U))
+	{
+		const auto curve = ToneCurve::Gamma(2.2);
+
+		run(params, results, label("bayer-colour-lut", sensor, source, destination, 3, 0), pixels, [&] {
+			Bayer::Colour(src.data(), dst.data(), w, h, 0, curve.Table());
+		});
+
+		run(params, results, label("monochrome-lut", sensor, source, destination, 1), pixels, [&] {
+			Monochrome::Decode(src.data(), dst.data(), w, h, 1, curve.Table());
+		});
+	}
+}
+
+
+template <typename U, typename S> void filters(const Params &params, vector<Result> &results, const Sensor &sensor, const string &destination)
+{
+	emg::Image<U, S> image;
+	const auto frame	= generate<U>(sensor);
+	const size_t pixels	= sensor.width * sensor.height;
+
+	image.Resize(sensor.width, sensor.height);
+
+	for (size_t i=0; i<image.Size(); i++)
+	{
+		image.Data()[i] = frame[i / image.Depth()];
+	}
+
+	Filter::Configuration offset;
+	offset.mode		= Filter::RowOffset;
+	offset.offset	= 1;
+
+	Filter::Configuration gain;
+	gain.mode		= Filter::RowGain;
+	gain.gain		= 1.01;
+
+	// The image gradually brightens but that has no bearing on the timing
+	run(params, results, label("filter-offset", sensor, destination, destination, image.Depth()), pixels, [&] {
+		Filter::Process(offset, image);
+	});
+
+	run(params, results, label("filter-gain", sensor, destination, destination, image.Depth()), pixels, [&] {
+		Filter::Process(gain, image);
+	});
+
+	// Monochrome decode followed by a separate correction pass compared with the correction
+	// fused into the decoder by the image handler
+	run(params, results, label("monochrome+filter", sensor, destination, destination, image.Depth()), pixels, [&] {
+		Monochrome::Decode(frame.data(), image.Data(), sensor.width, sensor.height, image.Depth(), 0);
+		Filter::Process(gain, image);
+	});
+
+	typename ImageHandler<U>::Configuration configuration;
+	configuration.filter = gain;
+
+	ImageHandler<U> handler(image, configuration);
+
+	run(params, results, label("monochrome-filtered", sensor, destination, destination, image.Depth()), pixels, [&] {
+		handler.Process(true, sizeof(U) > 1, (const byte *)frame.data(), frame.size() * sizeof(U), sensor.width, sensor.height, 0);
+	});
+}
+
+
+// End-to-end capture through a simulated camera, which exercises the transport, pipeline
+// and decode stages without any hardware attached. The latency is the interval between
+// consecutive frames arriving at the callback.
+void capture(const Params &params, vector<Result> &results, const Sensor &sensor, const byte pipeline, const size_t ring)
+{
+	const string name = "capture/" + sensor.name + "/p" + std::to_string(pipeline) + "/r" + std::to_string(ring);
+
+	if (!selected(params, name))
+	{
+		return;
+	}
+
+	SimulatedTransport::Configuration configuration;
+	configuration.chip		= sensor.name;
+	configuration.bandwidth	= params.bandwidth;
+
+	Camera camera(std::make_unique<SimulatedTransport>(configuration));
+	camera.Initialise();
+
+	for (int i=0; i<200 && !camera.Connected(); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	if (!camera.Connected())
+	{
+		cerr << name << ": simulated camera failed to connect" << endl;
+		return;
+	}
+
+	camera.SetPipeline(pipeline);
+	camera.SetDecoding(ring);
+
+	emg::Image<byte, emg::rgb> image;
+	ImageHandler<byte> handler(image);
+	vector<double> times;
+	int count		= 0;
+	int failures	= 0;
+	auto last		= std::chrono::steady_clock::now();
+
+	camera.GrabImage(Camera::Mode::Normal, handler, [&](bool success) {
+		const auto now = std::chrono::steady_clock::now();
+
+		if (!success)
+		{
+			failures++;
+		}
+		else if (count++ >= params.warmup)
+		{
+			times.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+		}
+
+		last = now;
+
+		return count < params.warmup + params.iterations && failures < params.iterations;
+	});
+
+	while (camera.Grabbing())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (failures)
+	{
+		cerr << name << ": " << failures << " frames failed" << endl;
+	}
+
+	record(params, results, name, sensor.width * sensor.height, times);
+}
+
+
+// Streaming from several simulated cameras driven by a single CameraGroup thread, optionally
+// alongside a camera connected over USB. The USB camera shares the libusb context serviced by the
+// group thread, which must also poll the simulated transports, and is streamed as well if one is
+// present. The latency is the interval between consecutive frames from each simulated camera.
+void group(const Params &params, vector<Result> &results, const Sensor &sensor, const int simulated, const bool usb)
+{
+	const string name = "group/" + sensor.name + "/s" + std::to_string(simulated) + (usb ? "+usb" : "");
+
+	if (!selected(params, name))
+	{
+		return;
+	}
+
+	struct Stream
+	{
+		Camera *camera = nullptr;
+		emg::Image<byte, emg::rgb> image;
+		std::unique_ptr<ImageHandler<byte>> handler;
+		int count	= 0;
+		int failed	= 0;
+		std::chrono::steady_clock::time_point last;
+	};
+
+	CameraGroup group;
+	std::deque<Stream> streams;
+	Stream physical;
+
+	if (usb)
+	{
+		physical.camera = &group.Add();
+	}
+
+	SimulatedTransport::Configuration configuration;
+	configuration.chip		= sensor.name;
+	configuration.bandwidth	= params.bandwidth;
+
+	for (int i=0; i<simulated; i++)
+	{
+		streams.emplace_back().camera = &group.Add(std::make_unique<SimulatedTransport>(configuration));
+	}
+
+	auto connected = [&] { return std::all_of(streams.begin(), streams.end(), [](auto &s) { return s.camera->Connected(); }); };
+
+	for (int i=0; i<200 && !connected(); i++)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	if (!connected())
+	{
+		cerr << name << ": simulated cameras failed to connect" << endl;
+		return;
+	}
+
+	std::mutex cs;
+	vector<double> times;
+	std::atomic<int> streaming = simulated;
+	const int frames = params.warmup + params.iterations;
+
+	for (auto &s : streams)
+	{
+		s.handler	= std::make_unique<ImageHandler<byte>>(s.image);
+		s.last		= std::chrono::steady_clock::now();
+
+		s.camera->GrabImage(Camera::Mode::Normal, *s.handler, [&, stream = &s](bool success) {
+			const auto now = std::chrono::steady_clock::now();
+
+			if (!success)
+			{
+				stream->failed++;
+			}
+			else if (stream->count++ >= params.warmup)
+			{
+				std::lock_guard lock(cs);
+				times.push_back(std::chrono::duration<double, std::milli>(now - stream->last).count());
+			}
+
+			stream->last = now;
+
+			const bool more = stream->count < frames && stream->failed < params.iterations;
+
+			if (!more)
+			{
+				streaming--;
+			}
+
+			return more;
+		});
+	}
+
+	// The USB camera (if present) streams until the simulated cameras have finished
+	const bool attached = physical.camera && physical.camera->Connected();
+
+	if (attached)
+	{
+		physical.handler = std::make_unique<ImageHandler<byte>>(physical.image);
+
+		physical.camera->GrabImage(Camera::Mode::Normal, *physical.handler, [&](bool success) {
+			physical.count	+= success;
+			physical.failed	+= !success;
+
+			return streaming > 0;
+		});
+	}
+
+	while (std::any_of(streams.begin(), streams.end(), [](auto &s) { return s.camera->Grabbing(); }))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (attached && !physical.camera->AwaitGrab(1000))
+	{
+		cerr << name << ": the USB camera stalled after " << physical.count << " frames" << endl;
+	}
+	else if (attached && physical.failed)
+	{
+		cerr << name << ": " << physical.failed << " USB frames failed" << endl;
+	}
+
+	for (auto &s : streams)
+	{
+		if (s.failed)
+		{
+			cerr << name << ": " << s.failed << " frames failed" << endl;
+		}
+	}
+
+	record(params, results, name, sensor.width * sensor.height * simulated, times);
+}
+
+
+// Streaming through the USB transport with the libusb calls answered by a simulated device, which
+// exercises the ring of bulk read transfers without hardware. Three frames are kept queued and the
+// latency is the interval between frames being collected.
+void usb(const Params &params, vector<Result> &results, const Sensor &sensor)
+{
+	const string name = "usb/" + sensor.name + "/q3";
+
+	if (!selected(params, name))
+	{
+		return;
+	}
+
+	SimulatedUsb::Configuration configuration;
+	configuration.frame		= sensor.width * sensor.height;
+	configuration.bandwidth	= params.bandwidth;
+
+	auto device = std::make_shared<SimulatedUsb>(configuration);
+	UsbTransport transport(nullptr, device);
+
+	transport.SetTransfers(4, 64 * 1024);
+	transport.Attach(device->Device(), "simulated");
+
+	const vector<byte> command	= { 0x00 };
+	const int frames			= params.warmup + params.iterations;
+	std::atomic<bool> waiting	= false;
+	TransportPool::Lease data;
+	vector<double> times;
+	int queued		= 0;
+	int failures	= 0;
+	auto last		= std::chrono::steady_clock::now();
+
+	for (; queued < std::min(frames, 3); queued++)
+	{
+		transport.Queue(command, configuration.frame, waiting);
+	}
+
+	for (int i=0; i<frames; i++)
+	{
+		const bool success	= transport.Collect(data);
+		const auto now		= std::chrono::steady_clock::now();
+
+		if (queued < frames)
+		{
+			transport.Queue(command, configuration.frame, waiting);
+			queued++;
+		}
+
+		// Every byte of a frame holds its sequence number so any misaligned chunk is caught
+		const byte *pd = success ? data->Data() : nullptr;
+
+		if (!pd || std::any_of(pd, pd + data->Size(), [&](byte b) { return b != (i & 0xff); }))
+		{
+			failures++;
+		}
+		else if (i >= params.warmup)
+		{
+			times.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+		}
+
+		last = now;
+	}
+
+	if (failures)
+	{
+		cerr << name << ": " << failures << " frames failed" << endl;
+	}
+
+	record(params, results, name, sensor.width * sensor.height, times);
+}
+
+
+// A fault is injected by the simulated libusb backend once the given number of bytes has been sent
+// whilst three frames are queued on the USB transport. The frames are then collected, when the outcome
+// for each must match, or flushed, cancelled or the device is released part way through. Any transfers that are
+// cancelled must complete, on the thread polling the transport, before the device is closed. Each frame
+// is followed by a count trailer and, since the frame is not a multiple of the USB 3 packet size, it
+// ends with a short packet before the trailer is sent. Returns the number of cases that failed.
+int faults(const Params &params, const Sensor &sensor)
+{
+	enum class Action { Collect, Flush, Cancel, Release };
+
+	struct Case
+	{
+		string name;
+		SimulatedUsb::Fault fault;
+		size_t after;
+		Action action;
+		vector<bool> expected;	// The outcome of collecting each frame
+	};
+
+	const int timeout		= 100;
+	const size_t trailer	= 8;
+	const size_t size		= sensor.width * sensor.height + trailer;
+	const vector<Case> cases = {
+		{ "usb-fault/unaligned",	SimulatedUsb::Fault::None,			0,					Action::Collect,	{ true, true, true }},
+		{ "usb-fault/short",		SimulatedUsb::Fault::Short,			size + size / 2,	Action::Collect,	{ true, false, false }},
+		{ "usb-fault/timeout",		SimulatedUsb::Fault::Timeout,		size / 2,			Action::Collect,	{ false, false, false }},
+		{ "usb-fault/cancel",		SimulatedUsb::Fault::Hang,			size / 2,			Action::Flush,		{}},
+		{ "usb-fault/abandon",		SimulatedUsb::Fault::Hang,			size / 2,			Action::Cancel,		{}},
+		{ "usb-fault/release",		SimulatedUsb::Fault::Hang,			size / 2,			Action::Release,	{ false, false, false }},
+		{ "usb-fault/disconnect",	SimulatedUsb::Fault::Disconnect,	size + size / 3,	Action::Collect,	{ true, false, false }}
+	};
+
+	int failed = 0;
+
+	for (auto &c : cases)
+	{
+		if (!selected(params, c.name))
+		{
+			continue;
+		}
+
+		SimulatedUsb::Configuration configuration;
+		configuration.frame		= size - trailer;
+		configuration.trailer	= trailer;
+		configuration.packet	= 1024;
+
+		auto device = std::make_shared<SimulatedUsb>(configuration);
+		UsbTransport transport(nullptr, device);
+
+		transport.SetTimeout(timeout);
+		transport.SetTransfers(4, 64 * 1024);
+		transport.Attach(device->Device(), "simulated");
+		device->Inject(c.fault, c.after);
+
+		const vector<byte> command	= { 0x00 };
+		std::atomic<bool> waiting	= false;
+		auto start					= std::chrono::steady_clock::now();
+		vector<string> problems;
+
+		for (int i=0; i<3; i++)
+		{
+			transport.Queue(command, size, waiting, trailer);
+		}
+
+		if (c.action == Action::Flush)
+		{
+			// Nothing completes so the flush gives up waiting and cancels the transfers
+			transport.Flush();
+
+			if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(2 * timeout + 2000))
+			{
+				problems.push_back("the flush took too long");
+			}
+		}
+
+		if (c.action == Action::Cancel)
+		{
+			// Allow the stream to start, the cancellation must then not wait for the stuck transfers
+			transport.Poll(10);
+
+			start = std::chrono::steady_clock::now();
+			transport.Cancel();
+
+			if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(timeout))
+			{
+				problems.push_back("the cancellation waited for the transfers");
+			}
+		}
+
+		if (c.action == Action::Release)
+		{
+			// Allow the stream to start before releasing the device mid-frame
+			transport.Poll(10);
+
+			start = std::chrono::steady_clock::now();
+			transport.Disconnect();
+
+			if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(timeout))
+			{
+				problems.push_back("the release waited for the transfers");
+			}
+
+			if (transport.Connected() || device->Closed())
+			{
+				problems.push_back("the device was closed whilst transfers were in flight");
+			}
+		}
+
+		for (size_t i=0; i<c.expected.size(); i++)
+		{
+			TransportPool::Lease data;
+
+			const auto begin	= std::chrono::steady_clock::now();
+			const bool success	= transport.Collect(data);
+
+			if (success != c.expected[i])
+			{
+				problems.push_back("frame " + std::to_string(i) + (success ? " succeeded" : " failed"));
+			}
+			else if (success && std::any_of(data->Data(), data->Data() + data->Size(), [&](byte b) { return b != i; }))
+			{
+				problems.push_back("frame " + std::to_string(i) + " is misaligned");
+			}
+
+			// A failure must be reported within the transfer timeout rather than the stall limit
+			if (std::chrono::steady_clock::now() - begin > std::chrono::milliseconds(2 * timeout))
+			{
+				problems.push_back("frame " + std::to_string(i) + " stalled");
+			}
+		}
+
+		if (c.action != Action::Collect)
+		{
+			// Cancelled transfers complete in the background whenever events are next handled
+			for (int i=0; i<50 && (device->Pending() || (c.action == Action::Release && !device->Closed())); i++)
+			{
+				transport.Poll(10);
+			}
+
+			if (c.action == Action::Release && !device->Closed())
+			{
+				problems.push_back("the device was never closed");
+			}
+		}
+
+		if (transport.Queued() || device->Pending())
+		{
+			problems.push_back("transfers were left outstanding");
+		}
+
+		if (c.fault == SimulatedUsb::Fault::Disconnect)
+		{
+			if (transport.Queue(command, size, waiting, trailer))
+			{
+				problems.push_back("a frame was queued after disconnection");
+			}
+
+			transport.Disconnect();
+			transport.Flush();
+
+			if (transport.Connected() || transport.Queued() || !device->Closed())
+			{
+				problems.push_back("the device was not released");
+			}
+		}
+
+		for (auto &p : problems)
+		{
+			cerr << c.name << ": " << p << endl;
+		}
+
+		if (!params.csv)
+		{
+			cout << std::left << std::setw(40) << c.name << std::right << std::setw(10) << (problems.empty() ? "ok" : "failed") << endl;
+		}
+
+		failed += problems.size() ? 1 : 0;
+	}
+
+	return failed;
+}
+
+
+// Decode the frames of a recording in turn (repeating them if there are fewer frames than
+// iterations) through the image handler, as a camera delivering that data would.
+template <typename U, typename S> void replay(const Params &params, vector<Result> &results, const Replay &recording, const string &destination)
+{
+	emg::Image<U, S> image;
+	ImageHandler<U> handler(image);
+	const string name = "replay/" + destination + "/" + std::to_string(image.Depth());
+
+	if (!selected(params, name))
+	{
+		return;
+	}
+
+	// The throughput is based upon the size of the first frame
+	if (!recording.Process(0, handler))
+	{
+		cerr << name << ": the recording could not be decoded" << endl;
+		return;
+	}
+
+	size_t frame = 0;
+
+	run(params, results, name, image.Width() * image.Height(), [&] {
+		recording.Process(frame++ % recording.Size(), handler);
+	});
+}
+
+
+void csv(std::ostream &stream, const vector<Result> &results)
+{
+	stream << "name,mpix,p50,p90,p99,max" << endl;
+
+	for (auto &r : results)
+	{
+		stream << r.name << ',' << r.mpix << ',' << r.p50 << ',' << r.p90 << ',' << r.p99 << ',' << r.max << endl;
+	}
+}
+
+
+std::map<string, double> load(const string &path)
+{
+	std::map<string, double> result;
+	std::ifstream file(path);
+	string line;
+
+	std::getline(file, line);	// header
+
+	while (std::getline(file, line))
+	{
+		const auto comma = line.find(',');
+
+		if (comma != string::npos)
+		{
+			result[line.substr(0, comma)] = std::atof(line.c_str() + comma + 1);
+		}
+	}
+
+	return result;
+}
+
+
+// Returns the number of cases whose throughput has dropped by more than the
+// tolerance (as a percentage) when compared with the baseline.
+int compare(const vector<Result> &results, const std::map<string, double> &baseline, const double tolerance)
+{
+	int regressions = 0;
+
+	for (auto &r : results)
+	{
+		auto b = baseline.find(r.name);
+
+		if (b != baseline.end() && r.mpix < b->second * (1.0 - tolerance / 100.0))
+		{
+			cerr << "regression: " << r.name << " " << std::fixed << std::setprecision(1) << b->second << " -> " << r.mpix << " MPix/s" << endl;
+			regressions++;
+		}
+	}
+
+	return regressions;
+}
+
+
+int main(int argc, char *argv[])
+{
+	bool help			= false;
+	bool scalar			= false;
+	bool simulate		= false;
+	double bandwidth	= 0;
+	int workers			= -1;
+	double tolerance	= 10;
+	string output, baseline, recording;
+	Params params;
+
+	emg::Clap clap;
+
+	clap['h'].Name("help")		.Describe("display this help and exit")										.Bind(help);
+	clap['i'].Name("iterations").Describe("number of timed frames per case (default is 50)")				.Bind(params.iterations);
+	clap['u'].Name("warmup")	.Describe("number of untimed frames per case (default is 3)")				.Bind(params.warmup);
+	clap['w'].Name("workers")	.Describe("number of decode worker threads (default is one per core)")		.Bind(workers);
+	clap['s'].Name("scalar")	.Describe("disable the vectorised kernels")									.Bind(scalar);
+	clap['f'].Name("filter")	.Describe("only run cases whose name contains the given text")				.Bind(params.only);
+	clap['c'].Name("csv")		.Describe("write the results to stdout as CSV")								.Bind(params.csv);
+	clap['o'].Name("output")	.Describe("write the results to the given CSV file")						.Bind(output);
+	clap['b'].Name("baseline")	.Describe("compare throughput against a previously written CSV file")		.Bind(baseline);
+	clap['x'].Name("capture")	.Describe("include end-to-end capture from simulated cameras")				.Bind(simulate);
+	clap['l'].Name("bandwidth")	.Describe("simulated camera bandwidth in MB/s (default is unlimited)")		.Bind(bandwidth);
+	clap['r'].Name("replay")	.Describe("include the decode of frames from the given recording")			.Bind(recording);
+	clap['t'].Name("tolerance")	.Describe("permitted drop in throughput as a percentage (default is 10)")	.Bind(tolerance);
+
+	clap.Parse(argc, argv);
+
+	if (help)
+	{
+		clap.Usage(cout, argv[0]);
+		return 0;
+	}
+
+	if (params.iterations < 1)
+	{
+		cerr << "At least one iteration is required" << endl;
+		return 1;
+	}
+
+	params.bandwidth = bandwidth * 1e6;
+
+	if (workers >= 0)	WorkerPool::Shared().Resize(workers);
+	if (scalar)			simd::Restrict(simd::Level::None);
+
+	if (!params.csv)
+	{
+		cout << std::left << std::setw(40) << "case" << std::right
+			<< std::setw(10) << "MPix/s"
+			<< std::setw(10) << "p50 ms"
+			<< std::setw(10) << "p90 ms"
+			<< std::setw(10) << "p99 ms"
+			<< std::setw(10) << "max ms" << endl;
+	}
+
+	vector<Result> results;
+
+	for (auto &sensor : SENSORS)
+	{
+		decoders<byte, byte>(params, results, sensor, "8", "8");
+		decoders<byte, uint16_t>(params, results, sensor, "8", "16");
+		decoders<uint16_t, byte>(params, results, sensor, "16", "8");
+		decoders<uint16_t, uint16_t>(params, results, sensor, "16", "16");
+
+		filters<byte, emg::grey>(params, results, sensor, "8");
+		filters<byte, emg::rgb>(params, results, sensor, "8");
+		filters<uint16_t, emg::grey>(params, results, sensor, "16");
+		filters<uint16_t, emg::rgb>(params, results, sensor, "16");
+
+		if (simulate)
+		{
+			capture(params, results, sensor, 0, 0);	// Synchronous transfers and decoding
+			capture(params, results, sensor, 3, 0);	// Pipelined transfers
+			capture(params, results, sensor, 3, 4);	// Pipelined transfers and decoupled decoding
+			group(params, results, sensor, 2, false);	// Simulated cameras sharing a thread
+			group(params, results, sensor, 2, true);	// Alongside a camera connected over USB
+			usb(params, results, sensor);				// The USB transport with a simulated device
+		}
+	}
+
+	const int failed = simulate ? faults(params, SENSORS.front()) : 0;
+
+	if (!recording.empty())
+	{
+		Replay frames;
+
+		if (!frames.Open(recording) || !frames.Size())
+		{
+			cerr << "Unable to replay " << recording << endl;
+			return 1;
+		}
+
+		replay<byte, emg::grey>(params, results, frames, "8");
+		replay<byte, emg::rgb>(params, results, frames, "8");
+		replay<uint16_t, emg::grey>(params, results, frames, "16");
+		replay<uint16_t, emg::rgb>(params, results, frames, "16");
+	}
+
+	if (params.csv)
+	{
+		csv(cout, results);
+	}
+
+	if (!output.empty())
+	{
+		std::ofstream file(output);
+		csv(file, results);
+	}
+
+	if (!baseline.empty() && compare(results, load(baseline), tolerance))
+	{
+		return 2;
+	}
+
+	return failed ? 3 : 0;
+}
@@ -0,0 +1,66 @@
+#include <iostream>
+#include <psinc/CameraGroup.h>
+#include <psinc/handlers/ImageHandler.hpp>
+
+using namespace std::chrono_literals;
+
+using psinc::CameraGroup;
+using psinc::ImageHandler;
+using psinc::Metadata;
+using emg::Image;
+using emg::byte;
+
+
+int main(int argc, char *argv[])
+{
+	std::cout << "This test application connects to two cameras by regex." << std::endl;
+	std::cout << "The first is the master. The second is the slave." << std::endl;
+	std::cout << "They must be physically wired up correctly to do slave capture!" << std::endl;
+
+	if (argc == 3)
+	{
+		// Both cameras are driven by the group thread
+		CameraGroup group;
+
+		auto &master	= group.Add(argv[1]);
+		auto &slave		= group.Add(argv[2]);
+
+		//Always use a distinct image driver for each camera!
+		ImageHandler<byte> masterHandler;
+		ImageHandler<byte> slaveHandler;
+
+		Image<byte> masterImage, slaveImage;
+
+		masterHandler.Initialise(masterImage);
+		slaveHandler.Initialise(slaveImage);
+
+		while (!master.Connected()) std::this_thread::sleep_for(1ms);
+		while (!slave.Connected()) std::this_thread::sleep_for(1ms);
+
+		int count = 0;
+
+		// The group arms the slave, waits until it is ready for the sync signal and then
+		// triggers the master. The callback receives the metadata for both frames once
+		// they have been decoded, and returning true streams further synchronised pairs.
+		group.GrabSynchronised({ &master, &masterHandler }, {{ &slave, &slaveHandler }}, [&](bool status, const std::vector<Metadata> &metadata) {
+			if (status)
+			{
+				auto offset = std::chrono::duration_cast<std::chrono::microseconds>(metadata[1].timestamp - metadata[0].timestamp);
+
+				std::cout << "Pair " << count << " received " << offset.count() << "us apart" << std::endl;
+
+				if (count == 0)
+				{
+					masterImage.Save("master.png");
+					slaveImage.Save("slave.png");
+				}
+			}
+
+			// Capture ten pairs
+			return ++count < 10;
+		});
+
+		// Wait for everything to finish
+		while (group.Synchronising()) std::this_thread::sleep_for(1ms);
+	}
+}
@@ -1,12 +1,32 @@
 #include "psinc.h"
 #include "psinc/Camera.h"
+#include "psinc/SimulatedTransport.h"
 #include "psinc/handlers/ImageHandler.hpp"
 #include <emergent/logger/Logger.hpp>
-#include <thread>
 
 using namespace psinc;
 using namespace emg;
-using namespace std::chrono;
+
+
+template <typename T> int _psinc_grab(Camera *camera, ImageHandler<T> &handler)
+{
+	int result = PSINC_OK;
+
+	const bool grabbing = camera->GrabImage(Camera::Mode::Normal, handler, [&](bool status) {
+		result = status ? PSINC_OK : PSINC_CAMERA_IO_ERROR;
+		return false;
+	});
+
+	if (!grabbing)
+	{
+		return PSINC_CAMERA_BUSY;
+	}
+
+	// Woken by the camera once the callback has returned and the handler is released
+	camera->AwaitGrab();
+
+	return result;
+}
 
 
 template <typename T> int _psinc_grab(Camera *camera, ImageBase<T> *image)
@@ -14,19 +34,33 @@ template <typename T> int _psinc_grab(Camera *camera, ImageBase<T> *image)
 	if (!camera)	return PSINC_INVALID_CAMERA;
 	if (!image)		return PSINC_INVALID_IMAGE;
 
-	int result = PSINC_OK;
 	ImageHandler<T> handler(*image);
 
-	camera->GrabImage(Camera::Mode::Normal, handler, [&](bool status) {
-		result = status ? PSINC_OK : PSINC_CAMERA_IO_ERROR;
-		return false;
-	});
+	return _psinc_grab(camera, handler);
+}
 
-	while (camera->Grabbing())
+
+template <typename T> int _psinc_grab_into(Camera *camera, T *data, int size, int stride, int depth, int order, int &width, int &height)
+{
+	if (!camera)	return PSINC_INVALID_CAMERA;
+	if (!data)		return PSINC_INVALID_IMAGE;
+
+	if (size <= 0 || stride < 0 || stride % sizeof(T) || order < PSINC_RGB || order > PSINC_BGRA || (depth != 1 && depth != (order < PSINC_RGBA ? 3 : 4)))
 	{
-		std::this_thread::sleep_for(1ms);
+		return PSINC_OUT_OF_RANGE;
 	}
 
+	typename ImageHandler<T>::Configuration configuration;
+	configuration.order = ChannelOrder(order);
+
+	ImageHandler<T> handler;
+	handler.Initialise(data, size / sizeof(T), depth, stride / sizeof(T), configuration);
+
+	const int result = _psinc_grab(camera, handler);
+
+	width	= handler.Width();
+	height	= handler.Height();
+
 	return result;
 }
 
@@ -46,6 +80,18 @@ extern "C"
 	}
 
 
+	psinc_camera *psinc_camera_create_simulated(const char *chip, double bandwidth, int latency)
+	{
+		SimulatedTransport::Configuration configuration;
+
+		configuration.chip		= chip ? chip : "v024";
+		configuration.bandwidth	= bandwidth;
+		configuration.latency	= latency;
+
+		return reinterpret_cast<psinc_camera *>(new Camera(std::make_unique<SimulatedTransport>(configuration)));
+	}
+
+
 	int psinc_camera_initialise(psinc_camera *camera, const char *serial)
 	{
 		if (!camera) return PSINC_INVALID_CAMERA;
@@ -60,6 +106,8 @@ extern "C"
 	{
 		if (!camera) return PSINC_INVALID_CAMERA;
 
+		psinc_camera_stop_stream(camera);
+
 		delete reinterpret_cast<Camera *>(camera);
 
 		return PSINC_OK;
@@ -78,25 +126,80 @@ extern "C"
 	}
 
 
+	int psinc_camera_grab_into(psinc_camera *camera, unsigned char *data, int size, int stride, int depth, int order, int &width, int &height)
+	{
+		return _psinc_grab_into(reinterpret_cast<Camera *>(camera), data, size, stride, depth, order, width, height);
+	}
+
+
+	int psinc_camera_grab_into_hdr(psinc_camera *camera, uint16_t *data, int size, int stride, int depth, int order, int &width, int &height)
+	{
+		return _psinc_grab_into(reinterpret_cast<Camera *>(camera), data, size, stride, depth, order, width, height);
+	}
+
+
+	int psinc_camera_set_pipeline(psinc_camera *camera, unsigned char depth, int decoding)
+	{
+		if (!camera)		return PSINC_INVALID_CAMERA;
+		if (decoding < 0)	return PSINC_OUT_OF_RANGE;
+
+		auto c = reinterpret_cast<Camera *>(camera);
+
+		c->SetPipeline(depth);
+		c->SetDecoding(decoding);
+
+		return PSINC_OK;
+	}
+
+
 	int psinc_camera_set_feature(psinc_camera *camera, const char *feature, int value)
+	{
+		const int handle = psinc_camera_feature_handle(camera, feature);
+
+		return handle < 0 ? handle : psinc_camera_set_feature_by_handle(camera, handle, value);
+	}
+
+
+	int psinc_camera_get_feature(psinc_camera *camera, const char *feature, int &value)
+	{
+		const int handle = psinc_camera_feature_handle(camera, feature);
+
+		return handle < 0 ? handle : psinc_camera_get_feature_by_handle(camera, handle, value);
+	}
+
+
+	int psinc_camera_feature_handle(psinc_camera *camera, const char *feature)
+	{
+		if (!camera)	return PSINC_INVALID_CAMERA;
+		if (!feature)	return PSINC_UNKNOWN_FEATURE;
+
+		const int handle = reinterpret_cast<Camera *>(camera)->features.Find(feature);
+
+		return handle == Features::INVALID ? PSINC_UNKNOWN_FEATURE : handle;
+	}
+
+
+	int psinc_camera_set_feature_by_handle(psinc_camera *camera, int handle, int value)
 	{
 		if (!camera) return PSINC_INVALID_CAMERA;
 
 		auto c = reinterpret_cast<Camera *>(camera);
 
-		return c->features.count(feature) == 0 ? PSINC_UNKNOWN_FEATURE : c->features[feature].Set(value) ? PSINC_OK : PSINC_OUT_OF_RANGE;
+		if (handle < 0 || handle >= (int)c->features.size()) return PSINC_UNKNOWN_FEATURE;
+
+		return c->features[handle].Set(value) ? PSINC_OK : PSINC_OUT_OF_RANGE;
 	}
 
 
-	int psinc_camera_get_feature(psinc_camera *camera, const char *feature, int &value)
+	int psinc_camera_get_feature_by_handle(psinc_camera *camera, int handle, int &value)
 	{
 		if (!camera) return PSINC_INVALID_CAMERA;
 
 		auto c = reinterpret_cast<Camera *>(camera);
 
-		if (c->features.count(feature) == 0) return PSINC_UNKNOWN_FEATURE;
+		if (handle < 0 || handle >= (int)c->features.size()) return PSINC_UNKNOWN_FEATURE;
 
-		value = c->features[feature].Get();
+		value = c->features[handle].Get();
 
 		return PSINC_OK;
 	}
@@ -128,4 +231,35 @@ extern "C"
 
 		return reinterpret_cast<Camera *>(camera)->Connected();
 	}
+
+
+	int psinc_camera_timing(psinc_camera *camera, psinc_timing *timing, bool reset)
+	{
+		if (!camera)	return PSINC_INVALID_CAMERA;
+		if (!timing)	return PSINC_OUT_OF_RANGE;
+
+		auto c		= reinterpret_cast<Camera *>(camera);
+		auto stats	= c->TimingStatistics();
+
+		auto stage = [](const Timing::Stage &stage) {
+			return psinc_stage { stage.mean, stage.p50, stage.p90, stage.p99, stage.max };
+		};
+
+		timing->frames		= stats.frames;
+		timing->failed		= stats.failed;
+		timing->fps			= stats.fps;
+		timing->request		= stage(stats.request);
+		timing->transfer	= stage(stats.transfer);
+		timing->queued		= stage(stats.queued);
+		timing->decode		= stage(stats.decode);
+		timing->callback	= stage(stats.callback);
+		timing->total		= stage(stats.total);
+
+		if (reset)
+		{
+			c->ResetTiming();
+		}
+
+		return PSINC_OK;
+	}
 }
@@ -0,0 +1,425 @@
+#include "psinc.h"
+#include "psinc/Camera.h"
+#include "psinc/handlers/ImageHandler.hpp"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <utility>
+
+using namespace psinc;
+using namespace emg;
+
+
+// The state shared between a continuous grab and the C API functions that control it
+class _psinc_stream : public DataHandler
+{
+	public:
+
+		// Prevent any further frames from being delivered and release any waiting callers
+		void Stop()
+		{
+			std::lock_guard lock(this->cs);
+
+			this->stopping = true;
+			this->available.notify_all();
+		}
+
+		virtual bool Complete(bool success, const Metadata &metadata) = 0;
+
+		// Lend the oldest queued frame to the caller (see psinc_frame_acquire)
+		virtual int Acquire(int timeout, psinc_frame *frame) = 0;
+
+		// Return a lent image to the pool
+		virtual void Return(void *image) = 0;
+
+		// Keeps the stream, and therefore the image, alive until the frame is released
+		struct Lease
+		{
+			std::shared_ptr<_psinc_stream> stream;
+			void *image;
+		};
+
+	protected:
+
+		std::mutex cs;
+		std::condition_variable available;
+		bool stopping = false;
+};
+
+
+// Frames are decoded straight into a pool of images. With a callback the image is lent to
+// the callback, otherwise it joins a bounded queue until it is copied out by next_frame or
+// lent out by acquire. The pool holds enough images for a full queue, the frame being
+// decoded and one frame that is being copied or is on lease. If the caller holds on to
+// further frames then the oldest queued frames are dropped to make room.
+template <typename T, typename C> class _psinc_stream_of : public _psinc_stream, public std::enable_shared_from_this<_psinc_stream_of<T, C>>
+{
+	public:
+
+		using Callback = bool (*)(void *, int, C *, const psinc_frame_info *);
+
+
+		_psinc_stream_of(size_t queue, bool colour, Callback callback, void *context) :
+			queue(queue), callback(callback), context(context)
+		{
+			for (size_t i=0; i<queue + 2; i++)
+			{
+				this->pool.push_back(std::make_unique<ImageBase<T>>(colour ? 3 : 1));
+				this->free.push_back(this->pool.back().get());
+			}
+		}
+
+
+		bool Process(bool monochrome, const bool hdr, const std::vector<byte> &data, const size_t width, const size_t height, const byte bayerMode) override
+		{
+			return this->Process(monochrome, hdr, data.data(), data.size(), width, height, bayerMode);
+		}
+
+
+		bool Process(bool monochrome, const bool hdr, const byte *data, const size_t size, const size_t width, const size_t height, const byte bayerMode) override
+		{
+			{
+				std::lock_guard lock(this->cs);
+
+				while (this->free.empty() && !this->ready.empty())
+				{
+					this->Release(this->ready.front().image);
+					this->ready.pop_front();
+				}
+
+				if (this->free.empty())
+				{
+					return false;
+				}
+
+				this->decoding = this->free.back();
+				this->free.pop_back();
+			}
+
+			this->handler.Initialise(*this->decoding);
+
+			return this->handler.Process(monochrome, hdr, data, size, width, height, bayerMode);
+		}
+
+
+		bool Complete(bool success, const Metadata &metadata) override
+		{
+			const psinc_frame_info info = {
+				metadata.sequence,
+				std::chrono::duration_cast<std::chrono::microseconds>(metadata.timestamp.time_since_epoch()).count(),
+				metadata.exposure,
+				metadata.gain,
+				metadata.context
+			};
+
+			std::unique_lock lock(this->cs);
+
+			auto image	= std::exchange(this->decoding, nullptr);
+			auto status	= success && image ? PSINC_OK : PSINC_CAMERA_IO_ERROR;
+
+			if (status != PSINC_OK && image)
+			{
+				this->free.push_back(image);
+				image = nullptr;
+			}
+
+			if (this->callback)
+			{
+				if (this->stopping)
+				{
+					this->Release(image);
+					return false;
+				}
+
+				lock.unlock();
+					const bool result = this->callback(this->context, status, reinterpret_cast<C *>(image), &info);
+				lock.lock();
+
+				this->Release(image);
+
+				return result && !this->stopping;
+			}
+
+			// Drop the oldest frame to make room
+			if (this->ready.size() >= this->queue)
+			{
+				this->Release(this->ready.front().image);
+				this->ready.pop_front();
+			}
+
+			this->ready.push_back({ image, status, info });
+			this->available.notify_all();
+
+			return !this->stopping;
+		}
+
+
+		int Next(C *target, int timeout, psinc_frame_info *info)
+		{
+			Entry entry;
+			const int result = this->Take(timeout, entry);
+
+			if (result != PSINC_OK)
+			{
+				return result;
+			}
+
+			if (info)
+			{
+				*info = entry.info;
+			}
+
+			if (entry.image)
+			{
+				// The copy is made without holding the lock so that decoding can continue
+				auto destination = reinterpret_cast<ImageBase<T> *>(target);
+
+				destination->Resize(entry.image->Width(), entry.image->Height(), entry.image->Depth());
+				memcpy(destination->Data(), entry.image->Data(), entry.image->Size() * sizeof(T));
+
+				this->Return(entry.image);
+			}
+
+			return entry.status;
+		}
+
+
+		int Acquire(int timeout, psinc_frame *frame) override
+		{
+			Entry entry;
+			const int result = this->Take(timeout, entry);
+
+			if (result != PSINC_OK)
+			{
+				return result;
+			}
+
+			*frame		= {};
+			frame->info	= entry.info;
+
+			if (entry.image)
+			{
+				frame->data		= entry.image->Data();
+				frame->width	= entry.image->Width();
+				frame->height	= entry.image->Height();
+				frame->depth	= entry.image->Depth();
+				frame->stride	= frame->width * frame->depth * sizeof(T);
+				frame->bytes	= sizeof(T);
+				frame->lease	= new Lease { this->shared_from_this(), entry.image };
+			}
+
+			return entry.status;
+		}
+
+
+		void Return(void *image) override
+		{
+			std::lock_guard lock(this->cs);
+
+			this->Release(reinterpret_cast<ImageBase<T> *>(image));
+		}
+
+
+	private:
+
+		struct Entry
+		{
+			ImageBase<T> *image		= nullptr;
+			int status				= PSINC_OK;
+			psinc_frame_info info	= {};
+		};
+
+
+		// Wait for the oldest queued frame and remove it from the queue
+		int Take(int timeout, Entry &entry)
+		{
+			std::unique_lock lock(this->cs);
+
+			auto done = [&] { return this->stopping || !this->ready.empty(); };
+
+			if (this->callback)
+			{
+				return PSINC_NOT_STREAMING;
+			}
+
+			if (timeout < 0)
+			{
+				this->available.wait(lock, done);
+			}
+			else if (!this->available.wait_for(lock, std::chrono::milliseconds(timeout), done))
+			{
+				return PSINC_TIMEOUT;
+			}
+
+			if (this->stopping)
+			{
+				return PSINC_NOT_STREAMING;
+			}
+
+			entry = this->ready.front();
+			this->ready.pop_front();
+
+			return PSINC_OK;
+		}
+
+
+		void Release(ImageBase<T> *image)
+		{
+			if (image)
+			{
+				this->free.push_back(image);
+			}
+		}
+
+
+		ImageHandler<T> handler;
+
+		std::vector<std::unique_ptr<ImageBase<T>>> pool;
+		std::vector<ImageBase<T> *> free;
+		std::deque<Entry> ready;
+
+		// The image that is being decoded, which is only accessed by the thread that decodes
+		// and completes each frame
+		ImageBase<T> *decoding = nullptr;
+
+		size_t queue		= 0;
+		Callback callback	= nullptr;
+		void *context		= nullptr;
+};
+
+
+// The active streams keyed by camera. A stream remains registered after it has ended (such
+// as when the callback returns false) until it is stopped or replaced.
+static std::mutex _psinc_streams_cs;
+static std::map<Camera *, std::shared_ptr<_psinc_stream>> _psinc_streams;
+
+
+template <typename T, typename C, typename F> int _psinc_start_stream(Camera *camera, int queue, bool colour, F callback, void *context)
+{
+	if (!camera)				return PSINC_INVALID_CAMERA;
+	if (!callback && queue < 1)	return PSINC_OUT_OF_RANGE;
+
+	auto stream = std::make_shared<_psinc_stream_of<T, C>>(callback ? 0 : queue, colour, callback, context);
+
+	std::lock_guard lock(_psinc_streams_cs);
+
+	const bool grabbing = camera->GrabImage(Camera::Mode::Normal, *stream, [s = stream.get()](bool success, const Metadata &metadata) {
+		return s->Complete(success, metadata);
+	});
+
+	if (!grabbing)
+	{
+		return PSINC_CAMERA_BUSY;
+	}
+
+	// Any previous stream for this camera has finished since the grab could be started
+	_psinc_streams[camera] = stream;
+
+	return PSINC_OK;
+}
+
+
+static std::shared_ptr<_psinc_stream> _psinc_find_stream(Camera *camera)
+{
+	std::lock_guard lock(_psinc_streams_cs);
+
+	auto entry = _psinc_streams.find(camera);
+
+	return entry != _psinc_streams.end() ? entry->second : nullptr;
+}
+
+
+template <typename T, typename C> int _psinc_next_frame(Camera *camera, C *image, int timeout, psinc_frame_info *info)
+{
+	if (!camera)	return PSINC_INVALID_CAMERA;
+	if (!image)		return PSINC_INVALID_IMAGE;
+
+	// The stream may be of the other image type
+	auto typed = std::dynamic_pointer_cast<_psinc_stream_of<T, C>>(_psinc_find_stream(camera));
+
+	return typed ? typed->Next(image, timeout, info) : PSINC_NOT_STREAMING;
+}
+
+
+extern "C"
+{
+	int psinc_camera_start_stream(psinc_camera *camera, int queue, bool colour, psinc_frame_callback callback, void *context)
+	{
+		return _psinc_start_stream<byte, emg_image>(reinterpret_cast<Camera *>(camera), queue, colour, callback, context);
+	}
+
+
+	int psinc_camera_start_stream_hdr(psinc_camera *camera, int queue, bool colour, psinc_hdrframe_callback callback, void *context)
+	{
+		return _psinc_start_stream<uint16_t, emg_hdrimage>(reinterpret_cast<Camera *>(camera), queue, colour, callback, context);
+	}
+
+
+	int psinc_camera_stop_stream(psinc_camera *camera)
+	{
+		if (!camera) return PSINC_INVALID_CAMERA;
+
+		auto c = reinterpret_cast<Camera *>(camera);
+		std::shared_ptr<_psinc_stream> stream;
+
+		{
+			std::lock_guard lock(_psinc_streams_cs);
+
+			auto entry = _psinc_streams.find(c);
+
+			if (entry == _psinc_streams.end())
+			{
+				return PSINC_NOT_STREAMING;
+			}
+
+			stream = entry->second;
+			_psinc_streams.erase(entry);
+		}
+
+		// The grab ends when the next frame completes, after which the stream is released
+		stream->Stop();
+		c->AwaitGrab();
+
+		return PSINC_OK;
+	}
+
+
+	int psinc_camera_next_frame(psinc_camera *camera, emg_image *image, int timeout, psinc_frame_info *info)
+	{
+		return _psinc_next_frame<byte>(reinterpret_cast<Camera *>(camera), image, timeout, info);
+	}
+
+
+	int psinc_camera_next_frame_hdr(psinc_camera *camera, emg_hdrimage *image, int timeout, psinc_frame_info *info)
+	{
+		return _psinc_next_frame<uint16_t>(reinterpret_cast<Camera *>(camera), image, timeout, info);
+	}
+
+
+	int psinc_frame_acquire(psinc_camera *camera, int timeout, psinc_frame *frame)
+	{
+		if (!camera)	return PSINC_INVALID_CAMERA;
+		if (!frame)		return PSINC_INVALID_IMAGE;
+
+		auto stream = _psinc_find_stream(reinterpret_cast<Camera *>(camera));
+
+		return stream ? stream->Acquire(timeout, frame) : PSINC_NOT_STREAMING;
+	}
+
+
+	int psinc_frame_release(psinc_frame *frame)
+	{
+		if (!frame) return PSINC_INVALID_IMAGE;
+
+		if (auto lease = reinterpret_cast<_psinc_stream::Lease *>(frame->lease))
+		{
+			lease->stream->Return(lease->image);
+			delete lease;
+		}
+
+		*frame = {};
+
+		return PSINC_OK;
+	}
+}
@@ -16,6 +16,53 @@ namespace libpsinc
 		UnknownFeature		= -7,
 		OutOfRange			= -8,
 		UnknownDevice		= -9,
+		Timeout				= -10,
+		NotStreaming		= -11,
+		CameraBusy			= -12,
+	}
+
+
+	/// <summary>
+	/// Channel order of colour output, where the alpha channel is opaque.
+	/// </summary>
+	public enum ChannelOrder
+	{
+		RGB		= 0,
+		BGR		= 1,
+		RGBA	= 2,
+		BGRA	= 3,
+	}
+
+
+	/// <summary>
+	/// Details of a frame delivered by a stream.
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct FrameInfo
+	{
+		public ulong Sequence;		// Incremented for every frame requested
+		public long Timestamp;		// Monotonic time at which the transfer completed in microseconds
+		public int Exposure;
+		public int Gain;
+		public byte Context;
+	}
+
+
+	/// <summary>
+	/// A decoded frame on lease from a stream, see <see cref="Camera.AcquireFrame"/>. The data
+	/// remains valid until the frame is released.
+	/// </summary>
+	[StructLayout(LayoutKind.Sequential)]
+	public struct Frame
+	{
+		public IntPtr Data;
+		public int Width;
+		public int Height;
+		public int Depth;
+		public int Stride;			// Bytes from the start of one row to the next
+		public int Bytes;			// Bytes per channel
+		public FrameInfo Info;
+		internal IntPtr Lease;
 	}
 
 
@@ -30,12 +77,21 @@ namespace libpsinc
 		[DllImport(LIB, EntryPoint = "psinc_camera_delete")]		internal static extern int Delete(IntPtr camera);
 		[DllImport(LIB, EntryPoint = "psinc_camera_grab")]			internal static extern int Grab(IntPtr camera, IntPtr image);
 		[DllImport(LIB, EntryPoint = "psinc_camera_grab_hdr")]		internal static extern int GrabHDR(IntPtr camera, IntPtr image);
+		[DllImport(LIB, EntryPoint = "psinc_camera_grab_into")]		internal static extern int GrabInto(IntPtr camera, IntPtr data, int size, int stride, int depth, int order, out int width, out int height);
 		[DllImport(LIB, EntryPoint = "psinc_camera_set_feature")]	internal static extern int SetFeature(IntPtr camera, string feature, int value);
 		[DllImport(LIB, EntryPoint = "psinc_camera_get_feature")]	internal static extern int GetFeature(IntPtr camera, string feature, out int value);
 		[DllImport(LIB, EntryPoint = "psinc_camera_set_flash")]		internal static extern int SetFlash(IntPtr camera, byte power);
 		[DllImport(LIB, EntryPoint = "psinc_camera_set_context")]	internal static extern int SetContext(IntPtr camera, byte context);
 		[DllImport(LIB, EntryPoint = "psinc_camera_connected")]		internal static extern bool Connected(IntPtr camera);
 
+		[DllImport(LIB, EntryPoint = "psinc_camera_start_stream")]		internal static extern int StartStream(IntPtr camera, int queue, bool colour, IntPtr callback, IntPtr context);
+		[DllImport(LIB, EntryPoint = "psinc_camera_start_stream_hdr")]	internal static extern int StartStreamHDR(IntPtr camera, int queue, bool colour, IntPtr callback, IntPtr context);
+		[DllImport(LIB, EntryPoint = "psinc_camera_stop_stream")]		internal static extern int StopStream(IntPtr camera);
+		[DllImport(LIB, EntryPoint = "psinc_camera_next_frame")]		internal static extern int NextFrame(IntPtr camera, IntPtr image, int timeout, IntPtr info);
+		[DllImport(LIB, EntryPoint = "psinc_camera_next_frame_hdr")]	internal static extern int NextFrameHDR(IntPtr camera, IntPtr image, int timeout, IntPtr info);
+		[DllImport(LIB, EntryPoint = "psinc_frame_acquire")]			internal static extern int AcquireFrame(IntPtr camera, int timeout, out Frame frame);
+		[DllImport(LIB, EntryPoint = "psinc_frame_release")]			internal static extern int ReleaseFrame(ref Frame frame);
+
 		[DllImport(LIB, EntryPoint = "psinc_device_initialise")]	internal static extern int DeviceInitialise(IntPtr camera, string device, byte configuration);
 		[DllImport(LIB, EntryPoint = "psinc_device_write_byte")]	internal static extern int DeviceWriteByte(IntPtr camera, string device, byte value);
 		[DllImport(LIB, EntryPoint = "psinc_device_write")]			internal static extern int DeviceWrite(IntPtr camera, string device, IntPtr buffer, int size);
@@ -123,6 +179,96 @@ namespace libpsinc
 		}
 
 
+		/// <summary>
+		/// Grab a frame and decode it directly into unmanaged or pinned memory, such as the locked bits
+		/// of a bitmap, in its final layout. This function blocks until the frame has been decoded.
+		/// </summary>
+		/// <returns>True if an image was successfully grabbed and fitted within the buffer.</returns>
+		/// <param name="data">Start of the buffer.</param>
+		/// <param name="size">Size of the buffer in bytes.</param>
+		/// <param name="stride">Bytes from the start of one row to the next.</param>
+		/// <param name="depth">1 for greyscale, otherwise the number of channels of the order.</param>
+		/// <param name="order">Channel order of colour output.</param>
+		/// <param name="width">Receives the width of the frame.</param>
+		/// <param name="height">Receives the height of the frame.</param>
+		public bool GrabInto(IntPtr data, int size, int stride, int depth, ChannelOrder order, out int width, out int height)
+		{
+			return Psinc.GrabInto(this.camera, data, size, stride, depth, (int)order, out width, out height) == (int)ReturnCodes.Ok;
+		}
+
+
+		/// <summary>
+		/// Start grabbing continuously into a queue of frames that are retrieved with
+		/// <see cref="NextFrame(Image, int)"/>. Once the queue is full the oldest frame is dropped.
+		/// </summary>
+		/// <returns>True if the stream was started, false if the camera is already grabbing.</returns>
+		/// <param name="queue">Maximum number of frames held waiting to be retrieved.</param>
+		/// <param name="colour">If set to <c>true</c> the frames are decoded to colour.</param>
+		/// <param name="hdr">If set to <c>true</c> the frames are retrieved as HDR images.</param>
+		public bool StartStream(int queue, bool colour, bool hdr = false)
+		{
+			return (hdr
+				? Psinc.StartStreamHDR(this.camera, queue, colour, IntPtr.Zero, IntPtr.Zero)
+				: Psinc.StartStream(this.camera, queue, colour, IntPtr.Zero, IntPtr.Zero)
+			) == (int)ReturnCodes.Ok;
+		}
+
+
+		/// <summary>
+		/// Stop the stream and wait until the camera has finished with it.
+		/// </summary>
+		public bool StopStream()
+		{
+			return Psinc.StopStream(this.camera) == (int)ReturnCodes.Ok;
+		}
+
+
+		/// <summary>
+		/// Wait for the oldest frame in the stream queue and write it to the supplied image.
+		/// </summary>
+		/// <returns>True if a frame was successfully retrieved.</returns>
+		/// <param name="image">Instance of image in which to write the frame.</param>
+		/// <param name="timeout">Time to wait in milliseconds (negative waits indefinitely).</param>
+		public bool NextFrame(Image image, int timeout)
+		{
+			return Psinc.NextFrame(this.camera, image.Pointer, timeout, IntPtr.Zero) == (int)ReturnCodes.Ok;
+		}
+
+
+		/// <summary>
+		/// Wait for the oldest frame in an HDR stream queue and write it to the supplied image.
+		/// </summary>
+		/// <returns>True if a frame was successfully retrieved.</returns>
+		/// <param name="image">Instance of image in which to write the frame.</param>
+		/// <param name="timeout">Time to wait in milliseconds (negative waits indefinitely).</param>
+		public bool NextFrame(ImageHDR image, int timeout)
+		{
+			return Psinc.NextFrameHDR(this.camera, image.Pointer, timeout, IntPtr.Zero) == (int)ReturnCodes.Ok;
+		}
+
+
+		/// <summary>
+		/// Wait for the oldest frame in the stream queue and lend its buffer without copying it.
+		/// The frame must be returned with <see cref="ReleaseFrame"/>.
+		/// </summary>
+		/// <returns>True if a frame was successfully acquired.</returns>
+		/// <param name="frame">Receives the frame.</param>
+		/// <param name="timeout">Time to wait in milliseconds (negative waits indefinitely).</param>
+		public bool AcquireFrame(out Frame frame, int timeout)
+		{
+			return Psinc.AcquireFrame(this.camera, timeout, out frame) == (int)ReturnCodes.Ok;
+		}
+
+
+		/// <summary>
+		/// Return a frame obtained from <see cref="AcquireFrame"/> to the stream.
+		/// </summary>
+		public void ReleaseFrame(ref Frame frame)
+		{
+			Psinc.ReleaseFrame(ref frame);
+		}
+
+
 		/// <summary>
 		/// Retrieve the value for a specific camera feature.
 		/// </summary>
@@ -12,18 +12,32 @@
 // and then add v4l2loopback to /etc/modules, then
 // $ sudo update-initramfs -u
 
+// The output defaults to YUYV on /dev/video0 (see usage). Without the module the raw frames
+// can be sent to any other file, for example
+// $ mkfifo /tmp/psinc && ffplay -f rawvideo -pixel_format nv12 -video_size 748x476 /tmp/psinc &
+// $ psinc-loopback -d /tmp/psinc -f nv12
+
 #include <psinc/Camera.h>
 #include <psinc/handlers/ImageHandler.hpp>
+#include <psinc/handlers/YuvHandler.hpp>
 #include <emergent/String.hpp>
 #include <emergent/Timer.hpp>
 
 #include <signal.h>
 #include <linux/videodev2.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
 #include <ncurses.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <mutex>
 
 
 using emergent::byte;
@@ -32,14 +46,21 @@ using emergent::String;
 using namespace std::chrono_literals;
 
 // todo:
-//   connect to specific camera
-//   provide a specific /dev/videoN
+//   --connect to specific camera--
+//   --provide a specific /dev/videoN--
 //   --display frame rate (limit framerate?)--
 //   --control exposure/gain/flash/colour?--
 //   --auto exposure?--
 //   lens correction?
 
 
+// The number of buffers requested from the device when streaming
+#define BUFFERS 4
+
+// How long to wait for the consumer to return a buffer before dropping the frame
+#define DEQUEUE_TIMEOUT 100	// ms
+
+
 std::string get_format(uint32_t value)
 {
 	return std::string((char *)&value, 4);
@@ -59,37 +80,117 @@ void print(v4l2_format &format)
 
 
 
+// The pixel formats that can be produced. The YUV formats are converted as the image is
+// decoded and require less than half of the bandwidth of RGB24.
+struct Format
+{
+	const char *name;
+	uint32_t fourcc;
+	uint32_t colourspace;
+
+	// The default number of bytes per line and per image
+	size_t Stride(size_t width) const
+	{
+		switch (this->fourcc)
+		{
+			case V4L2_PIX_FMT_RGB24:	return width * 3;
+			case V4L2_PIX_FMT_YUYV:		return width * 2;
+			default:					return width;
+		}
+	}
+
+	size_t Size(size_t stride, size_t height) const
+	{
+		return this->fourcc == V4L2_PIX_FMT_NV12 ? stride * (height + height / 2) : stride * height;
+	}
+};
+
+const std::array<Format, 4> formats = {{
+	{ "yuyv",	V4L2_PIX_FMT_YUYV,	V4L2_COLORSPACE_SMPTE170M },
+	{ "nv12",	V4L2_PIX_FMT_NV12,	V4L2_COLORSPACE_SMPTE170M },
+	{ "rgb",	V4L2_PIX_FMT_RGB24,	V4L2_COLORSPACE_SRGB },
+	{ "grey",	V4L2_PIX_FMT_GREY,	V4L2_COLORSPACE_SRGB }
+}};
+
+
+
+// The video output. Where the device supports it, a set of buffers is mapped from the device
+// and the frames are decoded directly into them before being queued (memory-mapped streaming).
+// Otherwise the frames are decoded to a local buffer which is then written to the device. Paths
+// that are not video devices, such as a pipe, a regular file or a memfd, receive the raw frames
+// through write so that the output can be tested without the v4l2loopback module.
 struct Output
 {
-	int fd = 0;
-	v4l2_format format;
+	struct Buffer
+	{
+		byte *data		= nullptr;
+		size_t size		= 0;
+		uint32_t index	= 0;
+	};
+
+	std::string path	= "/dev/video0";
+	Format format		= formats[0];
+	int fd				= -1;
+	bool video			= false;
+	bool streaming		= false;
+	size_t width		= 0;
+	size_t height		= 0;
+	size_t stride		= 0;
+	size_t size			= 0;
+
+	std::vector<Buffer> buffers;
+	std::vector<uint32_t> spare;	// Mapped buffers that are not queued with the device
 
+	std::vector<byte> local;
+	Buffer scratch;
 
-	bool Open(int width, int height, int depth)
+
+	bool Open(size_t width, size_t height)
 	{
-		if (this->fd)
+		if (this->fd >= 0 && this->width == width && this->height == height)
 		{
 			return true;
 		}
 
-		this->fd = open("/dev/video0", O_RDWR);	//O_WRONLY ??
+		this->Close();
 
-		if (!fd)
+		this->fd = open(this->path.c_str(), O_RDWR | O_NONBLOCK);
+
+		if (this->fd < 0)
 		{
-			std::cout << "failed to open output\n";
+			std::cout << "failed to open output " << this->path << ": " << strerror(errno) << "\n";
 			return false;
 		}
 
+		v4l2_capability capability;
+		this->video	= ioctl(this->fd, VIDIOC_QUERYCAP, &capability) != -1;
+		this->width	= width;
+		this->height	= height;
+
+		if (!this->video)
+		{
+			// Not a video device, so only the raw frames are written
+			fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) & ~O_NONBLOCK);
+
+			this->stride	= this->format.Stride(width);
+			this->size		= this->format.Size(this->stride, height);
+			this->local.resize(this->size);
+
+			std::cout << this->path << " is not a video device, writing raw " << this->format.name << " frames of " << width << "x" << height << "\n";
+			return true;
+		}
+
+		v4l2_format format;
 		memset(&format, 0, sizeof(format));
 
-		format.type					= V4L2_BUF_TYPE_VIDEO_OUTPUT;
-		format.fmt.pix.width		= width;
-		format.fmt.pix.height		= height;
-		format.fmt.pix.sizeimage	= width * height * depth;
-		format.fmt.pix.pixelformat	= depth == 3 ? V4L2_PIX_FMT_RGB24 : V4L2_PIX_FMT_GREY;
-		// format.fmt.pix.field		= V4L2_FIELD_NONE;
-		// format.fmt.pix.bytesperline	= width * depth;
-		// format.fmt.pix.colorspace	= V4L2_COLORSPACE_SRGB;
+		format.type						= V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		format.fmt.pix.width			= width;
+		format.fmt.pix.height			= height;
+		format.fmt.pix.pixelformat		= this->format.fourcc;
+		format.fmt.pix.field			= V4L2_FIELD_NONE;
+		format.fmt.pix.bytesperline		= this->format.Stride(width);
+		format.fmt.pix.sizeimage		= this->format.Size(format.fmt.pix.bytesperline, height);
+		format.fmt.pix.colorspace		= this->format.colourspace;
 
 		if (ioctl(this->fd, VIDIOC_S_FMT, &format) == -1)
 		{
@@ -112,7 +213,7 @@ struct Output
 
 		bool success = format.fmt.pix.width == width
 			&& format.fmt.pix.height == height
-			&& format.fmt.pix.pixelformat == (depth == 3 ? V4L2_PIX_FMT_RGB24 : V4L2_PIX_FMT_GREY);
+			&& format.fmt.pix.pixelformat == this->format.fourcc;
 
 		if (!success)
 		{
@@ -121,17 +222,191 @@ struct Output
 			return false;
 		}
 
+		// The device may pad the rows
+		this->stride	= std::max<size_t>(format.fmt.pix.bytesperline, this->format.Stride(width));
+		this->size		= std::max<size_t>(format.fmt.pix.sizeimage, this->format.Size(this->stride, height));
+
+		if (!this->Map())
+		{
+			std::cout << "memory-mapped streaming is unavailable, writing frames instead\n";
+			fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) & ~O_NONBLOCK);
+			this->local.resize(this->size);
+		}
+
+		return true;
+	}
+
+
+	// Request and map the device buffers
+	bool Map()
+	{
+		v4l2_requestbuffers request;
+		memset(&request, 0, sizeof(request));
+
+		request.count	= BUFFERS;
+		request.type	= V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		request.memory	= V4L2_MEMORY_MMAP;
+
+		if (ioctl(this->fd, VIDIOC_REQBUFS, &request) == -1 || request.count < 2)
+		{
+			return false;
+		}
+
+		for (uint32_t i=0; i<request.count; i++)
+		{
+			v4l2_buffer buffer;
+			memset(&buffer, 0, sizeof(buffer));
+
+			buffer.index	= i;
+			buffer.type		= V4L2_BUF_TYPE_VIDEO_OUTPUT;
+			buffer.memory	= V4L2_MEMORY_MMAP;
+
+			if (ioctl(this->fd, VIDIOC_QUERYBUF, &buffer) == -1 || buffer.length < this->size)
+			{
+				this->Unmap();
+				return false;
+			}
+
+			void *data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd, buffer.m.offset);
+
+			if (data == MAP_FAILED)
+			{
+				this->Unmap();
+				return false;
+			}
+
+			this->buffers.push_back({ (byte *)data, buffer.length, i });
+			this->spare.push_back(i);
+		}
+
+		return true;
+	}
+
+
+	void Unmap()
+	{
+		if (this->streaming)
+		{
+			int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+			ioctl(this->fd, VIDIOC_STREAMOFF, &type);
+			this->streaming = false;
+		}
+
+		for (auto &b : this->buffers)
+		{
+			munmap(b.data, b.size);
+		}
+
+		if (!this->buffers.empty())
+		{
+			// Release the buffers so that the format can be changed
+			v4l2_requestbuffers request;
+			memset(&request, 0, sizeof(request));
+
+			request.type	= V4L2_BUF_TYPE_VIDEO_OUTPUT;
+			request.memory	= V4L2_MEMORY_MMAP;
+
+			ioctl(this->fd, VIDIOC_REQBUFS, &request);
+		}
+
+		this->buffers.clear();
+		this->spare.clear();
+	}
+
+
+	// The buffer that the next frame should be decoded into, or nullptr if the consumer has not
+	// returned any buffers in time (in which case the frame is dropped)
+	Buffer *Next()
+	{
+		if (this->buffers.empty())
+		{
+			this->scratch = { this->local.data(), this->local.size(), 0 };
+			return this->local.empty() ? nullptr : &this->scratch;
+		}
+
+		if (!this->spare.empty())
+		{
+			const uint32_t index = this->spare.back();
+			this->spare.pop_back();
+
+			return &this->buffers[index];
+		}
+
+		v4l2_buffer buffer;
+		memset(&buffer, 0, sizeof(buffer));
+
+		buffer.type		= V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		buffer.memory	= V4L2_MEMORY_MMAP;
+
+		pollfd p = { this->fd, POLLOUT, 0 };
+
+		if (poll(&p, 1, DEQUEUE_TIMEOUT) <= 0 || ioctl(this->fd, VIDIOC_DQBUF, &buffer) == -1 || buffer.index >= this->buffers.size())
+		{
+			return nullptr;
+		}
+
+		return &this->buffers[buffer.index];
+	}
+
+
+	// Pass a decoded frame to the device. A buffer that failed to decode is kept for the next
+	// frame rather than being queued.
+	bool Submit(Buffer *b, bool decoded)
+	{
+		if (this->buffers.empty())
+		{
+			return !decoded || write(this->fd, b->data, this->size) == (ssize_t)this->size;
+		}
+
+		if (!decoded)
+		{
+			this->spare.push_back(b->index);
+			return true;
+		}
+
+		v4l2_buffer buffer;
+		memset(&buffer, 0, sizeof(buffer));
+
+		buffer.index		= b->index;
+		buffer.type			= V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		buffer.memory		= V4L2_MEMORY_MMAP;
+		buffer.bytesused	= this->size;
+		buffer.field		= V4L2_FIELD_NONE;
+
+		if (ioctl(this->fd, VIDIOC_QBUF, &buffer) == -1)
+		{
+			std::cout << "failed to queue buffer: " << strerror(errno) << "\n";
+			this->spare.push_back(b->index);
+			return false;
+		}
+
+		if (!this->streaming)
+		{
+			int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+
+			if (ioctl(this->fd, VIDIOC_STREAMON, &type) == -1)
+			{
+				std::cout << "failed to start streaming: " << strerror(errno) << "\n";
+				return false;
+			}
+
+			this->streaming = true;
+		}
+
 		return true;
 	}
 
 
 	void Close()
 	{
-		if (this->fd)
+		if (this->fd >= 0)
 		{
+			this->Unmap();
 			close(this->fd);
-			this->fd = 0;
+			this->fd = -1;
 		}
+
+		this->local.clear();
 	}
 
 
@@ -143,6 +418,91 @@ struct Output
 };
 
 
+
+// Decodes each frame straight into the next output buffer in the required format
+class Sink : public psinc::DataHandler
+{
+	public:
+
+		Sink(Output &output) : output(output) {}
+
+
+		bool Process(bool monochrome, const bool hdr, const std::vector<byte> &data, const size_t width, const size_t height, const byte bayerMode) override
+		{
+			return this->Process(monochrome, hdr, data.data(), data.size(), width, height, bayerMode);
+		}
+
+
+		bool Process(bool monochrome, const bool hdr, const byte *data, const size_t size, const size_t width, const size_t height, const byte bayerMode) override
+		{
+			std::lock_guard lock(this->cs);
+
+			// The standard bayer decoder trims 2 pixels from each edge
+			const size_t border = monochrome ? 0 : 4;
+
+			if (width <= border || height <= border)
+			{
+				return false;
+			}
+
+			if (!this->output.Open(width - border, height - border))
+			{
+				this->unavailable = true;
+				return false;
+			}
+
+			auto buffer = this->output.Next();
+
+			if (!buffer)
+			{
+				// Dropping a frame is not a failure
+				return true;
+			}
+
+			auto &o = this->output;
+			bool decoded;
+
+			switch (o.format.fourcc)
+			{
+				case V4L2_PIX_FMT_YUYV:
+				case V4L2_PIX_FMT_NV12:
+					this->yuv.Initialise(buffer->data, buffer->size, o.format.fourcc == V4L2_PIX_FMT_YUYV ? psinc::YuvFormat::YUYV : psinc::YuvFormat::NV12, o.stride);
+					decoded = this->yuv.Process(monochrome, hdr, data, size, width, height, bayerMode);
+					break;
+
+				default:
+					this->image.Initialise(buffer->data, buffer->size, o.format.fourcc == V4L2_PIX_FMT_RGB24 ? 3 : 1, o.stride);
+					decoded = this->image.Process(monochrome, hdr, data, size, width, height, bayerMode);
+					break;
+			}
+
+			return o.Submit(buffer, decoded) && decoded;
+		}
+
+
+		void Close()
+		{
+			std::lock_guard lock(this->cs);
+
+			this->output.Close();
+		}
+
+
+		// Set if the output could not be opened
+		std::atomic<bool> unavailable = false;
+
+
+	private:
+
+		// Decoding and closing the output may happen on different threads
+		std::mutex cs;
+		Output &output;
+
+		psinc::ImageHandler<byte> image;
+		psinc::YuvHandler yuv;
+};
+
+
 struct Colour
 {
 	double red		= 1.5;
@@ -163,7 +523,7 @@ struct Parameters
 	int exposure	= 200;
 	int gain		= 3;
 	Colour colour	= presets[1];
-	// int effects		= 0;
+	int effects		= 0;
 	int selected	= 0;
 	float fps		= 0.0;
 
@@ -221,7 +581,7 @@ void update(psinc::Camera &camera, Parameters &p)
 
 
 
-bool stream = true;
+std::atomic<bool> stream = true;
 
 
 void adjust(Parameters &p, int direction, int multiplier = 1)
@@ -331,6 +691,15 @@ bool keys(Parameters &p)
 // }
 
 
+void usage(const char *name)
+{
+	std::cout << "usage: " << name << " [-d device] [-f format] [-s serial]\n";
+	std::cout << "    -d  the output device or file (default /dev/video0)\n";
+	std::cout << "    -f  the pixel format, one of yuyv, nv12, rgb or grey (default yuyv)\n";
+	std::cout << "    -s  a regex matching the serial number of the camera to connect to\n";
+}
+
+
 int main(int argc, char *argv[])
 {
 	signal(SIGINT,	[](int) { stream = false; });
@@ -339,12 +708,41 @@ int main(int argc, char *argv[])
 
 	Output output;
 	Parameters parameters;
+	std::string serial;
+
+	int option;
+
+	while ((option = getopt(argc, argv, "d:f:s:h")) != -1)
+	{
+		switch (option)
+		{
+			case 'd':	output.path	= optarg;	break;
+			case 's':	serial		= optarg;	break;
+
+			case 'f':
+			{
+				auto format = std::find_if(formats.begin(), formats.end(), [](auto &f) { return f.name == std::string(optarg); });
+
+				if (format == formats.end())
+				{
+					usage(argv[0]);
+					return 1;
+				}
+
+				output.format = *format;
+				break;
+			}
+
+			default:
+				usage(argv[0]);
+				return option == 'h' ? 0 : 1;
+		}
+	}
 
 	psinc::Camera camera;
-	emg::Image<byte, rgb> buffer;
-	psinc::ImageHandler<byte> handler(buffer);
+	Sink sink(output);
 
-	camera.Initialise("", [&](bool connected) {
+	camera.Initialise(serial, [&](bool connected) {
 		if (connected)
 		{
 			parameters.connected = true;
@@ -352,29 +750,21 @@ int main(int argc, char *argv[])
 		}
 		else
 		{
-			output.Close();
+			sink.Close();
 			parameters.connected = false;
 		}
 	});
 
 
-	camera.GrabImage(psinc::Camera::Mode::Normal, handler, [&](bool success) {
+	// Each frame is decoded straight into an output buffer by the sink
+	camera.GrabImage(psinc::Camera::Mode::Normal, sink, [&](bool success) {
 
-		if (success)
+		if (!success && sink.unavailable)
 		{
-			if (!output.fd)
-			{
-				if (!output.Open(buffer.Width(), buffer.Height(), buffer.Depth()))
-				{
-					return stream = false;
-				}
-			}
-
-			// process(parameters, output, buffer);
-			write(output.fd, buffer.Data(), buffer.Size() * 3);
+			return stream = false;
 		}
 
-		return stream;
+		return stream.load();
 	});
 
 
@@ -6,6 +6,8 @@
 #include <future>
 
 #define REFRESH_ATTEMPTS 3
+#define COUNT_DEVICE 0x13	// The 64-bit Count device (see Instrument::Initialise)
+#define COUNT_SIZE 8
 
 using std::string;
 using namespace std::chrono_literals;
@@ -13,7 +15,7 @@ using namespace std::chrono_literals;
 
 namespace psinc
 {
-	Camera::Camera() : Instrument()
+	Camera::Camera(std::unique_ptr<Transport> transport) : Instrument(std::move(transport)), batch(&this->transport)
 	{
 		this->send = {
 			0x00, 0x00, 0x00, 0x00, 0x00, 	// Header
@@ -29,53 +31,129 @@ namespace psinc
 	}
 
 
+	Camera::~Camera()
+	{
+		// Ensure that the thread is not still using members of this class
+		this->Dispose();
+	}
+
+
 	bool Camera::Main()
 	{
+		bool waiting = false;
+
 		if (this->handler)
 		{
 			bool stream = false;
 
 			if (this->callback)
 			{
-				if (this->Connected())
+				const bool connected = this->Connected();
+
+				if (connected && this->group && !this->Ready())
+				{
+					// Waiting for the transfer of the next frame, which will wake the group
+					return true;
+				}
+
+				if (connected && this->decoupled)
 				{
-					stream = this->callback(this->Capture(this->handler, this->mode, this->flash));
+					// The decode thread will invoke the handler and callback
+					Frame frame;
+					const bool success	= this->Receive(frame, this->handler->waiting, this->mode, this->flash, true);
+					stream				= this->decoder.Push(std::move(frame), success);
+				}
+				else if (connected)
+				{
+					Frame frame;
+					const bool success	= this->Capture(frame, this->handler, this->mode, this->flash, this->streaming);
+					stream				= this->callback(success, frame.metadata);
+
+					this->timing.Record(frame.timing, success);
 				}
 				else
 				{
-					stream = this->callback(false);
+					this->Flush();
 
-					// Sleep the thread to avoid ramping up processor usage if in streaming mode.
-					std::this_thread::sleep_for(100ms);
+					if (this->decoupled)
+					{
+						stream = this->decoder.Push({}, false);
+					}
+					else
+					{
+						stream = this->callback(false, {});
+						this->timing.Record({}, false);
+					}
+
+					// Sleep the thread to avoid ramping up processor usage if in streaming mode. A
+					// group cannot be held up by one camera so it waits for events instead.
+					if (this->group)
+					{
+						waiting = true;
+					}
+					else
+					{
+						std::this_thread::sleep_for(100ms);
+					}
 				}
 			}
 
-			if (!stream) this->handler = nullptr;
+			this->streaming = stream;
+
+			if (!stream)
+			{
+				// Any requests queued ahead are no longer required
+				this->Flush();
+
+				if (this->decoupled)
+				{
+					this->decoder.Stop();
+					this->decoupled = false;
+				}
+
+				this->handler = nullptr;
+				this->finished.notify_all();
+			}
 		}
 
-		return this->handler == nullptr;
+		return this->handler == nullptr || waiting;
 	}
 
 
 	bool Camera::GrabImage(Mode mode, DataHandler &handler, std::function<bool(bool)> callback)
+	{
+		return this->GrabImage(mode, handler, callback
+			? [callback](bool success, const Metadata &) { return callback(success); }
+			: std::function<bool(bool, const Metadata &)>()
+		);
+	}
+
+
+	bool Camera::GrabImage(Mode mode, DataHandler &handler, std::function<bool(bool, const Metadata &)> callback)
 	{
 		bool result = false;
 
-		// This will block until the thread is back in the wait condition
+		// This will block until the thread has released the critical section
 		this->cs.lock();
-			if (!this->handler)
+			if (!this->handler && !this->synchronised)
 			{
 				this->callback	= callback;
 				this->handler	= &handler;
 				this->mode		= mode;
 				result			= true;
 				handler.waiting	= false;
+
+				if (this->ring && callback)
+				{
+					this->decoder.Start(this->ring, this->overflow, &handler, callback, &this->timing);
+					this->decoupled = true;
+				}
 			}
 		this->cs.unlock();
 
 		if (result)
 		{
-			this->condition.notify_one();
+			this->Notify();
 		}
 
 		return result;
@@ -84,12 +162,14 @@ namespace psinc
 
 	bool Camera::Configure()
 	{
+		// Anything staged refers to the registers that are about to be replaced
+		this->batch.Discard();
+
 		this->aliases.clear();
-		this->features.clear();
+		this->features.Clear();
 		this->registers.clear();
 
-		pugi::xml_document doc;
-		auto xml				= chip::v024;
+		auto table				= &chip::table::v024;
 		const auto description	= this->CustomDevice(0xff).Read(); //this->devicePool[0xff].Read();
 
 		if (description.size())
@@ -100,71 +180,91 @@ namespace psinc
 			{
 				switch (description[1])
 				{
-					case 0x00:	xml = chip::v024;	break;
-					case 0x01:	xml = chip::mt9;	break;
-					default: 						break;
+					case 0x00:	table = &chip::table::v024;	break;
+					case 0x01:	table = &chip::table::mt9;	break;
+					default: 								break;
 				}
 
 				this->monochrome = (description[2] & 0x01) == 0;
 			}
 		}
 
-		return doc.load(xml) && this->Configure(doc.child("camera")) && this->RefreshRegisters();
+		return this->Configure(*table) && this->RefreshRegisters();
 	}
 
 
-	bool Camera::Configure(pugi::xml_node xml)
+	bool Camera::Configure(const chip::Description &description)
 	{
-		this->chip			= xml.attribute("chip").as_string();
-		this->contextCount	= xml.attribute("contexts").as_int(1);
-		this->hdr			= xml.attribute("hdr").as_bool();
-		this->sizeByRange	= xml.attribute("sizeByRange").as_bool();
-		this->addressSize	= xml.attribute("addressSize").as_int(1);
-		this->bayerMode		= xml.attribute("bayer").as_int(0);
-
-		for (auto &child : xml.children("register"))
+		this->chip			= description.chip;
+		this->contextCount	= description.contexts;
+		this->hdr			= description.hdr;
+		this->sizeByRange	= description.sizeByRange;
+		this->addressSize	= description.addressSize;
+		this->bayerMode		= description.bayer;
+
+		std::vector<int> addresses(description.registers, description.registers + description.registerCount);
+		std::sort(addresses.begin(), addresses.end());
+		addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+
+		// The registers are held contiguously in address order and must be complete before
+		// any features are created since they refer to their parent register.
+		this->registers.reserve(addresses.size());
+
+		for (auto address : addresses)
 		{
-			int address = strtol(child.attribute("address").as_string("0x00"), nullptr, 0);
-
-			this->registers[address] = { child, &this->transport, this->addressSize };
+			this->registers.emplace_back(address, &this->transport, this->addressSize, &this->batch);
 		}
 
-		// Two separate loops, because the population of the register list involves
-		// growing memory and therefore any references taken for the features would
-		// become invalid.
-		for (auto &child : xml.children("register"))
+		std::vector<Features::Entry> features;
+		features.reserve(description.featureCount);
+
+		for (size_t i=0; i<description.featureCount; i++)
 		{
-			int address = strtol(child.attribute("address").as_string("0x00"), nullptr, 0);
+			auto &feature	= description.features[i];
+			auto parent		= std::lower_bound(addresses.begin(), addresses.end(), feature.address) - addresses.begin();
 
-			for (auto &feature : child.children("feature"))
-			{
-				this->features[feature.attribute("name").as_string()] = { feature, &this->registers[address] };
-			}
+			features.emplace_back(feature.name, Feature(feature, &this->registers[parent]));
 		}
 
-		for (auto &child : xml.children("alias"))
+		this->features.Assign(std::move(features));
+
+		for (size_t i=0; i<description.aliasCount; i++)
 		{
-			string key		= child.attribute("name").as_string();
-			string feature	= child.attribute("feature").as_string();
-			int context		= child.attribute("context").as_int(-1);
+			auto &alias			= description.aliases[i];
+			const auto feature	= this->features.Find(alias.feature);
+			const int context	= alias.context;
 
-			if (!key.empty() && !feature.empty() && this->features.count(feature))
+			if (!alias.name.empty() && feature != Features::INVALID)
 			{
 				if (context < 0)
 				{
 					// If context hasn't been assigned then it should be copied across all contexts
-					for (int i=0; i<this->contextCount; i++)
+					for (int c=0; c<this->contextCount; c++)
 					{
-						this->aliases[i].Set(key, this->features[feature]);
+						this->aliases[c].Set(alias.name, this->features[feature]);
 					}
 				}
 				else if (context < this->contextCount)
 				{
-					this->aliases[context].Set(key, this->features[feature]);
+					this->aliases[context].Set(alias.name, this->features[feature]);
 				}
 			}
 		}
 
+		// Resolve the channel gains (where supported) so that they can be set without a lookup
+		for (size_t c=0; c<this->gains.size(); c++)
+		{
+			static const char *channels[] = { "red", "green1", "green2", "blue" };
+
+			for (size_t i=0; i<this->gains[c].size(); i++)
+			{
+				const string suffix = c ? "_cb" : "";
+
+				this->gains[c][i].integer	= this->features.Find(channels[i] + string("_gain_int") + suffix);
+				this->gains[c][i].fraction	= this->features.Find(channels[i] + string("_gain_frac") + suffix);
+			}
+		}
+
 		return this->features.size();
 	}
 
@@ -173,8 +273,7 @@ namespace psinc
 	{
 		std::atomic<bool> waiting(false);
 
-		byte minPage = 255;
-		byte maxPage = 0;
+		std::vector<byte> pages;
 		std::vector<byte> data(512);
 		std::vector<byte> command = {
 			0x00, 0x00, 0x00, 0x00, 0x00,							// Header
@@ -182,13 +281,16 @@ namespace psinc
 			0xff 													// Terminator
 		};
 
+		// Only the pages that actually contain registers are requested
 		for (auto &r : this->registers)
 		{
-			minPage = std::min(minPage, r.second.Page());
-			maxPage = std::max(maxPage, r.second.Page());
+			pages.push_back(r.Page());
 		}
 
-		for (byte page = minPage; page <= maxPage; page++)
+		std::sort(pages.begin(), pages.end());
+		pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+		for (auto page : pages)
 		{
 			command[6] = page;
 
@@ -198,7 +300,7 @@ namespace psinc
 				{
 					for (auto &r : this->registers)
 					{
-						if (r.second.Page() == page) r.second.Refresh(data);
+						if (r.Page() == page) r.Refresh(data);
 					}
 
 					emg::Log::Info("%u: Successfully refreshed registers for page %d", emg::Timestamp::LogTime(), page);
@@ -220,6 +322,52 @@ namespace psinc
 	}
 
 
+	void Camera::BeginBatch()
+	{
+		this->batch.Begin();
+	}
+
+
+	bool Camera::CommitBatch()
+	{
+		return this->batch.Commit();
+	}
+
+
+	void Camera::DiscardBatch()
+	{
+		this->batch.Discard();
+	}
+
+
+	bool Camera::SetShadowing(bool enabled)
+	{
+		this->batch.Shadow(enabled);
+
+		return enabled || this->batch.Flush();
+	}
+
+
+	bool Camera::CommitRegisters()
+	{
+		return this->batch.Flush();
+	}
+
+
+	bool Camera::SetVolatile(int address, bool enabled)
+	{
+		auto item = std::lower_bound(this->registers.begin(), this->registers.end(), address, [](auto &r, int a) { return r.Address() < a; });
+
+		if (item != this->registers.end() && item->Address() == address)
+		{
+			item->SetVolatile(enabled);
+			return true;
+		}
+
+		return false;
+	}
+
+
 	bool Camera::SetRegister(int address, int value)
 	{
 		std::atomic<bool> waiting(false);
@@ -266,7 +414,23 @@ namespace psinc
 
 	bool Camera::Grabbing()
 	{
-		return this->handler;
+		return this->handler || this->synchronised;
+	}
+
+
+	bool Camera::AwaitGrab(int timeout)
+	{
+		std::unique_lock lock(this->cs);
+
+		auto done = [&] { return this->handler == nullptr; };
+
+		if (timeout < 0)
+		{
+			this->finished.wait(lock, done);
+			return true;
+		}
+
+		return this->finished.wait_for(lock, std::chrono::milliseconds(timeout), done);
 	}
 
 
@@ -276,6 +440,80 @@ namespace psinc
 	}
 
 
+	void Camera::SetPipeline(byte depth, byte transfers)
+	{
+		// Wait for the thread to be idle so that nothing is queued
+		std::lock_guard lock(this->cs);
+
+		this->pipeline = depth;
+		this->transport.SetTransfers(transfers);
+	}
+
+
+	void Camera::SetDecoding(size_t capacity, Decoder::Overflow overflow)
+	{
+		// Takes effect from the next call to GrabImage
+		std::lock_guard lock(this->cs);
+
+		this->ring		= capacity;
+		this->overflow	= overflow;
+	}
+
+
+	void Camera::SetCountSampling(bool enabled)
+	{
+		std::lock_guard lock(this->window);
+
+		this->counting = enabled;
+
+		// The count is read by a command that follows the capture in the same packet
+		// so that it arrives immediately after the image data, although as a separate
+		// packet (see Transport::Queue). Anything that follows the capture command is
+		// rebuilt so that disabling restores the terminator.
+		this->send.resize(10);
+
+		if (enabled)
+		{
+			this->send.insert(this->send.end(), { Commands::ReadBlock, COUNT_DEVICE, COUNT_SIZE, 0x00, 0x00 });
+		}
+
+		this->send.push_back(0xff);
+	}
+
+
+	void Camera::SetRecording(std::shared_ptr<Recorder> recorder)
+	{
+		std::lock_guard lock(this->cs);
+
+		this->recorder = recorder;
+	}
+
+
+	Decoder::Statistics Camera::DecodeStatistics()
+	{
+		return this->decoder.Stats();
+	}
+
+
+	Timing::Statistics Camera::TimingStatistics()
+	{
+		return this->timing.Stats();
+	}
+
+
+	void Camera::ResetTiming()
+	{
+		this->timing.Reset();
+	}
+
+
+	void Camera::Flush()
+	{
+		this->transport.Flush();
+		this->pending = {};
+	}
+
+
 	bool Camera::SetContext(byte context)
 	{
 		if (context < this->contextCount && this->aliases[0].context)
@@ -299,6 +537,8 @@ namespace psinc
 
 		std::lock_guard lock(this->window);
 
+		this->batch.Begin();
+
 		auto &alias			= this->aliases[0];
 		const int exposure	= std::lrint(properties.exposure * MAX_EXPOSURE);
 		const int gain		= std::lrint(properties.gain * std::max(1, alias.gain->Maximum() - alias.gain->Minimum()));
@@ -307,23 +547,28 @@ namespace psinc
 			&& alias.gain->Set(alias.gain->Minimum() + gain);
 
 		// Only the mt9 supports channel gains
-		if (this->chip == "mt9")
+		if (context < this->gains.size() && this->gains[context][0].integer != Features::INVALID)
 		{
-			static auto set = [](auto &features, const string &name, const char *suffix, const double value) {
-				return features[name + "_gain_int" + suffix].Set((int)value)
-					&& features[name + "_gain_frac" + suffix].Set((int)((value - (int)value) / 0.03125));
+			auto set = [&](const ChannelGain &gain, const double value) {
+				return this->features[gain.integer].Set((int)value)
+					&& this->features[gain.fraction].Set((int)((value - (int)value) / 0.03125));
 			};
 
+			auto &gains = this->gains[context];
+
 			result =
-				   set(this->features, "red",		context ? "_cb" : "", properties.red)
-				&& set(this->features, "green1",	context ? "_cb" : "", properties.green)
-				&& set(this->features, "green2",	context ? "_cb" : "", properties.green)
-				&& set(this->features, "blue",		context ? "_cb" : "", properties.blue);
+				   set(gains[0], properties.red)
+				&& set(gains[1], properties.green)
+				&& set(gains[2], properties.green)
+				&& set(gains[3], properties.blue);
 		}
 
 		this->SetFlash(properties.flash);
 
-		return result;
+		// Anything that was staged before a failure is still sent
+		const bool committed = this->batch.Commit();
+
+		return result && committed;
 	}
 
 
@@ -336,6 +581,8 @@ namespace psinc
 
 		std::lock_guard lock(this->window);
 
+		this->batch.Begin();
+
 		auto &alias	= this->aliases[context];
 		int mx		= alias.columnStart->Minimum();
 		int my		= alias.rowStart->Minimum();
@@ -358,14 +605,26 @@ namespace psinc
 			else			result = result && alias.height->Set(height);
 		}
 
-		return result;
+		// Anything that was staged before a failure is still sent
+		const bool committed = this->batch.Commit();
+
+		return result && committed;
 	}
 
 
-	bool Camera::Capture(DataHandler *handler, Mode mode, int flash)
+	bool Camera::Capture(Frame &frame, DataHandler *handler, Mode mode, int flash, bool streaming)
 	{
-		std::lock_guard lock(this->window);
+		const bool result = this->Receive(frame, handler->waiting, mode, flash, streaming) && frame.Process(*handler);
 
+		// Return the buffer to the pool before the callback
+		frame.data = nullptr;
+
+		return result;
+	}
+
+
+	size_t Camera::Describe(Frame &frame, Mode mode, int flash)
+	{
 		int width	= 0;
 		int height	= 0;
 		auto &alias	= this->aliases[context];
@@ -381,30 +640,160 @@ namespace psinc
 			height	= alias.height->Get();
 		}
 
-		const size_t size = width * height * (this->hdr ? 2 : 1);
+		const size_t size		= width * height * (this->hdr ? 2 : 1);
+		const size_t trailer	= this->counting ? COUNT_SIZE : 0;
+
+		if (!size)
+		{
+			return 0;
+		}
+
+		switch (mode)
+		{
+			case Mode::Normal:			this->send[5] = Commands::Capture;				break;
+			case Mode::Master:			this->send[5] = Commands::MasterCapture;		break;
+			case Mode::SlaveRising:		this->send[5] = Commands::SlaveCaptureRising;	break;
+			case Mode::SlaveFalling:	this->send[5] = Commands::SlaveCaptureFalling;	break;
+		}
+
+		this->send[6] = flash;
+		this->send[7] = (byte)(size & 0xff);
+		this->send[8] = (byte)((size >> 8) & 0xff);
+		this->send[9] = (byte)((size >> 16) & 0xff);
+
+		frame						= {};
+		frame.width					= width;
+		frame.height				= height;
+		frame.monochrome			= this->monochrome;
+		frame.hdr					= this->hdr;
+		frame.bayerMode				= this->bayerMode;
+		frame.trailer				= trailer;
+		frame.metadata.context		= this->context;
+		frame.metadata.exposure		= alias.exposure->Get();
+		frame.metadata.gain			= alias.gain->Get();
+
+		// Any changes made to the shadow registers since the last frame was requested are
+		// sent ahead of the capture command so that they take effect between frames without
+		// a separate round trip. The caller completes them once the packet has been sent.
+		this->packet = this->send;
+		this->batch.Carry(this->packet);
+
+		return size + trailer;
+	}
+
+
+	bool Camera::Request(std::atomic<bool> &waiting, Mode mode, int flash, bool streaming)
+	{
+		// Keep requests queued with the camera so that the next frame is being captured
+		// whilst the current one is received and processed.
+		const size_t depth = streaming ? this->pipeline : 1;
+
+		Frame next;
+		size_t size = 0;
+
+		while (this->pending.size() < depth && (size = this->Describe(next, mode, flash)))
+		{
+			const bool queued = this->transport.Queue(this->packet, size, waiting, next.trailer);
+
+			this->batch.Carried(queued);
+
+			if (!queued)
+			{
+				break;
+			}
+
+			next.metadata.sequence = this->sequence++;
+			this->pending.push(std::move(next));
+		}
+
+		return !this->pending.empty();
+	}
+
 
-		if (size)
+	bool Camera::Ready()
+	{
+		if (!this->pipeline || !this->handler)
 		{
-			this->receive.resize(size);
+			// A synchronous capture cannot be checked without blocking
+			return true;
+		}
 
-			switch (mode)
+		std::lock_guard lock(this->window);
+
+		return !this->Request(this->handler->waiting, this->mode, this->flash, this->decoupled || this->streaming) || this->transport.Ready();
+	}
+
+
+	bool Camera::Receive(Frame &frame, std::atomic<bool> &waiting, Mode mode, int flash, bool streaming)
+	{
+		std::lock_guard lock(this->window);
+
+		if (this->pipeline)
+		{
+			if (!this->Request(waiting, mode, flash, streaming))
 			{
-				case Mode::Normal:			this->send[5] = Commands::Capture;				break;
-				case Mode::Master:			this->send[5] = Commands::MasterCapture;		break;
-				case Mode::SlaveRising:		this->send[5] = Commands::SlaveCaptureRising;	break;
-				case Mode::SlaveFalling:	this->send[5] = Commands::SlaveCaptureFalling;	break;
+				return false;
 			}
 
-			this->send[6] = flash;
-			this->send[7] = (byte)(size & 0xff);
-			this->send[8] = (byte)((size >> 8) & 0xff);
-			this->send[9] = (byte)((size >> 16) & 0xff);
+			frame = std::move(this->pending.front());
+			this->pending.pop();
 
-			return
-				this->transport.Transfer(&this->send, &this->receive, handler->waiting) &&
-				handler->Process(this->monochrome, this->hdr, this->receive, width, height, this->bayerMode);
+			if (!this->transport.Collect(frame.data, &frame.timing))
+			{
+				// Following frames can no longer be trusted
+				this->Flush();
+				return false;
+			}
 		}
+		else
+		{
+			const size_t size = this->Describe(frame, mode, flash);
 
-		return false;
+			if (!size)
+			{
+				return false;
+			}
+
+			// The buffer is on loan from the transport pool until the frame is released
+			frame.metadata.sequence	= this->sequence++;
+			frame.data				= this->transport.Lease(size);
+
+			const bool sent = this->transport.Transfer(&this->packet, *frame.data, waiting, &frame.timing, frame.trailer);
+
+			this->batch.Carried(sent);
+
+			if (!sent)
+			{
+				return false;
+			}
+		}
+
+		this->Finish(frame);
+
+		return true;
+	}
+
+
+	void Camera::Finish(Frame &frame)
+	{
+		frame.metadata.timestamp = frame.timing.received;
+
+		if (frame.trailer && frame.data && frame.data->Size() >= frame.trailer)
+		{
+			// The count follows the image data (little-endian)
+			const byte *count = frame.data->Data() + frame.data->Size() - frame.trailer;
+
+			for (size_t i=0; i<frame.trailer; i++)
+			{
+				frame.metadata.count |= (uint64_t)count[i] << (8 * i);
+			}
+
+			frame.metadata.counted = true;
+		}
+
+		if (this->recorder)
+		{
+			this->recorder->Write(frame);
+		}
 	}
 }
@@ -0,0 +1,450 @@
+#include "psinc/CameraGroup.h"
+#include "psinc/UsbTransport.h"
+#include "psinc/handlers/helpers/WorkerPool.hpp"
+#include <emergent/logger/Logger.hpp>
+#include <algorithm>
+
+#define ARMING_TIMEOUT 1000	// ms
+
+using std::string;
+
+
+namespace psinc
+{
+	CameraGroup::CameraGroup(byte pipeline, size_t decoding) :
+		context(std::make_shared<UsbContext>()),
+		pipeline(pipeline),
+		decoding(decoding)
+	{
+		this->_thread = std::thread(&CameraGroup::Entry, this);
+	}
+
+
+	CameraGroup::~CameraGroup()
+	{
+		this->run = false;
+		this->Notify();
+		this->_thread.join();
+
+		// The cameras must be released before the context that they share
+		this->cameras.clear();
+	}
+
+
+	Camera &CameraGroup::Add(string serial, std::function<void(bool)> onConnection, int timeout, const std::set<uint16_t> &vendors)
+	{
+		return this->Insert(std::make_unique<UsbTransport>(this->context), false, serial, onConnection, timeout, vendors);
+	}
+
+
+	Camera &CameraGroup::Add(std::unique_ptr<Transport> transport, string serial, std::function<void(bool)> onConnection, int timeout, const std::set<uint16_t> &vendors)
+	{
+		return this->Insert(std::move(transport), true, serial, onConnection, timeout, vendors);
+	}
+
+
+	Camera &CameraGroup::Insert(std::unique_ptr<Transport> transport, bool external, string serial, std::function<void(bool)> onConnection, int timeout, const std::set<uint16_t> &vendors)
+	{
+		auto camera		= std::make_unique<Camera>(std::move(transport));
+		auto &result	= *camera;
+
+		// Must be assigned before initialising so that the camera does not start its own thread
+		camera->group = this;
+
+		camera->SetPipeline(this->pipeline);
+		camera->SetDecoding(this->decoding);
+		camera->Initialise(serial, onConnection, timeout, vendors);
+
+		{
+			std::lock_guard lock(this->cs);
+
+			this->cameras.push_back(std::move(camera));
+		}
+
+		if (external)
+		{
+			this->external++;
+		}
+
+		this->added = true;
+		this->Notify();
+
+		return result;
+	}
+
+
+	size_t CameraGroup::Size()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->cameras.size();
+	}
+
+
+	Camera &CameraGroup::operator[](size_t index)
+	{
+		std::lock_guard lock(this->cs);
+
+		return *this->cameras.at(index);
+	}
+
+
+	void CameraGroup::Notify()
+	{
+		this->woken = true;
+
+		if (this->context)
+		{
+			this->context->Interrupt();
+		}
+	}
+
+
+	void CameraGroup::Entry()
+	{
+		std::vector<Camera *> cameras;
+
+		while (this->run)
+		{
+			if (this->added.exchange(false))
+			{
+				std::lock_guard lock(this->cs);
+
+				cameras.clear();
+
+				for (auto &c : this->cameras)
+				{
+					cameras.push_back(c.get());
+				}
+			}
+
+			bool idle		= true;
+			bool grabbing	= false;
+
+			for (auto camera : cameras)
+			{
+				std::lock_guard lock(camera->cs);
+
+				idle		= camera->Step() && idle;
+				grabbing	= grabbing || camera->Grabbing();	// Includes a synchronised grab
+			}
+
+			Synchronised *sync = nullptr;
+
+			{
+				std::lock_guard lock(this->cs);
+				sync = this->sync.get();
+			}
+
+			if (sync)
+			{
+				idle = this->Synchronise(*sync) && idle;
+			}
+
+			if (idle)
+			{
+				this->Wait(grabbing);
+			}
+		}
+	}
+
+
+	bool CameraGroup::GrabSynchronised(const Member &master, const std::vector<Member> &slaves, std::function<bool(bool, const std::vector<Metadata> &)> callback, Camera::Mode edge)
+	{
+		if (!callback || (edge != Camera::Mode::SlaveRising && edge != Camera::Mode::SlaveFalling))
+		{
+			return false;
+		}
+
+		auto sync = std::make_unique<Synchronised>();
+		sync->callback = callback;
+
+		std::lock_guard lock(this->cs);
+
+		if (this->sync)
+		{
+			return false;
+		}
+
+		for (auto &m : slaves)
+		{
+			auto &participant	= sync->members.emplace_back();
+			participant.camera	= m.camera;
+			participant.handler	= m.handler;
+			participant.mode	= edge;
+		}
+
+		auto &participant	= sync->members.emplace_front();
+		participant.camera	= master.camera;
+		participant.handler	= master.handler;
+		participant.mode	= Camera::Mode::Master;
+
+		for (auto &p : sync->members)
+		{
+			const bool member = std::any_of(this->cameras.begin(), this->cameras.end(), [&](auto &c) { return c.get() == p.camera; });
+			const bool unique = std::count_if(sync->members.begin(), sync->members.end(), [&](auto &q) { return q.camera == p.camera; }) == 1;
+
+			if (!member || !unique || !p.handler)
+			{
+				return false;
+			}
+		}
+
+		// Reserve the cameras so that they cannot be grabbed individually
+		size_t reserved = 0;
+
+		for (auto &p : sync->members)
+		{
+			std::lock_guard guard(p.camera->cs);
+
+			if (p.camera->handler || p.camera->synchronised)
+			{
+				break;
+			}
+
+			p.camera->synchronised = true;
+			reserved++;
+		}
+
+		if (reserved < sync->members.size())
+		{
+			for (size_t i=0; i<reserved; i++)
+			{
+				sync->members[i].camera->synchronised = false;
+			}
+
+			return false;
+		}
+
+		this->sync = std::move(sync);
+		this->Notify();
+
+		return true;
+	}
+
+
+	bool CameraGroup::Synchronising()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->sync != nullptr;
+	}
+
+
+	bool CameraGroup::Synchronise(Synchronised &sync)
+	{
+		bool progress	= false;
+		bool failed		= false;
+		auto &master	= sync.members.front();
+		auto slaves		= [&](auto predicate) { return std::all_of(sync.members.begin() + 1, sync.members.end(), predicate); };
+
+		// Arm the slaves, keeping one cycle armed ahead whilst streaming so that the next can be
+		// triggered as soon as the camera is ready rather than once the callback has returned.
+		const uint64_t ahead = sync.streaming ? 2 : 1;
+
+		while (!failed && !sync.stopping && sync.requested == sync.triggered && sync.requested < sync.collected + ahead)
+		{
+			const int cycle = sync.requested % 2;
+
+			failed		= !slaves([&](auto &p) { return this->Request(p, p.armed[cycle], p.mode); });
+			sync.since	= std::chrono::steady_clock::now();
+			progress	= true;
+
+			sync.requested++;
+		}
+
+		// Trigger the master once every slave is waiting for the sync signal. A slave that has been
+		// armed ahead has only been sent the request and may still be exposing or transferring the
+		// previous frame, in which case it would miss the sync pulse, so a cycle is not triggered
+		// until the slaves have delivered their frames for the cycle before it.
+		if (!failed && sync.triggered < sync.requested)
+		{
+			const int cycle		= sync.triggered % 2;
+			const bool previous	= sync.collected == sync.triggered || slaves([](auto &p) { return p.camera->transport.Ready(); });
+
+			if (!previous)
+			{
+				// The arming timeout only applies once the previous frames have arrived, since the
+				// transfers for those have their own timeout
+				sync.since = std::chrono::steady_clock::now();
+			}
+			else if (slaves([&](auto &p) { return p.armed[cycle].load(); }))
+			{
+				failed		= !this->Request(master, master.armed[cycle], Camera::Mode::Master);
+				sync.since	= std::chrono::steady_clock::now();
+				progress	= true;
+
+				sync.triggered++;
+			}
+			else if (std::chrono::steady_clock::now() - sync.since > std::chrono::milliseconds(ARMING_TIMEOUT))
+			{
+				emg::Log::Error("%u: Timed out waiting for the slaves to be ready for a synchronised capture", emg::Timestamp::LogTime());
+				failed = true;
+			}
+		}
+
+		// Collect a cycle once every frame has arrived
+		if (!failed && sync.collected < sync.triggered && std::all_of(sync.members.begin(), sync.members.end(), [](auto &p) { return p.camera->transport.Ready(); }))
+		{
+			const size_t count = sync.members.size();
+
+			std::vector<Frame> frames(count);
+			std::vector<char> received(count, 0);
+			std::vector<char> decoded(count, 0);
+			std::vector<Metadata> metadata(count);
+
+			for (size_t i=0; i<count; i++)
+			{
+				received[i] = this->Receive(sync.members[i], frames[i]);
+			}
+
+			sync.collected++;
+			progress	= true;
+			failed		= std::count(received.begin(), received.end(), 0);
+
+			// A failure is reported once the remaining requests have been discarded (below)
+			if (!failed && !sync.stopping)
+			{
+				WorkerPool::Shared().Parallel(count, [&](size_t i) {
+					decoded[i]		= received[i] && frames[i].Process(*sync.members[i].handler);
+					frames[i].data	= nullptr;	// Return the buffer to the pool before the callback
+				});
+
+				for (size_t i=0; i<count; i++)
+				{
+					metadata[i] = frames[i].metadata;
+				}
+
+				const bool success = std::count(decoded.begin(), decoded.end(), 0) == 0;
+
+				sync.streaming	= sync.callback(success, metadata);
+				sync.stopping	= !sync.streaming;
+
+				for (size_t i=0; i<count; i++)
+				{
+					sync.members[i].camera->timing.Record(frames[i].timing, decoded[i]);
+				}
+			}
+		}
+
+		if (failed)
+		{
+			this->Abort(sync);
+
+			if (!sync.stopping)
+			{
+				sync.streaming	= sync.callback(false, std::vector<Metadata>(sync.members.size()));
+				sync.stopping	= !sync.streaming;
+			}
+		}
+
+		if (sync.stopping && sync.collected == sync.requested)
+		{
+			for (auto &p : sync.members)
+			{
+				p.camera->synchronised = false;
+			}
+
+			std::lock_guard lock(this->cs);
+			this->sync = nullptr;
+
+			return true;
+		}
+
+		// Whilst waiting the thread is woken by the transfers completing
+		return !progress || failed;
+	}
+
+
+	bool CameraGroup::Request(Synchronised::Participant &participant, std::atomic<bool> &armed, Camera::Mode mode)
+	{
+		auto camera = participant.camera;
+
+		std::lock_guard lock(camera->cs);
+		std::lock_guard guard(camera->window);
+
+		Frame frame;
+		const size_t size = camera->Connected() ? camera->Describe(frame, mode, camera->flash) : 0;
+
+		armed = false;
+
+		if (!size)
+		{
+			return false;
+		}
+
+		const bool queued = camera->transport.Queue(camera->packet, size, armed, frame.trailer);
+
+		camera->batch.Carried(queued);
+
+		if (!queued)
+		{
+			return false;
+		}
+
+		frame.metadata.sequence = camera->sequence++;
+		participant.frames.push_back(std::move(frame));
+
+		return true;
+	}
+
+
+	bool CameraGroup::Receive(Synchronised::Participant &participant, Frame &frame)
+	{
+		auto camera = participant.camera;
+
+		std::lock_guard lock(camera->cs);
+
+		if (participant.frames.empty())
+		{
+			return false;
+		}
+
+		frame = std::move(participant.frames.front());
+		participant.frames.pop_front();
+
+		if (!camera->transport.Collect(frame.data, &frame.timing))
+		{
+			return false;
+		}
+
+		camera->Finish(frame);
+
+		return true;
+	}
+
+
+	void CameraGroup::Abort(Synchronised &sync)
+	{
+		for (auto &p : sync.members)
+		{
+			std::lock_guard lock(p.camera->cs);
+
+			// Armed slaves may never be triggered so, rather than waiting for the transfers to
+			// time out, they are cancelled and left to complete in the background
+			p.camera->transport.Cancel();
+			p.frames.clear();
+		}
+
+		sync.requested	= 0;
+		sync.triggered	= 0;
+		sync.collected	= 0;
+	}
+
+
+	void CameraGroup::Wait(bool grabbing)
+	{
+		if (this->woken.exchange(false))
+		{
+			return;
+		}
+
+		// Returns as soon as any transfer completes, a device arrives or leaves, or the wait is
+		// interrupted by Notify. The shared context must always be serviced here since nothing
+		// else handles its events, but cameras on other transports cannot wake the thread when
+		// their data arrives so they are polled whilst grabbing.
+		this->context->Handle(this->external && grabbing ? 1 : 50);
+
+		this->woken = false;
+	}
+}
@@ -0,0 +1,163 @@
+#include "psinc/Decoder.h"
+
+
+namespace psinc
+{
+	Decoder::~Decoder()
+	{
+		{
+			std::lock_guard lock(this->cs);
+			this->run		= false;
+			this->running	= false;
+			this->ring.clear();
+		}
+
+		this->available.notify_all();
+		this->space.notify_all();
+
+		if (this->_thread.joinable())
+		{
+			this->_thread.join();
+		}
+	}
+
+
+	void Decoder::Start(size_t capacity, Overflow overflow, DataHandler *handler, std::function<bool(bool, const Metadata &)> callback, Timing *timing)
+	{
+		this->Stop();
+
+		std::lock_guard lock(this->cs);
+
+		this->capacity		= std::max<size_t>(capacity, 1);
+		this->overflow		= overflow;
+		this->handler		= handler;
+		this->callback		= callback;
+		this->timing		= timing;
+		this->statistics	= {};
+		this->running		= true;
+
+		if (!this->run)
+		{
+			this->run		= true;
+			this->_thread	= std::thread(&Decoder::Entry, this);
+		}
+	}
+
+
+	bool Decoder::Push(Frame &&frame, bool success)
+	{
+		std::unique_lock lock(this->cs);
+
+		if (this->overflow == Overflow::Block)
+		{
+			this->space.wait(lock, [&] { return !this->running || this->ring.size() < this->capacity; });
+		}
+
+		if (!this->running)
+		{
+			return false;
+		}
+
+		if (this->ring.size() >= this->capacity)
+		{
+			this->ring.pop_front();
+			this->statistics.dropped++;
+		}
+
+		this->ring.push_back({ std::move(frame), success });
+		this->statistics.captured++;
+
+		lock.unlock();
+		this->available.notify_one();
+
+		return true;
+	}
+
+
+	void Decoder::Stop()
+	{
+		std::unique_lock lock(this->cs);
+
+		this->running = false;
+		this->ring.clear();
+
+		// Returning leases to the pool in the ring is fine, but the handler
+		// must not be in use once this returns.
+		this->space.notify_all();
+		this->space.wait(lock, [&] { return !this->busy; });
+
+		this->handler	= nullptr;
+		this->callback	= nullptr;
+		this->timing	= nullptr;
+	}
+
+
+	bool Decoder::Running()
+	{
+		std::lock_guard lock(this->cs);
+		return this->running;
+	}
+
+
+	Decoder::Statistics Decoder::Stats()
+	{
+		std::lock_guard lock(this->cs);
+		return this->statistics;
+	}
+
+
+	void Decoder::Entry()
+	{
+		std::unique_lock lock(this->cs);
+
+		while (this->run)
+		{
+			this->available.wait(lock, [&] { return !this->run || (this->running && this->ring.size()); });
+
+			if (!this->run)
+			{
+				break;
+			}
+
+			auto item	= std::move(this->ring.front());
+			this->busy	= true;
+			this->ring.pop_front();
+
+			// A newer frame has already arrived so this one is behind
+			if (this->ring.size())
+			{
+				this->statistics.late++;
+			}
+
+			// The handler, callback and timing cannot change whilst busy (see Stop)
+			lock.unlock();
+			this->space.notify_one();
+
+				const bool result	= item.success && this->handler && item.frame.Process(*this->handler);
+				item.frame.data		= nullptr;	// Return the buffer to the pool before the callback
+				const bool stream	= this->callback ? this->callback(result, item.frame.metadata) : false;
+
+				if (this->timing)
+				{
+					this->timing->Record(item.frame.timing, result);
+				}
+
+			lock.lock();
+
+			this->busy = false;
+
+			if (result)
+			{
+				this->statistics.decoded++;
+			}
+
+			if (!stream && this->running)
+			{
+				this->running = false;
+				this->ring.clear();
+			}
+
+			this->space.notify_all();
+		}
+	}
+}
@@ -1,4 +1,6 @@
 #include "psinc/Instrument.h"
+#include "psinc/CameraGroup.h"
+#include "psinc/UsbTransport.h"
 #include "psinc/driver/Commands.h"
 
 #include <emergent/logger/Logger.hpp>
@@ -14,6 +16,13 @@ namespace psinc
 	const std::set<uint16_t> Instrument::Vendors::PSI = { 0x2dd8 };
 
 
+	Instrument::Instrument(std::unique_ptr<Transport> transport) :
+		link(transport ? std::move(transport) : std::make_unique<UsbTransport>()),
+		transport(*this->link)
+	{
+	}
+
+
 	Instrument::~Instrument()
 	{
 		this->Dispose();
@@ -28,7 +37,7 @@ namespace psinc
 			this->initialised	= false;
 
 			// Notify the thread to wake so that it can then exit
-			this->condition.notify_one();
+			this->transport.Interrupt();
 			this->_thread.join();
 		}
 	}
@@ -95,9 +104,14 @@ namespace psinc
 
 		if (!this->initialised)
 		{
-			this->run			= true;
-			this->_thread		= std::thread(&Instrument::Entry, this);
-			this->initialised	= true;
+			// An instrument that belongs to a group is driven by the group thread instead
+			if (!this->group)
+			{
+				this->run		= true;
+				this->_thread	= std::thread(&Instrument::Entry, this);
+			}
+
+			this->initialised = true;
 		}
 	}
 
@@ -132,23 +146,54 @@ namespace psinc
 
 		while (this->run)
 		{
-			this->transport.Poll(0);
+			const bool idle = this->Step();
+
+			// Release the critical section so that other threads get a chance to use the instrument
+			lock.unlock();
 
-			if (this->transport.Connected() && !this->configured)
+			if (idle)
 			{
-				this->configured = this->Configure();
+				// Sleep until the transport has events (transfers completing, hotplugging) or the
+				// thread is notified. The timeout only allows for polling legacy devices.
+				this->transport.Wait(50);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+
+			lock.lock();
+		}
+	}
+
+
+	bool Instrument::Step()
+	{
+		this->transport.Poll(0);
+
+		if (this->transport.Connected() && !this->configured)
+		{
+			this->configured = this->Configure();
 
-				if (this->onConnection && this->configured)
-				{
-					this->onConnection(true);
-				}
+			if (this->onConnection && this->configured)
+			{
+				this->onConnection(true);
 			}
+		}
+
+		return this->Main();
+	}
+
 
-			// if (this->Main())
-			// {
-			// 	this->condition.wait_for(lock, 50ms);
-			// }
-			this->condition.wait_for(lock, this->Main() ? 50ms : 10us);
+	void Instrument::Notify()
+	{
+		if (this->group)
+		{
+			this->group->Notify();
+		}
+		else
+		{
+			this->transport.Interrupt();
 		}
 	}
 
@@ -214,4 +259,10 @@ namespace psinc
 	{
 		return this->transport.UsbVersion();
 	}
+
+
+	TransportPool::Statistics Instrument::BufferStatistics()
+	{
+		return this->transport.BufferStatistics();
+	}
 }
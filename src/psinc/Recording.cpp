@@ -0,0 +1,374 @@
+#include "psinc/Recording.h"
+#include <emergent/logger/Logger.hpp>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#define ALIGNMENT 8
+
+using std::string;
+using namespace std::chrono;
+using namespace psinc::recording;
+
+
+namespace psinc
+{
+	// The size of the data following a record once padded
+	static inline size_t Padded(const size_t size)
+	{
+		return (size + ALIGNMENT - 1) & ~size_t(ALIGNMENT - 1);
+	}
+
+
+	static inline int64_t Nanoseconds(const steady_clock::time_point time)
+	{
+		return duration_cast<nanoseconds>(time.time_since_epoch()).count();
+	}
+
+
+	Recorder::~Recorder()
+	{
+		this->Close();
+	}
+
+
+	bool Recorder::Open(const string &path)
+	{
+		this->Close();
+
+		std::lock_guard lock(this->cs);
+		std::error_code error;
+
+		const uintmax_t size = std::filesystem::exists(path, error) ? std::filesystem::file_size(path, error) : 0;
+
+		if (size)
+		{
+			// Append to an existing recording, first discarding any incomplete record at the end
+			// (such as when the previous recording was interrupted)
+			std::FILE *existing = std::fopen(path.c_str(), "rb");
+
+			if (!existing)
+			{
+				emg::Log::Error("%u: Unable to open recording '%s'", emg::Timestamp::LogTime(), path);
+				return false;
+			}
+
+			Header header;
+			Record record;
+			uintmax_t end = sizeof(Header);
+
+			const bool valid = std::fread(&header, sizeof(Header), 1, existing) == 1
+				&& !std::memcmp(header.magic, MAGIC, sizeof(MAGIC))
+				&& header.version == VERSION;
+
+			while (valid && std::fread(&record, sizeof(Record), 1, existing) == 1 && record.magic == FRAME && end + sizeof(Record) + Padded(record.size) <= size)
+			{
+				end += sizeof(Record) + Padded(record.size);
+				std::fseek(existing, Padded(record.size), SEEK_CUR);
+			}
+
+			std::fclose(existing);
+
+			if (!valid)
+			{
+				emg::Log::Error("%u: Unable to append to '%s' since it is not a recording", emg::Timestamp::LogTime(), path);
+				return false;
+			}
+
+			if (end < size)
+			{
+				std::filesystem::resize_file(path, end, error);
+			}
+
+			this->file = error ? nullptr : std::fopen(path.c_str(), "ab");
+		}
+		else
+		{
+			Header header = {};
+
+			std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+			header.version = VERSION;
+
+			this->file = std::fopen(path.c_str(), "wb");
+
+			if (this->file && std::fwrite(&header, sizeof(Header), 1, this->file) != 1)
+			{
+				std::fclose(this->file);
+				this->file = nullptr;
+			}
+		}
+
+		if (!this->file)
+		{
+			emg::Log::Error("%u: Unable to open recording '%s' for writing", emg::Timestamp::LogTime(), path);
+			return false;
+		}
+
+		this->frames = 0;
+
+		return true;
+	}
+
+
+	void Recorder::Close()
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->file)
+		{
+			std::fclose(this->file);
+			this->file = nullptr;
+		}
+	}
+
+
+	bool Recorder::Write(const Frame &frame)
+	{
+		static const byte PADDING[ALIGNMENT] = {};
+
+		std::lock_guard lock(this->cs);
+
+		if (!this->file || !frame.data || frame.data->Size() < frame.trailer)
+		{
+			return false;
+		}
+
+		const size_t size = frame.data->Size() - frame.trailer;
+
+		Record record = {};
+
+		record.magic		= FRAME;
+		record.size			= size;
+		record.width		= frame.width;
+		record.height		= frame.height;
+		record.exposure		= frame.metadata.exposure;
+		record.gain			= frame.metadata.gain;
+		record.sequence		= frame.metadata.sequence;
+		record.sent			= Nanoseconds(frame.timing.sent);
+		record.received		= Nanoseconds(frame.metadata.timestamp);
+		record.count		= frame.metadata.count;
+		record.monochrome	= frame.monochrome;
+		record.hdr			= frame.hdr;
+		record.bayerMode	= frame.bayerMode;
+		record.context		= frame.metadata.context;
+		record.counted		= frame.metadata.counted;
+
+		const size_t padding = Padded(size) - size;
+
+		const bool result = std::fwrite(&record, sizeof(Record), 1, this->file) == 1
+			&& std::fwrite(frame.data->Data(), 1, size, this->file) == size
+			&& std::fwrite(PADDING, 1, padding, this->file) == padding;
+
+		if (!result)
+		{
+			// Anything partially written is discarded when the recording is next opened
+			emg::Log::Error("%u: Failed to write frame %u to the recording", emg::Timestamp::LogTime(), frame.metadata.sequence);
+			return false;
+		}
+
+		this->frames++;
+
+		return true;
+	}
+
+
+	uint64_t Recorder::Frames()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->frames;
+	}
+
+
+
+	Replay::~Replay()
+	{
+		this->Close();
+	}
+
+
+	bool Replay::Open(const string &path)
+	{
+		this->Close();
+
+		#ifdef _WIN32
+			this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+			LARGE_INTEGER size;
+
+			if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &size))
+			{
+				emg::Log::Error("%u: Unable to open recording '%s'", emg::Timestamp::LogTime(), path);
+				this->file = nullptr;
+				return false;
+			}
+
+			this->length	= size.QuadPart;
+			this->mapping	= this->length ? CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+			this->data		= this->mapping ? (const byte *)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		#else
+			const int fd = open(path.c_str(), O_RDONLY);
+			struct stat info;
+
+			if (fd < 0 || fstat(fd, &info))
+			{
+				emg::Log::Error("%u: Unable to open recording '%s'", emg::Timestamp::LogTime(), path);
+
+				if (fd >= 0) close(fd);
+				return false;
+			}
+
+			// The mapping remains valid once the file is closed
+			this->length	= info.st_size;
+			void *mapping	= this->length ? mmap(nullptr, this->length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+			this->data		= mapping != MAP_FAILED ? (const byte *)mapping : nullptr;
+
+			close(fd);
+
+			if (this->data)
+			{
+				// Frames are usually replayed in order so allow the kernel to read ahead and to
+				// drop the pages that have been replayed
+				madvise(mapping, this->length, MADV_SEQUENTIAL);
+			}
+		#endif
+
+		Header header;
+
+		if (!this->data || this->length < sizeof(Header) || (std::memcpy(&header, this->data, sizeof(Header)), std::memcmp(header.magic, MAGIC, sizeof(MAGIC))) || header.version != VERSION)
+		{
+			emg::Log::Error("%u: '%s' is not a recording", emg::Timestamp::LogTime(), path);
+
+			this->Close();
+			return false;
+		}
+
+		Record record;
+		size_t offset = sizeof(Header);
+
+		while (offset + sizeof(Record) <= this->length)
+		{
+			std::memcpy(&record, this->data + offset, sizeof(Record));
+
+			if (record.magic != FRAME || offset + sizeof(Record) + Padded(record.size) > this->length)
+			{
+				emg::Log::Info("%u: The recording '%s' ends with an incomplete frame", emg::Timestamp::LogTime(), path);
+				break;
+			}
+
+			this->index.push_back(offset);
+			offset += sizeof(Record) + Padded(record.size);
+		}
+
+		return true;
+	}
+
+
+	void Replay::Close()
+	{
+		#ifdef _WIN32
+			if (this->data)		UnmapViewOfFile(this->data);
+			if (this->mapping)	CloseHandle(this->mapping);
+			if (this->file)		CloseHandle(this->file);
+
+			this->mapping	= nullptr;
+			this->file		= nullptr;
+		#else
+			if (this->data)		munmap((void *)this->data, this->length);
+		#endif
+
+		this->data		= nullptr;
+		this->length	= 0;
+		this->index.clear();
+	}
+
+
+	size_t Replay::Size() const
+	{
+		return this->index.size();
+	}
+
+
+	const byte *Replay::Read(size_t index, Record &record) const
+	{
+		if (index >= this->index.size())
+		{
+			return nullptr;
+		}
+
+		std::memcpy(&record, this->data + this->index[index], sizeof(Record));
+
+		return this->data + this->index[index] + sizeof(Record);
+	}
+
+
+	bool Replay::Process(size_t index, DataHandler &handler, Metadata *metadata) const
+	{
+		Record record;
+		const byte *raw = this->Read(index, record);
+
+		if (!raw)
+		{
+			return false;
+		}
+
+		if (metadata)
+		{
+			metadata->timestamp	= steady_clock::time_point(duration_cast<steady_clock::duration>(nanoseconds(record.received)));
+			metadata->sequence	= record.sequence;
+			metadata->context	= record.context;
+			metadata->exposure	= record.exposure;
+			metadata->gain		= record.gain;
+			metadata->counted	= record.counted;
+			metadata->count		= record.count;
+		}
+
+		return handler.Process(record.monochrome, record.hdr, raw, record.size, record.width, record.height, record.bayerMode);
+	}
+
+
+	size_t Replay::Play(DataHandler &handler, std::function<bool(bool, const Metadata &)> callback, Speed speed, size_t first) const
+	{
+		const auto start	= steady_clock::now();
+		int64_t origin		= 0;
+		size_t played		= 0;
+
+		for (size_t i=first; i<this->index.size(); i++)
+		{
+			Record record;
+			Metadata metadata;
+
+			this->Read(i, record);
+
+			if (speed == Speed::Recorded)
+			{
+				if (i == first)
+				{
+					origin = record.received;
+				}
+
+				std::this_thread::sleep_until(start + nanoseconds(record.received - origin));
+			}
+
+			const bool success = this->Process(i, handler, &metadata);
+
+			played++;
+
+			if (callback && !callback(success, metadata))
+			{
+				break;
+			}
+		}
+
+		return played;
+	}
+}
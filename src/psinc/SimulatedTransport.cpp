@@ -0,0 +1,643 @@
+#include "psinc/SimulatedTransport.h"
+#include "psinc/driver/Commands.h"
+#include "psinc/xml/Devices.h"
+#include <emergent/logger/Logger.hpp>
+#include <regex>
+#include <thread>
+
+#define PAGE_SIZE 512
+
+using std::string;
+using namespace std::chrono;
+
+
+namespace psinc
+{
+	SimulatedTransport::SimulatedTransport(const Configuration &configuration) : configuration(configuration)
+	{
+		this->devices[0x05] = { configuration.serial.begin(), configuration.serial.end() };	// Serial
+		this->devices[0x07] = { 's', 'i', 'm', 'u', 'l', 'a', 't', 'e', 'd' };				// Name
+
+		if (!this->Load())
+		{
+			emg::Log::Error("Simulated device - unable to load the register file for chip type '%s'", configuration.chip);
+		}
+	}
+
+
+	bool SimulatedTransport::Load()
+	{
+		this->type = this->configuration.chip == "mt9" ? 0x01 : 0x00;
+
+		auto &description	= this->type ? chip::table::mt9 : chip::table::v024;
+		this->addressSize	= description.addressSize;
+		this->hdr			= description.hdr;
+
+		for (size_t i=0; i<description.registerCount; i++)
+		{
+			this->defaults[description.registers[i]] = 0;
+		}
+
+		for (size_t i=0; i<description.featureCount; i++)
+		{
+			auto &feature	= description.features[i];
+			const int mask	= ((1 << feature.bits) - 1) << feature.offset;
+
+			this->defaults[feature.address] |= (feature.defaultValue << feature.offset) & mask;
+		}
+
+		this->registers = this->defaults;
+
+		return this->configuration.chip == "v024" || this->configuration.chip == "mt9";
+	}
+
+
+	bool SimulatedTransport::Initialise(const std::set<uint16_t> &, uint16_t, string serial, std::function<void(bool)> onConnection, int timeout)
+	{
+		this->Disconnect();
+
+		std::lock_guard lock(this->cs);
+
+		this->serial		= serial;
+		this->onConnection	= onConnection;
+		this->timeout		= timeout;
+		this->arrived		= true;
+		this->wake.notify_all();
+
+		return true;
+	}
+
+
+	void SimulatedTransport::SetTimeout(int timeout)
+	{
+		std::lock_guard lock(this->cs);
+
+		this->timeout = timeout;
+	}
+
+
+	bool SimulatedTransport::Connected() const
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->connected;
+	}
+
+
+	uint8_t SimulatedTransport::UsbVersion() const
+	{
+		return this->Connected() ? 2 : 0;
+	}
+
+
+	void SimulatedTransport::Poll(int time)
+	{
+		std::vector<bool> events;
+
+		{
+			std::lock_guard lock(this->cs);
+
+			if (this->disconnect)
+			{
+				events.push_back(false);
+				this->disconnect = false;
+			}
+
+			if (this->connected && !this->attached)
+			{
+				emg::Log::Info("%u: Simulated device unplugged - %s", emg::Timestamp::LogTime(), this->configuration.serial);
+
+				this->connected = false;
+				this->frames.clear();
+				this->Discard();
+				events.push_back(false);
+			}
+
+			if (!this->connected && this->attached && this->arrived)
+			{
+				this->arrived = false;
+
+				if (this->serial.empty() || std::regex_match(this->configuration.serial, std::regex(this->serial)))
+				{
+					emg::Log::Info("%u: Simulated device claimed - %s", emg::Timestamp::LogTime(), this->configuration.serial);
+
+					this->connected	= true;
+					this->registers	= this->defaults;
+					this->Discard();
+					events.push_back(true);
+				}
+			}
+		}
+
+		if (this->onConnection)
+		{
+			for (bool connected : events)
+			{
+				this->onConnection(connected);
+			}
+		}
+
+		if (events.empty() && time > 0)
+		{
+			std::this_thread::sleep_for(milliseconds(time));
+		}
+	}
+
+
+	void SimulatedTransport::Plug(bool attached)
+	{
+		std::lock_guard lock(this->cs);
+
+		this->attached = attached;
+		this->arrived |= attached;
+		this->wake.notify_all();
+	}
+
+
+	void SimulatedTransport::Wait(int time)
+	{
+		std::unique_lock lock(this->cs);
+
+		auto deadline = steady_clock::now() + milliseconds(time);
+
+		if (this->frames.size())
+		{
+			deadline = std::min(deadline, this->frames.front().timing.received);
+		}
+
+		this->wake.wait_until(lock, deadline, [&] {
+			return this->woken || this->disconnect
+				|| (this->connected && !this->attached)
+				|| (!this->connected && this->attached && this->arrived);
+		});
+
+		this->woken = false;
+	}
+
+
+	void SimulatedTransport::Interrupt()
+	{
+		std::lock_guard lock(this->cs);
+
+		this->woken = true;
+		this->wake.notify_all();
+	}
+
+
+	int SimulatedTransport::Peek(int address)
+	{
+		std::lock_guard lock(this->cs);
+
+		auto r = this->registers.find(address);
+
+		return r == this->registers.end() ? -1 : r->second;
+	}
+
+
+	void SimulatedTransport::Disconnect()
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->connected)
+		{
+			emg::Log::Info("%u: Simulated device released - %s", emg::Timestamp::LogTime(), this->configuration.serial);
+
+			this->connected		= false;
+			this->disconnect	= true;
+			this->frames.clear();
+			this->Discard();
+		}
+	}
+
+
+	bool SimulatedTransport::Reset(bool control)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->connected && control)
+		{
+			// The camera reboots, so it disconnects and then arrives again
+			this->connected		= false;
+			this->disconnect	= true;
+			this->arrived		= true;
+			this->frames.clear();
+			this->Discard();
+		}
+
+		return this->connected;
+	}
+
+
+	bool SimulatedTransport::Transfer(std::vector<byte> *send, std::vector<byte> *receive, std::atomic<bool> &waiting, bool check, bool truncate)
+	{
+		size_t transferred = 0;
+
+		const bool result = receive
+			? this->Exchange(send, receive->data(), receive->size(), waiting, check, transferred)
+			: this->Exchange(send, nullptr, 0, waiting, check, transferred);
+
+		// When requested, truncate the buffer to the size of data actually received.
+		if (result && receive && truncate)
+		{
+			receive->resize(transferred);
+		}
+
+		return result;
+	}
+
+
+	bool SimulatedTransport::Transfer(std::vector<byte> *send, TransportBuffer &receive, std::atomic<bool> &waiting, FrameTiming *timing, size_t)
+	{
+		size_t transferred = 0;
+
+		return this->Exchange(send, receive.Data(), receive.Size(), waiting, true, transferred, timing);
+	}
+
+
+	bool SimulatedTransport::Exchange(const std::vector<byte> *send, byte *data, size_t size, std::atomic<bool> &waiting, bool check, size_t &transferred, FrameTiming *timing)
+	{
+		FrameTiming schedule;
+
+		{
+			std::lock_guard lock(this->cs);
+
+			if (!this->connected || (send && !this->Execute(*send)))
+			{
+				return false;
+			}
+
+			waiting		= true;
+			transferred	= this->Read(data, size);
+
+			if (!this->Schedule(transferred, schedule))
+			{
+				emg::Log::Error("%u: Simulated device %s - LIBUSB_ERROR_TIMEOUT when reading (%d bytes)", emg::Timestamp::LogTime(), this->configuration.serial, size);
+				return false;
+			}
+		}
+
+		std::this_thread::sleep_until(schedule.received);
+
+		if (timing)
+		{
+			timing->sent		= schedule.sent;
+			timing->first		= schedule.first;
+			timing->received	= schedule.received;
+		}
+
+		if (check && transferred != size)
+		{
+			emg::Log::Error(
+				"%u: Simulated device %s - Incomplete transfer when reading (%d of %d bytes)",
+				emg::Timestamp::LogTime(),
+				this->configuration.serial,
+				transferred,
+				size
+			);
+
+			return false;
+		}
+
+		return true;
+	}
+
+
+	TransportPool::Lease SimulatedTransport::Lease(size_t size)
+	{
+		return this->pool.Acquire(nullptr, size);
+	}
+
+
+	TransportPool::Statistics SimulatedTransport::BufferStatistics()
+	{
+		return this->pool.Stats();
+	}
+
+
+	void SimulatedTransport::SetTransfers(size_t, size_t)
+	{
+	}
+
+
+	bool SimulatedTransport::Queue(const std::vector<byte> &command, size_t size, std::atomic<bool> &waiting, size_t)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (!this->connected || !size || !this->Execute(command))
+		{
+			return false;
+		}
+
+		auto &frame		= this->frames.emplace_back();
+		frame.data		= this->pool.Acquire(nullptr, size);
+		frame.failed	= this->Read(frame.data->Data(), size) != size || !this->Schedule(size, frame.timing);
+		waiting			= true;
+
+		return true;
+	}
+
+
+	bool SimulatedTransport::Collect(TransportPool::Lease &receive, FrameTiming *timing)
+	{
+		std::unique_lock lock(this->cs);
+
+		if (this->frames.empty())
+		{
+			return false;
+		}
+
+		auto frame = std::move(this->frames.front());
+		this->frames.pop_front();
+
+		lock.unlock();
+
+		std::this_thread::sleep_until(frame.timing.received);
+
+		receive = std::move(frame.data);
+
+		if (timing)
+		{
+			*timing = frame.timing;
+		}
+
+		return !frame.failed;
+	}
+
+
+	bool SimulatedTransport::Ready()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->frames.size() && steady_clock::now() >= this->frames.front().timing.received;
+	}
+
+
+	size_t SimulatedTransport::Queued()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->frames.size();
+	}
+
+
+	void SimulatedTransport::Flush()
+	{
+		std::lock_guard lock(this->cs);
+
+		this->frames.clear();
+	}
+
+
+	void SimulatedTransport::Cancel()
+	{
+		this->Flush();
+	}
+
+
+	bool SimulatedTransport::Schedule(size_t size, FrameTiming &timing)
+	{
+		const int jitter	= this->configuration.jitter > 0 ? this->random() % (this->configuration.jitter + 1) : 0;
+		const auto latency	= duration_cast<steady_clock::duration>(microseconds(this->configuration.latency + jitter));
+		const auto data		= duration_cast<steady_clock::duration>(duration<double>(this->configuration.bandwidth > 0 ? size / this->configuration.bandwidth : 0));
+		const auto period	= latency + data;
+
+		// The link is shared so a transfer cannot start until the previous one has finished
+		timing.sent		= steady_clock::now();
+		timing.first	= std::max(timing.sent, this->busy) + latency;
+		this->busy		= timing.first + data;
+		timing.received	= this->busy;
+
+		return !this->timeout || period <= milliseconds(this->timeout);
+	}
+
+
+	size_t SimulatedTransport::Read(byte *data, size_t size)
+	{
+		const size_t length = std::min(size, this->output.size() - this->position);
+
+		if (length)
+		{
+			memcpy(data, this->output.data() + this->position, length);
+			this->position += length;
+		}
+
+		if (this->position == this->output.size())
+		{
+			this->Discard();
+		}
+
+		return length;
+	}
+
+
+	void SimulatedTransport::Discard()
+	{
+		this->output.clear();
+		this->position = 0;
+	}
+
+
+	bool SimulatedTransport::Execute(const std::vector<byte> &packet)
+	{
+		auto append = [&](std::initializer_list<byte> data) {
+			this->output.insert(this->output.end(), data);
+		};
+
+		// A packet is a 5 byte header followed by 5 byte commands and then a terminator
+		for (size_t i=5; i+4 < packet.size() && packet[i] != 0xff; i+=5)
+		{
+			const byte *c		= packet.data() + i;
+			const int address	= c[1] | (c[2] << 8);
+			const size_t size	= c[2] | (c[3] << 8) | (c[4] << 16);
+
+			switch (c[0])
+			{
+				case Commands::Capture:
+				case Commands::SlaveCaptureRising:
+				case Commands::SlaveCaptureFalling:
+				case Commands::MasterCapture:
+					this->Capture(size);
+					break;
+
+				case Commands::ResetChip:
+					// A full or imaging chip reset restores the registers whereas a communications
+					// reset discards any pending response
+					if (c[1] == 0x01)	this->Discard();
+					else if (c[1] < 4)	this->registers = this->defaults;
+					break;
+
+				case Commands::Flush:
+					this->Discard();
+					break;
+
+				case Commands::WriteRegister:
+					this->registers[address] = c[3] | (c[4] << 8);
+					break;
+
+				case Commands::WriteBit:
+				{
+					auto &value = this->registers[address];
+					value		= c[4] ? value | (1 << c[3]) : value & ~(1 << c[3]);
+					break;
+				}
+
+				case Commands::QueueRegister:
+				{
+					const int value = this->registers.count(address) ? this->registers[address] : 0;
+					append({ 0x00, c[1], c[2], (byte)(value & 0xff), (byte)((value >> 8) & 0xff) });
+					break;
+				}
+
+				case Commands::ReadRegisterPage:
+					this->Page(c[1]);
+					break;
+
+				case Commands::WriteDevice:
+					this->devices[c[1]] = { c[2] };
+					break;
+
+				case Commands::QueueDevice:
+				{
+					const auto data = this->Describe(c[1]);
+					append({ 0x00, c[1], (byte)(data.size() & 0xff), (byte)((data.size() >> 8) & 0xff) });
+					this->output.insert(this->output.end(), data.begin(), data.end());
+					break;
+				}
+
+				case Commands::InitialiseDevice:
+					break;
+
+				case Commands::WriteBlock:
+					// The block data follows the command and is then followed by the terminator
+					if (i + 5 + size > packet.size())
+					{
+						return false;
+					}
+
+					this->devices[c[1]].assign(c + 5, c + 5 + size);
+					i += size;
+					break;
+
+				case Commands::ReadBlock:
+				{
+					const auto data = this->Describe(c[1]);
+					this->output.insert(this->output.end(), data.begin(), data.begin() + std::min(size, data.size()));
+					break;
+				}
+
+				case Commands::Channel:
+				{
+					auto &channel = this->channels[c[1]];
+
+					if (c[2])
+					{
+						channel = c[3] | (c[4] << 8);
+					}
+
+					append({ (byte)(channel & 0xff), (byte)((channel >> 8) & 0xff), 0x00, 0x00 });
+					break;
+				}
+
+				case Commands::Query:
+					append({ c[1], 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 });
+					break;
+
+				default:
+					emg::Log::Error("%u: Simulated device %s - Unknown command 0x%02x", emg::Timestamp::LogTime(), this->configuration.serial, c[0]);
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+
+	void SimulatedTransport::Capture(size_t size)
+	{
+		if (this->pattern.size() != size)
+		{
+			// A ramp with a little noise so that the decoders have something plausible to work with
+			const int limit	= this->hdr ? 4096 : 256;
+			uint32_t seed	= 0x2545f491;
+
+			this->pattern.resize(size);
+
+			for (size_t i=0; i<size; i++)
+			{
+				seed = seed * 1664525 + 1013904223;
+
+				const int value = (i / 3 + (seed >> 24) % 16) % limit;
+
+				if (this->hdr && i + 1 < size)
+				{
+					this->pattern[i]		= value & 0xff;
+					this->pattern[i + 1]	= (value >> 8) & 0xff;
+					i++;
+				}
+				else
+				{
+					this->pattern[i] = value;
+				}
+			}
+		}
+
+		const size_t start = this->output.size();
+
+		this->output.insert(this->output.end(), this->pattern.begin(), this->pattern.end());
+
+		for (size_t i=0; i<std::min<size_t>(size, 4); i++)
+		{
+			this->output[start + i] = (this->sequence >> (8 * i)) & 0xff;
+		}
+
+		this->sequence++;
+	}
+
+
+	void SimulatedTransport::Page(byte page)
+	{
+		// The inverse of the page layout expected by Register::Refresh
+		const int mask		= 0x1ff / this->addressSize;
+		const size_t start	= this->output.size();
+
+		this->output.resize(start + PAGE_SIZE, 0);
+
+		for (auto &[address, value] : this->registers)
+		{
+			const int offset = this->addressSize * (address & mask);
+
+			if (((address & ~mask) >> 8) == page && offset < PAGE_SIZE - 1)
+			{
+				this->output[start + offset]		= (value >> 8) & 0xff;
+				this->output[start + offset + 1]	= value & 0xff;
+			}
+		}
+	}
+
+
+	std::vector<byte> SimulatedTransport::Describe(byte index)
+	{
+		if (index == 0xff)
+		{
+			// The query device reports the chip type and whether or not it is a bayer sensor
+			return { 0x03, this->type, (byte)(this->configuration.monochrome ? 0x00 : 0x01) };
+		}
+
+		if (index == 0x13)
+		{
+			// The Count device reports the number of frames captured as a 64-bit value
+			std::vector<byte> count(8);
+
+			for (size_t i=0; i<count.size(); i++)
+			{
+				count[i] = ((uint64_t)this->sequence >> (8 * i)) & 0xff;
+			}
+
+			return count;
+		}
+
+		auto device = this->devices.find(index);
+
+		return device == this->devices.end() ? std::vector<byte> {} : device->second;
+	}
+}
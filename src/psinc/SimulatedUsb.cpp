@@ -0,0 +1,290 @@
+#include "psinc/SimulatedUsb.h"
+#include <emergent/logger/Logger.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace std::chrono;
+
+
+namespace psinc
+{
+	SimulatedUsb::SimulatedUsb(const Configuration &configuration) : configuration(configuration) {}
+
+
+	libusb_device_handle *SimulatedUsb::Device()
+	{
+		// The handle is never dereferenced by the transport, only passed back to this backend
+		return reinterpret_cast<libusb_device_handle *>(this);
+	}
+
+
+	void SimulatedUsb::Inject(Fault fault, size_t after)
+	{
+		std::lock_guard lock(this->cs);
+
+		this->fault		= fault;
+		this->trigger	= this->sent + after;
+		this->busy		= std::max(this->busy, Clock::now());
+
+		this->changed.notify_all();
+	}
+
+
+	size_t SimulatedUsb::Pending()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->writes.size() + this->reads.size() + this->completed.size();
+	}
+
+
+	bool SimulatedUsb::Closed()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->closed;
+	}
+
+
+	bool SimulatedUsb::Active(Fault fault) const
+	{
+		return this->fault == fault && this->sent >= this->trigger;
+	}
+
+
+	int SimulatedUsb::Submit(libusb_transfer *transfer)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->Active(Fault::Disconnect))
+		{
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+
+		auto &endpoint = (transfer->endpoint & LIBUSB_ENDPOINT_IN) ? this->reads : this->writes;
+
+		endpoint.push_back({ transfer, Clock::now() });
+
+		this->changed.notify_all();
+
+		return 0;
+	}
+
+
+	int SimulatedUsb::Cancel(libusb_transfer *transfer)
+	{
+		std::lock_guard lock(this->cs);
+
+		for (auto endpoint : { &this->writes, &this->reads })
+		{
+			auto match = std::find_if(endpoint->begin(), endpoint->end(), [&](auto &s) { return s.transfer == transfer; });
+
+			if (match != endpoint->end())
+			{
+				this->Complete(transfer, LIBUSB_TRANSFER_CANCELLED, match->received);
+				endpoint->erase(match);
+				this->changed.notify_all();
+
+				return 0;
+			}
+		}
+
+		return LIBUSB_ERROR_NOT_FOUND;
+	}
+
+
+	int SimulatedUsb::Handle(libusb_context *, struct timeval *time)
+	{
+		std::deque<libusb_transfer *> finished;
+
+		{
+			std::unique_lock lock(this->cs);
+
+			auto now			= Clock::now();
+			const auto deadline	= now + (time ? seconds(time->tv_sec) + microseconds(time->tv_usec) : Clock::duration::zero());
+
+			while (true)
+			{
+				const auto next = this->Progress(now);
+
+				if (this->completed.size() || now >= deadline)
+				{
+					break;
+				}
+
+				this->changed.wait_until(lock, std::min(next, deadline));
+				now = Clock::now();
+			}
+
+			finished.swap(this->completed);
+		}
+
+		// As with libusb, the callbacks are free to submit further transfers
+		for (auto transfer : finished)
+		{
+			transfer->callback(transfer);
+		}
+
+		return 0;
+	}
+
+
+	void SimulatedUsb::Complete(libusb_transfer *transfer, libusb_transfer_status status, int length)
+	{
+		transfer->status		= status;
+		transfer->actual_length	= length;
+
+		this->completed.push_back(transfer);
+	}
+
+
+	SimulatedUsb::Clock::time_point SimulatedUsb::Progress(Clock::time_point now)
+	{
+		auto next = Clock::time_point::max();
+
+		// Every command is accepted and requests another frame
+		while (this->writes.size() && !this->Active(Fault::Disconnect))
+		{
+			auto transfer = this->writes.front().transfer;
+
+			if (this->frames.empty())
+			{
+				this->busy = std::max(this->busy, now);
+			}
+
+			this->frames.push_back({ this->configuration.frame, this->configuration.trailer });
+			this->writes.pop_front();
+			this->Complete(transfer, LIBUSB_TRANSFER_COMPLETED, transfer->length);
+		}
+
+		// Reads complete in the order they were submitted as the frame data is sent
+		while (this->reads.size() && this->frames.size() && (this->fault == Fault::None || this->fault == Fault::Short || this->sent < this->trigger))
+		{
+			auto &read		= this->reads.front();
+			auto &frame		= this->frames.front();
+			auto transfer	= read.transfer;
+			const bool body	= frame.data > 0;
+			auto &remaining	= body ? frame.data : frame.trailer;
+			size_t length	= std::min<size_t>(transfer->length - read.received, remaining);
+			const bool hit	= this->fault != Fault::None && this->sent + length > this->trigger;
+
+			if (hit)
+			{
+				length = this->trigger - this->sent;
+			}
+
+			const auto done = std::max(this->busy, read.submitted) + duration_cast<Clock::duration>(
+				duration<double>(this->configuration.bandwidth > 0 ? length / this->configuration.bandwidth : 0)
+			);
+
+			if (done > now)
+			{
+				next = std::min(next, done);
+				break;
+			}
+
+			std::memset(transfer->buffer + read.received, this->sequence & 0xff, length);
+
+			read.received	+= length;
+			this->sent		+= length;
+			this->busy		= done;
+			remaining		-= length;
+
+			// The read ends early if what has just been sent finished with a short packet
+			bool terminated = !remaining && (body ? this->configuration.frame : this->configuration.trailer) % std::max<size_t>(this->configuration.packet, 1);
+
+			if (hit && this->fault == Fault::Short)
+			{
+				// The remainder of the frame, and its trailer, is abandoned
+				frame		= { 0, 0 };
+				terminated	= true;
+				this->fault	= Fault::None;
+			}
+
+			if (!frame.data && !frame.trailer)
+			{
+				this->frames.pop_front();
+				this->sequence++;
+			}
+
+			if (terminated || read.received == transfer->length)
+			{
+				this->Complete(transfer, LIBUSB_TRANSFER_COMPLETED, read.received);
+				this->reads.pop_front();
+			}
+		}
+
+		if (this->Active(Fault::Disconnect))
+		{
+			for (auto endpoint : { &this->writes, &this->reads })
+			{
+				for (auto &s : *endpoint)
+				{
+					this->Complete(s.transfer, LIBUSB_TRANSFER_NO_DEVICE, s.received);
+				}
+
+				endpoint->clear();
+			}
+		}
+		else if (!this->Active(Fault::Hang))
+		{
+			// Anything still waiting for data is subject to the transfer timeout
+			for (auto read = this->reads.begin(); read != this->reads.end();)
+			{
+				const auto limit = read->submitted + milliseconds(read->transfer->timeout);
+
+				if (read->transfer->timeout && limit <= now)
+				{
+					this->Complete(read->transfer, LIBUSB_TRANSFER_TIMED_OUT, read->received);
+					read = this->reads.erase(read);
+				}
+				else
+				{
+					if (read->transfer->timeout) next = std::min(next, limit);
+					read++;
+				}
+			}
+		}
+
+		return next;
+	}
+
+
+	int SimulatedUsb::Transfer(libusb_device_handle *, byte endpoint, byte *, int size, int *transferred, unsigned int)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->Active(Fault::Disconnect))
+		{
+			*transferred = 0;
+			return LIBUSB_ERROR_NO_DEVICE;
+		}
+
+		*transferred = (endpoint & LIBUSB_ENDPOINT_IN) ? 0 : size;
+
+		return *transferred ? 0 : LIBUSB_ERROR_TIMEOUT;
+	}
+
+
+	int SimulatedUsb::Reset(libusb_device_handle *, bool, unsigned int)
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->Active(Fault::Disconnect) ? LIBUSB_ERROR_NO_DEVICE : 0;
+	}
+
+
+	void SimulatedUsb::Close(libusb_device_handle *)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->writes.size() || this->reads.size() || this->completed.size())
+		{
+			emg::Log::Error("%u: Simulated USB device closed with transfers still in flight", emg::Timestamp::LogTime());
+		}
+
+		// Frames that have been requested but not sent are lost along with the claim on the device
+		this->frames.clear();
+		this->closed = true;
+	}
+}
@@ -0,0 +1,1136 @@
+#include "psinc/UsbTransport.h"
+#include <emergent/logger/Logger.hpp>
+#include <emergent/String.hpp>
+#include <libusb-1.0/libusb.h>
+#include <regex>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <unistd.h>
+#endif
+// #include <cstring>
+
+#define WRITE_PIPE	0x03
+#define READ_PIPE	0x81
+
+using std::string;
+
+
+// #include <emergent/Timer.hpp>
+
+namespace psinc
+{
+	int UsbBackend::Submit(libusb_transfer *transfer)
+	{
+		return libusb_submit_transfer(transfer);
+	}
+
+
+	int UsbBackend::Cancel(libusb_transfer *transfer)
+	{
+		return libusb_cancel_transfer(transfer);
+	}
+
+
+	int UsbBackend::Handle(libusb_context *context, struct timeval *time)
+	{
+		return libusb_handle_events_timeout_completed(context, time, nullptr);
+	}
+
+
+	int UsbBackend::Transfer(libusb_device_handle *handle, byte endpoint, byte *data, int size, int *transferred, unsigned int timeout)
+	{
+		return libusb_bulk_transfer(handle, endpoint, data, size, transferred, timeout);
+	}
+
+
+	int UsbBackend::Reset(libusb_device_handle *handle, bool control, unsigned int timeout)
+	{
+		return control
+			? libusb_control_transfer(handle, 0x40, 0xf2, 0, 0, 0, 0, timeout)
+			: libusb_reset_device(handle);
+	}
+
+
+	void UsbBackend::Close(libusb_device_handle *handle)
+	{
+		libusb_release_interface(handle, 0);
+		libusb_close(handle);
+	}
+
+
+	UsbContext::UsbContext()
+	{
+		libusb_init(&this->context);
+
+		#ifndef _WIN32
+			if (pipe(this->wake) == 0)
+			{
+				fcntl(this->wake[0], F_SETFL, fcntl(this->wake[0], F_GETFL) | O_NONBLOCK);
+				fcntl(this->wake[1], F_SETFL, fcntl(this->wake[1], F_GETFL) | O_NONBLOCK);
+			}
+			else
+			{
+				this->wake[0] = this->wake[1] = -1;
+			}
+		#endif
+	}
+
+
+	UsbContext::~UsbContext()
+	{
+		libusb_exit(this->context);
+
+		#ifndef _WIN32
+			if (this->wake[0] >= 0)
+			{
+				close(this->wake[0]);
+				close(this->wake[1]);
+			}
+		#endif
+	}
+
+
+	libusb_context *UsbContext::Get() const
+	{
+		return this->context;
+	}
+
+
+	void UsbContext::Handle(int time)
+	{
+		#ifndef _WIN32
+			const libusb_pollfd **list = this->wake[0] >= 0 ? libusb_get_pollfds(this->context) : nullptr;
+
+			if (list)
+			{
+				std::vector<pollfd> fds = {{ this->wake[0], POLLIN, 0 }};
+
+				for (auto p = list; *p; p++)
+				{
+					fds.push_back({ (*p)->fd, (*p)->events, 0 });
+				}
+
+				libusb_free_pollfds(list);
+
+				// Some platforms require libusb to handle transfer timeouts itself
+				struct timeval next;
+
+				if (libusb_get_next_timeout(this->context, &next) == 1)
+				{
+					time = std::min<int>(time, next.tv_sec * 1000 + (next.tv_usec + 999) / 1000);
+				}
+
+				if (poll(fds.data(), fds.size(), time) > 0 && (fds[0].revents & POLLIN))
+				{
+					byte drain[64];
+					while (read(this->wake[0], drain, sizeof(drain)) > 0);
+				}
+
+				// Handle whatever is ready without blocking
+				struct timeval zero = { 0, 0 };
+				libusb_handle_events_timeout_completed(this->context, &zero, nullptr);
+
+				return;
+			}
+		#endif
+
+		struct timeval tv = { time / 1000, (time % 1000) * 1000 };
+		libusb_handle_events_timeout_completed(this->context, &tv, nullptr);
+	}
+
+
+	void UsbContext::Interrupt()
+	{
+		#ifndef _WIN32
+			if (this->wake[1] >= 0)
+			{
+				// The pipe is non-blocking so if it is already full the wake is still pending
+				const byte signal = 1;
+				[[maybe_unused]] auto result = write(this->wake[1], &signal, 1);
+			}
+		#endif
+
+		#if LIBUSB_API_VERSION >= 0x01000105
+			libusb_interrupt_event_handler(this->context);
+		#endif
+	}
+
+
+	UsbTransport::UsbTransport(std::shared_ptr<UsbContext> context, std::shared_ptr<UsbBackend> backend) :
+		shared(context ? context : std::make_shared<UsbContext>()),
+		context(this->shared->Get()),
+		backend(backend ? backend : std::make_shared<UsbBackend>()),
+		exclusive(!context)
+	{
+		this->legacy = !libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG);
+
+		// for testing on windows - please remove
+		// emg::Log::Initialise({ std::make_unique<emg::logger::Console>() });
+		// emg::Log::Verbosity(emg::Severity::Info);
+	}
+
+
+	UsbTransport::~UsbTransport()
+	{
+		this->Release();
+
+		// The cancelled transfers must complete before their memory can be freed
+		this->Drain();
+		this->Close();
+
+		for (auto &slot : this->slots)
+		{
+			// A transfer still owned by libusb at this point cannot be safely freed
+			if (!slot.busy)
+			{
+				libusb_free_transfer(slot.read);
+			}
+		}
+
+		if (!this->legacy)
+		{
+			libusb_hotplug_deregister_callback(this->context, this->hotplug);
+		}
+	}
+
+
+	bool UsbTransport::Initialise(const std::set<uint16_t> &vendors, uint16_t product, std::string serial, std::function<void(bool)> onConnection, int timeout)
+	{
+		this->Disconnect();
+
+		this->vendors		= vendors;
+		this->product		= product;
+		this->serial		= serial;
+		this->onConnection	= onConnection;
+		this->timeout		= timeout;
+
+		if (!this->legacy)
+		{
+			libusb_hotplug_deregister_callback(this->context, this->hotplug);
+			this->registered = false;
+		}
+		else emg::Log::Info("USB hotplug not supported on this platform, running in legacy mode");
+
+		return true;
+	}
+
+
+	void UsbTransport::SetTimeout(int timeout)
+	{
+		this->timeout = timeout;
+	}
+
+
+	bool UsbTransport::Connected() const
+	{
+		return this->handle;
+	}
+
+
+	uint8_t UsbTransport::UsbVersion() const
+	{
+		return version;
+	}
+
+
+	int LIBUSB_CALL OnHotplug(libusb_context *, libusb_device *device, libusb_hotplug_event event, void *data)
+	{
+		reinterpret_cast<UsbTransport *>(data)->Pending(device, event);
+		return 0;
+	}
+
+
+	void UsbTransport::Pending(libusb_device *device, libusb_hotplug_event event)
+	{
+		if (Valid(device, this->vendors, this->product))
+		{
+			if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT && this->handle)
+			{
+				if (device == libusb_get_device(this->handle))
+				{
+					// Events cannot be handled from within the callback so the transfers of the
+					// departed device could not complete here, release it when next polled instead.
+					this->departed = true;
+				}
+			}
+
+			// A device that has departed is still held until polled, when it is released before any arrivals are claimed
+			if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED && (!this->handle || this->departed))
+			{
+				std::lock_guard lock(this->arrivals);
+				this->pending.push(device);
+			}
+		}
+	}
+
+
+	void UsbTransport::Poll(int time)
+	{
+		if (this->departed.exchange(false))
+		{
+			std::lock_guard lock(this->cs);
+			this->Release();
+		}
+
+		this->Close();
+
+		if (this->disconnect && this->onConnection)
+		{
+			this->onConnection(false);
+			this->disconnect = false;
+		}
+
+		if (this->legacy)
+		{
+			if (!this->handle)
+			{
+				this->LegacyConnect();
+			}
+
+			return;
+		}
+
+		if (!this->registered)
+		{
+			auto events = (libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT);
+
+			if (libusb_hotplug_register_callback(this->context, events, LIBUSB_HOTPLUG_ENUMERATE, LIBUSB_HOTPLUG_MATCH_ANY, this->product, LIBUSB_HOTPLUG_MATCH_ANY, &OnHotplug, this, &this->hotplug))
+			{
+				emg::Log::Error("Unable to register USB hotplug callback");
+				return;
+			}
+
+			this->registered = true;
+		}
+
+		if (this->exclusive)
+		{
+			struct timeval tv = { 0, time * 1000 };
+			this->backend->Handle(this->context, &tv);
+		}
+
+		std::queue<libusb_device *> arrived;
+
+		{
+			std::lock_guard lock(this->arrivals);
+			arrived.swap(this->pending);
+		}
+
+		while (!arrived.empty())
+		{
+			if (!this->handle && this->Claim(arrived.front()) && this->onConnection)
+			{
+				this->onConnection(true);
+				this->disconnect = false;
+			}
+			arrived.pop();
+		}
+	}
+
+
+	void UsbTransport::Wait(int time)
+	{
+		this->shared->Handle(time);
+	}
+
+
+	void UsbTransport::Interrupt()
+	{
+		this->shared->Interrupt();
+	}
+
+
+	std::string UsbTransport::ReadDescriptor(libusb_device_handle *device, const uint8_t index)
+	{
+		unsigned char data[128] = { 0 };
+		const int length		= libusb_get_string_descriptor_ascii(device, index, data, 127);
+
+		return length > 0 && length < 127
+			? emg::String::trim(reinterpret_cast<char *>(data), ' ')
+			: std::string {};
+	}
+
+
+	bool UsbTransport::Match(libusb_device_handle *device, const uint8_t index)
+	{
+		this->id = UsbTransport::ReadDescriptor(device, index);
+
+		return this->serial.empty() ? true : regex_match(this->id, std::regex(this->serial));
+	}
+
+
+	bool UsbTransport::Valid(libusb_device *device, const std::set<uint16_t> &vendors, uint16_t product)
+	{
+		libusb_device_descriptor descriptor;
+
+		return libusb_get_device_descriptor(device, &descriptor) == 0
+			&& vendors.count(descriptor.idVendor)
+			&& descriptor.idProduct == product;
+	}
+
+
+	void UsbTransport::LegacyConnect()
+	{
+		libusb_device **list;
+		libusb_get_device_list(this->context, &list);
+
+		// Loop through the list of connected USB devices
+		for (libusb_device **device = list; *device; device++)
+		{
+			if (Valid(*device, this->vendors, this->product))
+			{
+				// If a particular device matches the known vendor, product ID then attempt to claim it.
+				if (this->Claim(*device))
+				{
+					if (this->onConnection) this->onConnection(true);
+					break;
+				}
+			}
+		}
+
+		libusb_free_device_list(list, 1);
+	}
+
+
+	bool UsbTransport::Claim(libusb_device *device)
+	{
+		std::lock_guard lock(this->cs);
+
+		libusb_device_descriptor descriptor;
+
+		if (libusb_get_device_descriptor(device, &descriptor) == 0)
+		{
+			// Attempt to open and claim the device
+			if (libusb_open(device, &this->handle) == 0)
+			{
+				// If a serial number has been specified then check that this device matches it
+				if (this->Match(this->handle, descriptor.iSerialNumber))
+				{
+					// TODO: Disabled this while PSI is solving an issue with
+					// the camera that causes it to get stuck in a strange state.
+					//if (libusb_set_configuration(this->handle, 1) == 0)
+					{
+						if (libusb_claim_interface(this->handle, 0) == 0)
+						{
+							this->version = (descriptor.bcdUSB >> 8) & 0xff;
+
+							emg::Log::Info(
+								"%u: USB (v%d.%d) device claimed - %s",
+								emg::Timestamp::LogTime(),
+								this->version,
+								descriptor.bcdUSB & 0xff,
+								this->id);
+							return true;
+						}
+					}
+				}
+
+				// Claiming was unsuccessful so clean up
+				libusb_close(this->handle);
+				this->handle 	= nullptr;
+				this->id		= "";
+			}
+		}
+
+		return false;
+	}
+
+
+	std::map<string, Transport::Info> Transport::List(const std::set<uint16_t> &vendors, uint16_t product)
+	{
+		return UsbTransport::List(vendors, product);
+	}
+
+
+	std::map<string, UsbTransport::Info> UsbTransport::List(const std::set<uint16_t> &vendors, uint16_t product)
+	{
+		std::map<string, Info> result;
+
+		// unsigned char data[128];
+		libusb_device **list;
+		libusb_device_descriptor descriptor;
+		libusb_device_handle *handle;
+		libusb_context *context = nullptr;
+
+		libusb_init(&context);
+		libusb_get_device_list(context, &list);
+
+		for (libusb_device **device = list; *device; device++)
+		{
+			if (Valid(*device, vendors, product) && libusb_get_device_descriptor(*device, &descriptor) == 0)
+			{
+				if (libusb_open(*device, &handle) == 0)
+				{
+					const string serial	= UsbTransport::ReadDescriptor(handle, descriptor.iSerialNumber);
+					const string name	= UsbTransport::ReadDescriptor(handle, descriptor.iProduct);
+
+					result[serial] = {
+						name,
+						emg::String::format(
+							"v%d.%d",
+							(descriptor.bcdUSB >> 8) & 0xff,
+							descriptor.bcdUSB & 0xff
+						),
+						emg::String::format(
+							"%d:%d:%d",
+							libusb_get_bus_number(*device),
+							libusb_get_port_number(*device),
+							libusb_get_device_address(*device)
+						),
+						descriptor.idVendor,
+						descriptor.idProduct
+					};
+
+					libusb_close(handle);
+				}
+			}
+		}
+
+		libusb_free_device_list(list, 1);
+		libusb_exit(context);
+
+		return result;
+
+	}
+
+
+	void UsbTransport::Disconnect()
+	{
+		std::lock_guard lock(this->cs);
+
+		this->Release();
+	}
+
+
+	void UsbTransport::Attach(libusb_device_handle *handle, const std::string &id, uint8_t version)
+	{
+		std::lock_guard lock(this->cs);
+
+		this->Release();
+
+		this->handle		= handle;
+		this->id			= id;
+		this->version		= version;
+		this->disconnect	= false;
+
+		emg::Log::Info("%u: USB device attached - %s", emg::Timestamp::LogTime(), this->id);
+	}
+
+
+	void UsbTransport::Release()
+	{
+		if (this->handle)
+		{
+			this->Abort();
+
+			{
+				std::lock_guard lock(this->stream);
+				this->closing = this->handle;
+			}
+
+			emg::Log::Info("%u: USB deviced released - %s", emg::Timestamp::LogTime(), this->id);
+
+			this->disconnect	= true;
+			this->handle		= nullptr;
+			this->id			= "";
+			this->version		= 0;
+
+			this->Close();
+		}
+	}
+
+
+	void UsbTransport::Close()
+	{
+		std::lock_guard lock(this->stream);
+
+		if (this->closing && !this->Busy())
+		{
+			// Release the device and close the handle
+			this->pool.Release(this->closing);
+			this->backend->Close(this->closing);
+			this->closing = nullptr;
+		}
+	}
+
+
+
+	bool UsbTransport::Reset(bool control)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->handle)
+		{
+			if (control)
+			{
+				this->backend->Reset(this->handle, true, this->timeout);
+
+				// This tells the camera to reset itself and will therefore result in
+				// disconnection so assume that the handle is now invalid.
+				this->Release();
+			}
+			else if (this->backend->Reset(this->handle, false, this->timeout) != 0)
+			{
+				// Something has gone wrong with the reset and so the device appears
+				// as if it has been reconnected. Therefore this handle is invalid
+				// and must be cleaned up.
+				this->Release();
+
+				emg::Log::Error("Problem resetting USB device, handle has been released");
+			}
+		}
+
+		return this->handle;
+	}
+
+
+	bool UsbTransport::Transfer(std::vector<byte> *send, std::vector<byte> *receive, std::atomic<bool> &waiting, bool check, bool truncate)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (receive && this->Queued())
+		{
+			// Any response would be read into the transfers of a streamed frame, so
+			// wait for the stream to finish receiving everything that was queued.
+			this->Await([&] { return this->Idle(); });
+		}
+
+		return this->handle
+			? this->Transfer(send, true, check, false)
+				&& (waiting = true)
+				&& this->Transfer(receive, false, check, truncate)
+			: false;
+	}
+
+
+	bool UsbTransport::Transfer(std::vector<byte> *send, TransportBuffer &receive, std::atomic<bool> &waiting, FrameTiming *timing, size_t trailer)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (this->Queued())
+		{
+			this->Await([&] { return this->Idle(); });
+		}
+
+		if (!this->handle || !this->Transfer(send, true, true, false))
+		{
+			return false;
+		}
+
+		waiting = true;
+
+		if (timing)
+		{
+			timing->sent = FrameTiming::Clock::now();
+		}
+
+		// The rest of the response may end with a short packet, so the trailer is read separately
+		int transferred		= 0;
+		const size_t split	= receive.Size() - std::min(trailer, receive.Size());
+		const bool result	= (!split || this->Transfer(receive.Data(), split, false, true, transferred))
+			&& (split == receive.Size() || this->Transfer(receive.Data() + split, receive.Size() - split, false, true, transferred));
+
+		if (timing)
+		{
+			timing->first = timing->received = FrameTiming::Clock::now();
+		}
+
+		return result;
+	}
+
+
+	TransportPool::Lease UsbTransport::Lease(size_t size)
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->pool.Acquire(this->backend->Mapped() ? this->handle : nullptr, size);
+	}
+
+
+	TransportPool::Statistics UsbTransport::BufferStatistics()
+	{
+		return this->pool.Stats();
+	}
+
+
+	bool UsbTransport::Transfer(std::vector<byte> *buffer, bool write, bool check, bool truncate)
+	{
+		if (buffer)
+		{
+			int transferred		= 0;
+			const bool result	= this->Transfer(buffer->data(), buffer->size(), write, check, transferred);
+
+			// When requested, truncate the buffer to the size of data actually received.
+			if (!write && result && truncate)
+			{
+				buffer->resize(transferred);
+			}
+
+			return result;
+		}
+
+		return true;
+	}
+
+
+	bool UsbTransport::Transfer(byte *data, size_t size, bool write, bool check, int &transferred)
+	{
+		// emg::Timer timer;
+
+		bool result	= false;
+		int err		= this->backend->Transfer(this->handle, write ? WRITE_PIPE : READ_PIPE, data, size, &transferred, this->timeout);
+
+		// const auto time = timer.MicroElapsed();
+
+		if (!err)
+		{
+			result = (write || check) ? transferred == (int)size : true;
+
+			if (!result)
+			{
+				emg::Log::Error(
+					"%u: USB device %s - Incomplete transfer when %s (%d of %d bytes)",
+					emg::Timestamp::LogTime(),
+					this->id,
+					write ? "writing" : "reading",
+					transferred,
+					size
+				);
+			}
+		}
+		else if (this->legacy && (err == LIBUSB_ERROR_NO_DEVICE || err == LIBUSB_ERROR_IO))
+		{
+			emg::Log::Error("%u: USB device %s - Device has been disconnected", emg::Timestamp::LogTime(), this->id);
+			this->Release();
+		}
+		else
+		{
+			// std::cout << "time spent transferring: " << time << "us\n";
+			emg::Log::Error("%u: USB device %s - %s (%d) when %s (%d bytes transferred)", emg::Timestamp::LogTime(), this->id, libusb_error_name(err), err, write ? "writing" : "reading", transferred);
+		}
+
+		return result;
+	}
+
+
+	void UsbTransport::SetTransfers(size_t count, size_t size)
+	{
+		std::lock_guard lock(this->stream);
+
+		if (this->Busy() || this->frames.size())
+		{
+			emg::Log::Error("%u: USB device %s - Unable to change streaming transfers whilst frames are queued", emg::Timestamp::LogTime(), this->id);
+			return;
+		}
+
+		for (auto &slot : this->slots)
+		{
+			libusb_free_transfer(slot.read);
+		}
+
+		this->slots.clear();
+		this->transfers	= std::max<size_t>(count, 1);
+		this->chunk		= std::max<size_t>(size, 1024);
+	}
+
+
+	bool UsbTransport::Queue(const std::vector<byte> &command, size_t size, std::atomic<bool> &waiting, size_t trailer)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (!this->handle || !size)
+		{
+			return false;
+		}
+
+		std::lock_guard guard(this->stream);
+
+		auto &frame		= this->frames.emplace_back();
+		frame.waiting	= &waiting;
+		frame.data		= this->pool.Acquire(this->backend->Mapped() ? this->handle : nullptr, size);
+		frame.split		= size - std::min(trailer, size);
+		frame.write		= libusb_alloc_transfer(0);
+
+		// The command is owned (and freed) by the transfer since it can outlive a discarded frame
+		auto buffer = frame.write ? static_cast<byte *>(std::malloc(command.size())) : nullptr;
+
+		if (buffer)
+		{
+			std::memcpy(buffer, command.data(), command.size());
+
+			libusb_fill_bulk_transfer(frame.write, this->handle, WRITE_PIPE, buffer, command.size(), &UsbTransport::OnWrite, this, this->timeout);
+			frame.write->flags |= LIBUSB_TRANSFER_FREE_BUFFER;
+
+			if (this->backend->Submit(frame.write) == 0)
+			{
+				this->writing++;
+				this->Submit();
+				return true;
+			}
+		}
+
+		if (frame.write)
+		{
+			libusb_free_transfer(frame.write);
+		}
+
+		emg::Log::Error("%u: USB device %s - Unable to queue streaming request", emg::Timestamp::LogTime(), this->id);
+
+		this->frames.pop_back();
+
+		return false;
+	}
+
+
+	bool UsbTransport::Collect(TransportPool::Lease &receive, FrameTiming *timing)
+	{
+		if (!this->Queued())
+		{
+			return false;
+		}
+
+		this->Await([&] { return this->frames.front().Complete(); });
+
+		std::lock_guard lock(this->stream);
+
+		auto &frame = this->frames.front();
+
+		if (!frame.Complete())
+		{
+			return false;
+		}
+
+		const bool result	= !frame.failed;
+		receive				= std::move(frame.data);
+
+		if (timing)
+		{
+			*timing = frame.timing;
+		}
+
+		this->frames.pop_front();
+
+		return result;
+	}
+
+
+	bool UsbTransport::Ready()
+	{
+		std::lock_guard lock(this->stream);
+
+		return this->frames.size() && this->frames.front().Complete();
+	}
+
+
+	size_t UsbTransport::Queued()
+	{
+		std::lock_guard lock(this->stream);
+
+		return this->frames.size();
+	}
+
+
+	void UsbTransport::Flush()
+	{
+		if (!this->Queued())
+		{
+			return;
+		}
+
+		if (!this->Await([&] { return this->Idle(); }))
+		{
+			// Transfers are stuck so cancel them, they complete once events are next handled
+			this->Abort();
+		}
+
+		std::lock_guard lock(this->stream);
+
+		this->Discard();
+	}
+
+
+	void UsbTransport::Cancel()
+	{
+		this->Abort();
+
+		std::lock_guard lock(this->stream);
+
+		this->Discard();
+	}
+
+
+	void UsbTransport::Discard()
+	{
+		// Any transfers still in flight hold a lease on their destination so it is not reused
+		// until they complete, but there is no longer a frame to account the data against
+		for (auto &slot : this->slots)
+		{
+			slot.frame = nullptr;
+		}
+
+		this->frames.clear();
+	}
+
+
+	bool UsbTransport::Idle() const
+	{
+		return std::all_of(this->frames.begin(), this->frames.end(), [](auto &f) { return f.Complete(); });
+	}
+
+
+	bool UsbTransport::Busy() const
+	{
+		return this->writing || std::any_of(this->slots.begin(), this->slots.end(), [](auto &s) { return s.busy; });
+	}
+
+
+	bool UsbTransport::Drain()
+	{
+		const auto limit = std::chrono::steady_clock::now() + std::chrono::milliseconds(2 * this->timeout + 1000);
+
+		while (true)
+		{
+			{
+				std::lock_guard lock(this->stream);
+
+				if (!this->Busy())
+				{
+					return true;
+				}
+			}
+
+			struct timeval tv = { 0, 100000 };
+
+			if (std::chrono::steady_clock::now() >= limit || this->backend->Handle(this->context, &tv) < 0)
+			{
+				return false;
+			}
+		}
+	}
+
+
+	void UsbTransport::Submit()
+	{
+		if (!this->handle)
+		{
+			return;
+		}
+
+		if (this->slots.empty())
+		{
+			this->slots.resize(this->transfers);
+
+			for (auto &slot : this->slots)
+			{
+				slot.owner	= this;
+				slot.read	= libusb_alloc_transfer(0);
+			}
+		}
+
+		for (auto &slot : this->slots)
+		{
+			if (slot.busy || !slot.read)
+			{
+				continue;
+			}
+
+			auto frame = std::find_if(this->frames.begin(), this->frames.end(), [](auto &f) {
+				return !f.failed && f.requested < f.data->Size();
+			});
+
+			if (frame == this->frames.end())
+			{
+				break;
+			}
+
+			// Read transfers on an endpoint complete in the order they were submitted,
+			// so chunks can be handed out sequentially across the queued frames. A chunk
+			// never runs on into the trailer since the data before it may end short.
+			const size_t end	= frame->requested < frame->split ? frame->split : frame->data->Size();
+			const size_t length	= std::min(this->chunk, end - frame->requested);
+
+			libusb_fill_bulk_transfer(slot.read, this->handle, READ_PIPE, frame->data->Data() + frame->requested, length, &UsbTransport::OnRead, &slot, this->timeout);
+
+			if (this->backend->Submit(slot.read))
+			{
+				emg::Log::Error("%u: USB device %s - Unable to submit streaming transfer", emg::Timestamp::LogTime(), this->id);
+				frame->failed = true;
+				break;
+			}
+
+			slot.busy		= true;
+			slot.frame		= &*frame;
+			slot.data		= frame->data;
+			frame->requested += length;
+			frame->outstanding++;
+		}
+	}
+
+
+	template <typename Condition> bool UsbTransport::Await(Condition condition)
+	{
+		// Every transfer is subject to the timeout so the stream should always progress within
+		// that period. The limit guards against a device that stops responding altogether.
+		const auto limit = std::chrono::steady_clock::now() + std::chrono::milliseconds(2 * this->timeout + 1000);
+
+		while (!this->timeout || std::chrono::steady_clock::now() < limit)
+		{
+			{
+				std::lock_guard lock(this->stream);
+
+				if (condition())
+				{
+					return true;
+				}
+
+				const bool active = std::any_of(this->frames.begin(), this->frames.end(), [](auto &f) {
+					return f.write || f.outstanding;
+				});
+
+				if (!active)
+				{
+					// Nothing is in flight that could progress the stream so fail whatever is left
+					for (auto &frame : this->frames)
+					{
+						frame.failed = true;
+					}
+
+					return condition();
+				}
+			}
+
+			struct timeval tv = { 0, 100000 };
+
+			if (this->backend->Handle(this->context, &tv) < 0)
+			{
+				return false;
+			}
+		}
+
+		return false;
+	}
+
+
+	void UsbTransport::Abort()
+	{
+		std::lock_guard lock(this->stream);
+
+		for (auto &frame : this->frames)
+		{
+			frame.failed = true;
+
+			if (frame.write)
+			{
+				this->backend->Cancel(frame.write);
+			}
+		}
+
+		for (auto &slot : this->slots)
+		{
+			if (slot.busy)
+			{
+				this->backend->Cancel(slot.read);
+			}
+		}
+	}
+
+
+	void LIBUSB_CALL UsbTransport::OnWrite(libusb_transfer *transfer)
+	{
+		auto self = reinterpret_cast<UsbTransport *>(transfer->user_data);
+
+		std::lock_guard lock(self->stream);
+
+		self->writing--;
+
+		// The frame will be missing if it was discarded whilst the command was in flight
+		for (auto &frame : self->frames)
+		{
+			if (frame.write == transfer)
+			{
+				if (transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length == transfer->length)
+				{
+					*frame.waiting		= true;
+					frame.timing.sent	= FrameTiming::Clock::now();
+				}
+				else
+				{
+					emg::Log::Error("%u: USB device %s - Streaming command failed with status %d", emg::Timestamp::LogTime(), self->id, transfer->status);
+					frame.failed = true;
+				}
+
+				frame.write = nullptr;
+				break;
+			}
+		}
+
+		libusb_free_transfer(transfer);
+	}
+
+
+	void LIBUSB_CALL UsbTransport::OnRead(libusb_transfer *transfer)
+	{
+		auto slot = reinterpret_cast<Slot *>(transfer->user_data);
+		auto self = slot->owner;
+
+		std::lock_guard lock(self->stream);
+
+		auto frame	= slot->frame;
+		slot->busy	= false;
+		slot->frame	= nullptr;
+		slot->data.reset();
+
+		// The frame will be missing if it was discarded whilst the transfer was in flight
+		if (!frame)
+		{
+			return;
+		}
+
+		frame->outstanding--;
+
+		if (transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length == transfer->length)
+		{
+			const auto now = FrameTiming::Clock::now();
+
+			if (!frame->received)
+			{
+				frame->timing.first = now;
+			}
+
+			frame->received			+= transfer->actual_length;
+			frame->timing.received	= now;
+		}
+		else
+		{
+			if (!frame->failed)
+			{
+				emg::Log::Error(
+					"%u: USB device %s - Streaming read failed with status %d (%d of %d bytes)",
+					emg::Timestamp::LogTime(),
+					self->id,
+					transfer->status,
+					transfer->actual_length,
+					transfer->length
+				);
+			}
+
+			// Subsequent data can no longer be trusted to line up with the queued frames, but any
+			// earlier frames have already been received in full
+			auto failed = std::find_if(self->frames.begin(), self->frames.end(), [&](auto &f) { return &f == frame; });
+
+			for (; failed != self->frames.end(); failed++)
+			{
+				failed->failed = true;
+			}
+		}
+
+		self->Submit();
+	}
+}
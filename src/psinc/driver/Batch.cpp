@@ -0,0 +1,290 @@
+#include "psinc/driver/Batch.h"
+#include "psinc/driver/Register.h"
+#include "psinc/driver/Commands.h"
+#include <emergent/logger/Logger.hpp>
+#include <algorithm>
+#include <atomic>
+
+using namespace std;
+
+
+namespace psinc
+{
+	void Batch::Begin()
+	{
+		std::lock_guard lock(this->cs);
+
+		this->depth++;
+	}
+
+
+	bool Batch::Commit()
+	{
+		{
+			std::lock_guard lock(this->cs);
+
+			if (this->depth > 1 || !this->depth)
+			{
+				this->depth = std::max(this->depth - 1, 0);
+				return true;
+			}
+
+			this->depth = 0;
+
+			if (this->shadow)
+			{
+				// Staged writes are kept until flushed
+				return true;
+			}
+		}
+
+		return this->Send();
+	}
+
+
+	bool Batch::Flush()
+	{
+		return this->Send();
+	}
+
+
+	bool Batch::Send()
+	{
+		std::lock_guard guard(this->sending);
+
+		{
+			std::lock_guard lock(this->cs);
+			this->Prepare(this->staged.size());
+		}
+
+		// The staged writes can continue to change whilst the transfers are made
+		auto &writes	= this->inflight;
+		size_t sent		= 0;
+
+		for (; sent<writes.size(); sent+=MAX_COMMANDS)
+		{
+			atomic<bool> waiting(false);
+
+			const size_t count = std::min(MAX_COMMANDS, writes.size() - sent);
+			std::vector<byte> data(5, 0x00);	// Header
+
+			data.reserve(5 + 5 * count + 1);
+
+			this->Pack(data, sent, count);
+
+			data.push_back(0xff);	// Terminator
+
+			if (!this->transport || !this->transport->Transfer(&data, nullptr, waiting))
+			{
+				emg::Log::Error("%u: Failed to commit a batch of %d register writes", emg::Timestamp::LogTime(), (int)(writes.size() - sent));
+				break;
+			}
+
+			for (size_t j=sent; j<sent+count; j++)
+			{
+				writes[j].first->Initialise(0, 0xffff, writes[j].second);
+			}
+		}
+
+		std::lock_guard lock(this->cs);
+
+		const bool result = sent >= writes.size();
+
+		this->Restage(std::min(sent, writes.size()));
+
+		return result;
+	}
+
+
+	void Batch::Carry(std::vector<byte> &packet)
+	{
+		this->sending.lock();
+
+		std::lock_guard lock(this->cs);
+
+		if (this->shadow)
+		{
+			// The packet already holds a header, at least one command and the terminator
+			const size_t used = (packet.size() - 6) / 5;
+
+			this->Prepare(MAX_COMMANDS - std::min(used, MAX_COMMANDS));
+
+			std::vector<byte> data(packet.begin(), packet.begin() + 5);
+
+			data.reserve(packet.size() + 5 * this->inflight.size());
+
+			this->Pack(data, 0, this->inflight.size());
+
+			data.insert(data.end(), packet.begin() + 5, packet.end());
+			packet.swap(data);
+		}
+	}
+
+
+	void Batch::Carried(bool sent)
+	{
+		if (sent)
+		{
+			for (auto &w : this->inflight)
+			{
+				w.first->Initialise(0, 0xffff, w.second);
+			}
+		}
+
+		{
+			std::lock_guard lock(this->cs);
+			this->Restage(sent ? this->inflight.size() : 0);
+		}
+
+		this->sending.unlock();
+	}
+
+
+	void Batch::Prepare(size_t limit)
+	{
+		// Writes that would not change anything are dropped
+		auto item = this->staged.begin();
+
+		for (; item != this->staged.end() && this->inflight.size() < limit; item++)
+		{
+			if (item->first->Cached() != item->second)
+			{
+				this->inflight.push_back(*item);
+			}
+		}
+
+		this->staged.erase(this->staged.begin(), item);
+	}
+
+
+	void Batch::Pack(std::vector<byte> &data, size_t from, size_t count)
+	{
+		for (size_t i=from; i<from+count; i++)
+		{
+			const int address	= this->inflight[i].first->Address();
+			const int value		= this->inflight[i].second;
+
+			data.insert(data.end(), {
+				Commands::WriteRegister,
+				(byte)(address & 0xff),
+				(byte)((address >> 8) & 0xff),
+				(byte)(value & 0xff),
+				(byte)((value >> 8) & 0xff)
+			});
+		}
+	}
+
+
+	void Batch::Restage(size_t sent)
+	{
+		if (sent < this->inflight.size())
+		{
+			// Stage the unsent writes again in their original order. Anything staged for the same
+			// register since was based upon the unsent value and so supersedes it.
+			std::vector<std::pair<Register *, int>> restaged(this->inflight.begin() + sent, this->inflight.end());
+
+			for (auto &r : restaged)
+			{
+				auto item = std::find_if(this->staged.begin(), this->staged.end(), [&](auto &s) { return s.first == r.first; });
+
+				if (item != this->staged.end())
+				{
+					r.second = item->second;
+					this->staged.erase(item);
+				}
+			}
+
+			restaged.insert(restaged.end(), this->staged.begin(), this->staged.end());
+			this->staged.swap(restaged);
+		}
+
+		this->inflight.clear();
+	}
+
+
+	void Batch::Discard()
+	{
+		std::lock_guard lock(this->cs);
+
+		this->depth = 0;
+		this->staged.clear();
+	}
+
+
+	bool Batch::Active()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->depth > 0 || this->shadow;
+	}
+
+
+	void Batch::Shadow(bool enabled)
+	{
+		std::lock_guard lock(this->cs);
+
+		this->shadow = enabled;
+	}
+
+
+	bool Batch::Shadowing()
+	{
+		return this->shadow;
+	}
+
+
+	size_t Batch::Dirty()
+	{
+		std::lock_guard lock(this->cs);
+
+		return this->staged.size();
+	}
+
+
+	bool Batch::Stage(Register *target, int offset, int mask, int value)
+	{
+		std::lock_guard lock(this->cs);
+
+		if (!this->depth && !this->shadow)
+		{
+			return false;
+		}
+
+		auto item = std::find_if(this->staged.begin(), this->staged.end(), [&](auto &s) { return s.first == target; });
+
+		if (item == this->staged.end())
+		{
+			// Start from the value being sent, if there is one, since it will soon be the cached value
+			auto sending	= std::find_if(this->inflight.begin(), this->inflight.end(), [&](auto &s) { return s.first == target; });
+			item			= this->staged.insert(this->staged.end(), { target, sending != this->inflight.end() ? sending->second : target->Cached() });
+		}
+
+		item->second = (item->second & ~mask) | ((value << offset) & mask);
+
+		return true;
+	}
+
+
+	bool Batch::Pending(const Register *target, int &value)
+	{
+		if (!this->shadow)
+		{
+			return false;
+		}
+
+		std::lock_guard lock(this->cs);
+
+		for (auto writes : { &this->staged, &this->inflight })
+		{
+			auto item = std::find_if(writes->begin(), writes->end(), [&](auto &s) { return s.first == target; });
+
+			if (item != writes->end())
+			{
+				value = item->second;
+				return true;
+			}
+		}
+
+		return false;
+	}
+}
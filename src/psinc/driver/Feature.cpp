@@ -1,6 +1,7 @@
 #include "psinc/driver/Feature.h"
 
 #include <emergent/logger/Logger.hpp>
+#include <algorithm>
 
 using namespace std;
 using namespace pugi;
@@ -32,6 +33,22 @@ namespace psinc
 	}
 
 
+	Feature::Feature(const chip::FeatureDescription &description, Register *parent)
+	{
+		this->parent		= parent;
+		this->defaultValue	= description.defaultValue;
+		this->offset		= description.offset;
+		this->bits			= description.bits;
+		this->readonly		= description.readonly;
+		this->minimum		= description.minimum;
+		this->maximum		= description.maximum;
+		this->flag			= this->bits == 1;
+		this->mask			= ((1 << this->bits) - 1) << this->offset;
+
+		this->invalid.assign(description.invalid.begin(), description.invalid.begin() + description.invalidCount);
+	}
+
+
 	void Feature::Invalidate(string values)
 	{
 		if (values.size())
@@ -52,12 +69,12 @@ namespace psinc
 						{
 							int end	= strtol(limits[1].c_str(), &check, 0);
 
-							if (check < limits[1].c_str())
+							if (check > limits[1].c_str())
 							{
-								for (int i=start; i<=end; i++) this->invalid.insert(i);
+								this->invalid.push_back({ start, end });
 							}
 						}
-						else this->invalid.insert(start);
+						else this->invalid.push_back({ start, start });
 					}
 				}
 			}
@@ -67,7 +84,9 @@ namespace psinc
 
 	bool Feature::Valid(int value)
 	{
-		return value >= this->minimum && value <= this->maximum && !this->invalid.count(value);
+		return value >= this->minimum && value <= this->maximum && std::none_of(
+			this->invalid.begin(), this->invalid.end(), [&](auto &range) { return value >= range.start && value <= range.end; }
+		);
 	}
 
 
@@ -9,17 +9,24 @@ using namespace emergent;
 
 namespace psinc
 {
-	Register::Register(xml_node configuration, Transport *transport, int addressSize)
+	Register::Register(xml_node configuration, Transport *transport, int addressSize, Batch *batch)
+		: Register(strtol(configuration.attribute("address").as_string("0x00"), nullptr, 0), transport, addressSize, batch)
+	{
+	}
+
+
+	Register::Register(int address, Transport *transport, int addressSize, Batch *batch)
 	{
 		// A page is 512 bytes, therefore with byte-level addressing the mask
 		// should be 0x1ff. For chips with 16-bit addressing (v024) the mask
 		// will be 0xff (since addressSize is 2).
 		int mask		= 0x1ff / addressSize;
-		this->address	= strtol(configuration.attribute("address").as_string("0x00"), nullptr, 0);
+		this->address	= address;
 		this->offset 	= addressSize * (address & mask);
 		this->page		= (address & ~mask) >> 8;
 		this->value		= 0;
 		this->transport	= transport;
+		this->batch		= batch;
 	}
 
 
@@ -36,11 +43,41 @@ namespace psinc
 
 
 	int Register::Get()
+	{
+		int pending = 0;
+
+		if (this->batch && this->batch->Pending(this, pending))
+		{
+			return pending;
+		}
+
+		if (this->dynamic)
+		{
+			this->Refresh();
+		}
+
+		return this->value;
+	}
+
+
+	int Register::Cached() const
 	{
 		return this->value;
 	}
 
 
+	void Register::SetVolatile(bool enabled)
+	{
+		this->dynamic = enabled;
+	}
+
+
+	bool Register::Volatile() const
+	{
+		return this->dynamic;
+	}
+
+
 	int Register::Address()
 	{
 		return this->address;
@@ -49,6 +86,11 @@ namespace psinc
 
 	bool Register::Set(int offset, int mask, int value)
 	{
+		if (this->batch && this->batch->Stage(this, offset, mask, value))
+		{
+			return true;
+		}
+
 		atomic<bool> waiting(false);
 
 		int updated = (this->value & ~mask) | ((value << offset) & mask);
@@ -79,6 +121,11 @@ namespace psinc
 
 	bool Register::SetBit(int offset, bool value)
 	{
+		if (this->batch && this->batch->Stage(this, offset, 1 << offset, value ? 1 : 0))
+		{
+			return true;
+		}
+
 		atomic<bool> waiting(false);
 
 		int updated = value ? (this->value | (1 << offset)) : this->value & ~(1 << offset);
@@ -0,0 +1,30 @@
+#include "psinc/xml/Devices.h"
+#include "v024.hpp"
+#include "mt9.hpp"
+
+
+namespace psinc
+{
+	namespace chip
+	{
+		const char *v024	= source::v024;
+		const char *mt9		= source::mt9;
+
+
+		namespace
+		{
+			constexpr auto V024_COUNTS	= Measure(source::v024);
+			constexpr auto MT9_COUNTS	= Measure(source::mt9);
+
+			constexpr auto V024_TABLE	= Parse<V024_COUNTS.registers, V024_COUNTS.features, V024_COUNTS.aliases>(source::v024);
+			constexpr auto MT9_TABLE	= Parse<MT9_COUNTS.registers, MT9_COUNTS.features, MT9_COUNTS.aliases>(source::mt9);
+		}
+
+
+		namespace table
+		{
+			const Description v024	= V024_TABLE.View();
+			const Description mt9	= MT9_TABLE.View();
+		}
+	}
+}
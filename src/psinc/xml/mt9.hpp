@@ -1,4 +1,6 @@
-namespace psinc { namespace chip { const char *mt9 = R"xml(
+#pragma once
+
+namespace psinc { namespace chip { namespace source { constexpr char mt9[] = R"xml(
 <?xml version="1.0" encoding="utf-8"?>
 <camera chip="mt9" bits="16" manufacturer="PSI" author="dan" contexts="2" hdr="true" bayer="2" sizeByRange="true">
 	<alias context="0" name="ColumnStart" feature="x_addr_start" />
@@ -266,7 +268,7 @@ namespace psinc { namespace chip { const char *mt9 = R"xml(
 	<register address="0x31ee"><feature name="vertical_cursor_width" bits="11" min="0" max="2047" default="0" /></register>
 	<register address="0x31fc"><feature name="i2c_ids" bits="16" min="0" max="65535" default="12320" /></register>
 </camera>
-)xml"; }}
+)xml"; }}}
 
 
 
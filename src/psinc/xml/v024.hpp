@@ -1,4 +1,6 @@
-namespace psinc { namespace chip { const char *v024 = R"xml(
+#pragma once
+
+namespace psinc { namespace chip { namespace source { constexpr char v024[] = R"xml(
 <?xml version="1.0" encoding="utf-8"?>
 <camera chip="v024" bits="16" manufacturer="PSI" author="dan" contexts="2" addressSize="2" bayer="3">
 	<alias context="0" name="Width" feature="A: Window Width" />
@@ -500,4 +502,4 @@ namespace psinc { namespace chip { const char *v024 = R"xml(
 		<feature name="Register Lock Code" bits="16" min="48879" max="57007" default="48879" invalid="48880-57004,57006" />
 	</register>
 </camera>
-)xml"; }}
+)xml"; }}}